@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "RamBuffer.h"
+
+// Same interface as RamBuffer, but the entries of each type are stored compressed:
+// delta-of-delta encoded times and XOR encoded float values (Gorilla), in blocks of
+// COMPRESSEDBUFFER_BLOCK_SIZE bytes. The oldest block of a type is dropped if its ring is full.
+
+#define COMPRESSEDBUFFER_BLOCK_SIZE 64
+#define COMPRESSEDBUFFER_BLOCK_ENTRIES 64 // max. entries per block
+#define COMPRESSEDBUFFER_HEADER_ID 0x12345679
+
+#pragma pack(2)
+typedef struct
+{
+    uint16_t count; // number of entries
+    uint32_t time; // first entry
+    float value; // first entry
+    uint8_t data[COMPRESSEDBUFFER_BLOCK_SIZE - 10]; // all other entries, bit stream
+} compressedBlock_t;
+
+typedef struct
+{
+    uint16_t start; // first block of this segment
+    uint16_t capacity; // number of blocks of this segment
+    uint16_t first; // oldest block, relative to start
+    uint16_t count; // number of used blocks, the newest one is open for writing
+
+    // encoder state of the newest block
+    uint16_t bitPos;
+    int32_t prevDelta;
+    uint32_t prevValue;
+    uint8_t prevLeading;
+    uint8_t prevTrailing;
+    dataEntry_t last; // newest entry
+} compressedSegment_t;
+
+typedef struct
+{
+    uint32_t id; // COMPRESSEDBUFFER_HEADER_ID
+    uint32_t timeBase; // added to millis(), keeps the entry times increasing after a reset
+    compressedSegment_t segment[RAMBUFFER_TYPE_COUNT];
+    uint32_t crc; // of all fields above
+} compressedHeader_t;
+#pragma pack()
+
+// Reads the entries of one block, oldest first
+class CompressedBlockDecoder {
+public:
+    CompressedBlockDecoder(const compressedBlock_t* block, RamDataType_t type); // block may be nullptr -> no entries
+
+    // false if all entries are read
+    bool next(dataEntry_t& entry);
+    uint16_t index() const { return _index; }
+
+private:
+    const compressedBlock_t* _block;
+    RamDataType_t _type;
+    uint16_t _index;
+    uint16_t _pos;
+    uint32_t _time;
+    int32_t _delta;
+    uint32_t _value;
+    uint8_t _leading;
+    uint8_t _trailing;
+};
+
+class CompressedRamBuffer {
+public:
+    // capacities: number of uncompressed entries per RamDataType_t, the same memory holds more entries compressed
+    CompressedRamBuffer(uint8_t* buffer, size_t size, const uint16_t* capacities);
+    void PowerOnInitialize();
+    bool Restore();
+
+    static constexpr size_t blocksFor(uint16_t capacity)
+    {
+        size_t blocks = capacity * sizeof(dataEntry_t) / sizeof(compressedBlock_t);
+        return capacity == 0 ? 0 : (blocks < 2 ? 2 : blocks);
+    }
+
+    static constexpr size_t requiredSize(const uint16_t* capacities)
+    {
+        size_t blocks = 0;
+        for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+            blocks += blocksFor(capacities[i]);
+        }
+        return sizeof(compressedHeader_t) + blocks * sizeof(compressedBlock_t);
+    }
+
+    time_t now() const { return millis() + _header->timeBase; }
+
+    // Entries of one segment starting at startTime, oldest first. The entries are decoded
+    // into the iterator, a reference is only valid until the next increment.
+    class Iterator {
+    public:
+        Iterator(CompressedRamBuffer& buffer, const compressedSegment_t& seg, RamDataType_t type, uint16_t block, time_t startTime)
+            : _buffer(buffer)
+            , _seg(seg)
+            , _type(type)
+            , _block(block)
+            , _decoder(block < seg.count ? buffer.blockAt(seg, block) : nullptr, type)
+            , _valid(false)
+        {
+            do {
+                advance();
+            } while (_valid && _entry.time < startTime);
+        }
+        dataEntry_t& operator*() { return _entry; }
+        dataEntry_t* operator->() { return &_entry; }
+        Iterator& operator++()
+        {
+            advance();
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const
+        {
+            return _valid != other._valid || (_valid && (_block != other._block || _decoder.index() != other._decoder.index()));
+        }
+
+    private:
+        void advance()
+        {
+            while (!_decoder.next(_entry)) {
+                if (_block + 1 >= _seg.count) {
+                    _block = _seg.count;
+                    _valid = false;
+                    return;
+                }
+                _block++;
+                _decoder = CompressedBlockDecoder(_buffer.blockAt(_seg, _block), _type);
+            }
+            _valid = true;
+        }
+
+        CompressedRamBuffer& _buffer;
+        const compressedSegment_t& _seg;
+        RamDataType_t _type;
+        uint16_t _block;
+        CompressedBlockDecoder _decoder;
+        dataEntry_t _entry;
+        bool _valid;
+    };
+
+    class Range {
+    public:
+        Range(CompressedRamBuffer& buffer, RamDataType_t type, time_t startTime)
+            : _buffer(buffer)
+            , _type(type)
+            , _startTime(startTime)
+        {
+        }
+        Iterator begin() const
+        {
+            const compressedSegment_t& seg = _buffer.segment(_type);
+            return Iterator(_buffer, seg, _type, _buffer.toStartBlock(seg, _startTime), _startTime);
+        }
+        Iterator end() const
+        {
+            const compressedSegment_t& seg = _buffer.segment(_type);
+            return Iterator(_buffer, seg, _type, seg.count, 0);
+        }
+
+    private:
+        CompressedRamBuffer& _buffer;
+        RamDataType_t _type;
+        time_t _startTime;
+    };
+
+    void writeValue(RamDataType_t type, time_t time, float value);
+    dataEntry_t* getLastEntry(RamDataType_t type);
+
+    // entries of the last lastMillis, see RamBuffer::entries
+    Range entries(RamDataType_t type, time_t lastMillis) { return Range(*this, type, now() - lastMillis); }
+
+    template <typename F>
+    void forAllEntries(RamDataType_t type, time_t lastMillis, F&& doDataEntry)
+    {
+        for (auto& entry : entries(type, lastMillis)) {
+            doDataEntry(&entry);
+        }
+    }
+
+    size_t copyEntries(RamDataType_t type, time_t startTime, size_t skip, time_t endTime, dataEntry_t* entries, size_t maxEntries);
+
+private:
+    compressedSegment_t& segment(RamDataType_t type) { return _header->segment[static_cast<size_t>(type)]; }
+    // pos: 0 is the oldest block of the segment, seg.count - 1 the newest
+    compressedBlock_t* blockAt(const compressedSegment_t& seg, uint16_t pos) { return &_blocks[seg.start + (seg.first + pos) % seg.capacity]; }
+    void newBlock(compressedSegment_t& seg, time_t time, float value);
+    uint16_t toStartBlock(const compressedSegment_t& seg, time_t startTime);
+    uint32_t calculateCrc() const;
+    void updateCrc() { _header->crc = calculateCrc(); }
+
+private:
+    compressedHeader_t* _header;
+    compressedBlock_t* _blocks;
+    size_t _elements; // number of blocks
+    uint16_t _capacities[RAMBUFFER_TYPE_COUNT]; // number of blocks
+};
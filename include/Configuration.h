@@ -8,7 +8,7 @@
 #include <condition_variable>
 
 #define CONFIG_FILENAME "/config.json"
-#define CONFIG_VERSION 0x00011d00 // 0.1.29 // make sure to clean all after change
+#define CONFIG_VERSION 0x00011e00 // 0.1.30 // make sure to clean all after change
 
 #define WIFI_MAX_SSID_STRLEN 32
 #define WIFI_MAX_PASSWORD_STRLEN 64
@@ -27,6 +27,8 @@
 #define MQTT_MAX_CERT_STRLEN 2560
 
 #define SHELLY_MAX_HOSTNAME_STRLEN 128
+#define SHELLY_MAX_JSONPATH_STRLEN 47
+#define SHELLY_MAX_DEVICES 6
 
 #define INV_MAX_NAME_STRLEN 31
 #define INV_MAX_COUNT 10
@@ -59,6 +61,14 @@ struct INVERTER_CONFIG_T {
     CHANNEL_CONFIG_T channel[INV_MAX_CHAN_COUNT];
 };
 
+struct SHELLY_DEVICE_CONFIG_T {
+    char Hostname[SHELLY_MAX_HOSTNAME_STRLEN + 1]; // empty: slot not used
+    uint8_t Role; // ShellyRole_t
+    uint8_t Type; // ShellyDeviceType_t
+    char JsonPath[SHELLY_MAX_JSONPATH_STRLEN + 1]; // empty: default path of the type
+    uint8_t Transport; // ShellyTransport_t, WebSocket or Mqtt (Hostname is the topic prefix)
+};
+
 struct CONFIG_T {
     struct {
         uint32_t Version;
@@ -142,14 +152,19 @@ struct CONFIG_T {
 
     struct {
         bool ShellyEnable;
-        char Hostname_Pro3EM[SHELLY_MAX_HOSTNAME_STRLEN + 1];
-        char Hostname_PlugS[SHELLY_MAX_HOSTNAME_STRLEN + 1];
+        SHELLY_DEVICE_CONFIG_T Devices[SHELLY_MAX_DEVICES];
         bool LimitEnable;
         uint32_t MaxPower;
         uint32_t MinPower;
         int32_t TargetValue;
         uint32_t FeedInLevel;
         uint32_t ViewOption;
+        uint8_t GridPhase; // 0: total of all phases, 1..3: phase A..C
+        uint32_t HttpInterval; // [ms] RPC polling while the websocket is down, 0: off
+        uint8_t ControlStrategy; // LimitStrategy_t
+        float PiKp;
+        float PiKi; // [1/s]
+        float PiKff; // feed-forward of the generation
     } Shelly;
 
     struct {
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ctime>
+#include <functional>
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#pragma pack(2)
+typedef struct
+{
+    uint32_t time; // start of the bucket [ms]
+    float min;
+    float max;
+    float mean;
+    uint16_t count; // number of raw samples
+} historyBucket_t; // 4 + 4 + 4 + 4 + 2 => 18 Bytes
+#pragma pack()
+
+// Ring of buckets with a fixed duration. Samples and buckets of a finer tier are merged
+// into the open bucket, which is closed as soon as a value of a later bucket arrives.
+class HistoryTier {
+public:
+    HistoryTier(uint32_t duration, uint16_t capacity);
+
+    // returns true, if the open bucket was closed -> closed is valid
+    bool add(const historyBucket_t& bucket, historyBucket_t& closed);
+    void forAllBuckets(time_t startTime, const std::function<void(const historyBucket_t&)>& doBucket) const;
+
+    uint32_t getDuration() const { return _duration; }
+    time_t getLength() const { return static_cast<time_t>(_duration) * _buckets.size(); }
+    // start of the oldest bucket, the max. time_t if the tier is empty
+    time_t getStartTime() const;
+
+private:
+    uint32_t _duration;
+    std::vector<historyBucket_t> _buckets;
+    uint16_t _first;
+    uint16_t _count;
+
+    historyBucket_t _open;
+    double _openSum; // sum of all samples of the open bucket
+};
+
+// Downsampled history of one value: 10 s, 1 min and 15 min buckets.
+class HistoryTiers {
+public:
+    HistoryTiers();
+
+    void add(time_t time, float value);
+
+    // Returns the coarsest tier with at least minPoints buckets in the last lastMillis
+    // or nullptr if the raw values are fine enough. If the raw values start after now - lastMillis,
+    // the finest tier reaching back that far is returned, or the one reaching back furthest.
+    const HistoryTier* selectTier(time_t now, time_t lastMillis, size_t minPoints, time_t rawStartTime) const;
+
+    // time span of the coarsest tier [ms]
+    time_t getLength() const { return _tiers.back().getLength(); }
+
+private:
+    std::vector<HistoryTier> _tiers; // finest first
+};
@@ -2,6 +2,8 @@
 #pragma once
 
 #include "Configuration.h"
+#include "LimitDistribution.h"
+#include "LimitStrategy.h"
 #include "ShellyClientData.h"
 
 // #include <ArduinoJson.h>
@@ -15,6 +17,12 @@
 
 ////////////////////////
 
+// The control runs, when a new value of the grid meter is stored
+#define LIMIT_CONTROL_MIN_INTERVAL 200 // [ms] a burst of samples is handled by one run
+#define LIMIT_CONTROL_SEND_INTERVAL (10 * TASK_SECOND) // [ms] command budget of the inverter
+#define LIMIT_CONTROL_RETRY_INTERVAL TASK_SECOND // [ms] a pending limit, which couldn't be sent, is tried again
+#define LIMIT_CONTROL_ACK_TIMEOUT (30 * TASK_SECOND) // [ms] a command without acknowledge doesn't block further
+
 #if 1
 enum SendLimitResult_t {
     NoInverter,
@@ -30,6 +38,10 @@ public:
     void loop();
 
 private:
+    void Trigger();
+    RamDataType_t GridType() const;
+    LimitStrategy& Strategy(const CONFIG_T& config);
+    void UpdateInverters();
     void CalculateLimit();
     SendLimitResult_t SendLimit(float limit, float generatedPower);
 
@@ -44,6 +56,17 @@ private:
 
     float _actLimit;
     unsigned long _lastLimitSend;
+    unsigned long _lastRun;
+    bool _sendPending; // a new limit waits for the command budget
+    unsigned long _lastCalculate; // 0: first step of the strategy
+
+    HeuristicLimitStrategy _heuristic;
+    PiLimitStrategy _pi;
+    LimitStrategy_t _strategyType;
+
+    limitInverter_t _inverter[INV_MAX_COUNT];
+    uint8_t _inverterCount; // active inverters
+    float _inverterMaxPower; // [W] sum of the active inverters
 };
 
 extern LimitControlClass LimitControl;
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The total limit is split across all reachable inverters with enabled commands
+#define LIMIT_CONTROL_SIMILAR 15 // [W] smaller changes are not sent
+#define LIMIT_CONTROL_PRODUCTION_MARGIN 20 // [W] below limit - margin the inverter doesn't use its limit
+#define LIMIT_CONTROL_LATENCY_REF 1000 // [ms] inverters acknowledging faster get the full share of a change
+
+typedef struct {
+    uint64_t serial; // 0: no inverter at this position
+    bool active; // reachable, commands enabled
+    float maxPower; // [W]
+    float production; // [W]
+    float limit; // [W] last sent or read absolute limit
+    float target; // [W] result of the distribution
+    bool pending; // acknowledge of the last limit command outstanding
+    unsigned long sentMillis;
+    uint32_t latency; // [ms] smoothed time until acknowledge, 0: not known
+} limitInverter_t;
+
+// Splits a change of the total limit into the targets of the inverters.
+// Inverters where the change acts on the production come first, slow inverters get a smaller share.
+class LimitDistribution {
+public:
+    template <size_t N>
+    static void Distribute(limitInverter_t (&inverters)[N], float delta)
+    {
+        float room[N];
+        float weight[N];
+        Distribute(inverters, N, delta, room, weight);
+    }
+
+private:
+    static float Room(const limitInverter_t& inverter, bool increase, bool production);
+    static void Distribute(limitInverter_t* inverters, size_t count, float delta, float* room, float* weight);
+};
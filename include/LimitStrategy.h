@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+
+// Input of a control step, all powers in W
+typedef struct
+{
+    float gridPower; // > 0 import
+    float generatedPower; // sum of the generation devices (PlugS)
+    float actLimit; // limit sent last
+    float targetValue; // grid power to reach
+    float minLimit;
+    float maxLimit;
+    float dt; // [s] since the last step
+} limitInput_t;
+
+enum class LimitStrategy_t : uint8_t {
+    Heuristic,
+    PI,
+    MAX,
+};
+
+// Calculates the next limit of the inverter. LimitControl clamps and sends it.
+class LimitStrategy {
+public:
+    virtual ~LimitStrategy() = default;
+
+    // LIMIT_STRATEGY_NO_CHANGE: keep the actual limit
+    virtual float Calculate(const limitInput_t& input) = 0;
+    // the strategy was selected again or the control was interrupted
+    virtual void Reset() { }
+};
+
+#define LIMIT_STRATEGY_NO_CHANGE (-1.0e30f)
+
+// Steps towards the target outside of a dead band, a large export is reduced at once
+class HeuristicLimitStrategy : public LimitStrategy {
+public:
+    float Calculate(const limitInput_t& input) override;
+
+private:
+    static constexpr float Border = 10; // [W] dead band around the target
+    static constexpr float DecreaseFullBand = 50; // [W] export beyond the border, which is reduced at once
+    static constexpr float IncreaseFactor = 0.75f;
+    static constexpr float DecreaseFactor = 0.8f;
+    static constexpr float DecreaseFullFactor = 0.9f;
+};
+
+// Discrete PI controller on the grid error with feed-forward of the generation.
+// The integral only follows, while the output isn't limited (anti-windup).
+class PiLimitStrategy : public LimitStrategy {
+public:
+    PiLimitStrategy();
+    void SetParameter(float kp, float ki, float kff);
+
+    float Calculate(const limitInput_t& input) override;
+    void Reset() override { _integral = 0; }
+
+private:
+    float _kp;
+    float _ki; // [1/s]
+    float _kff;
+    float _integral; // [W]
+};
@@ -1,9 +1,10 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
-#include <functional>
+#include <Arduino.h>
 
 #include <ctime>
+#include <stddef.h>
 #include <stdint.h>
 
 enum class RamDataType_t : uint16_t {
@@ -15,9 +16,29 @@ enum class RamDataType_t : uint16_t {
     PlugS_Max,
     CalulatedLimit,
     Limit,
+    Pro3EM_A, // active power per phase
+    Pro3EM_B,
+    Pro3EM_C,
+    Pro3EM_VoltageA,
+    Pro3EM_VoltageB,
+    Pro3EM_VoltageC,
+    Pro3EM_CurrentA,
+    Pro3EM_CurrentB,
+    Pro3EM_CurrentC,
+    Pro3EM_PfA, // power factor
+    Pro3EM_PfB,
+    Pro3EM_PfC,
+    Device0, // value of each configured Shelly device, see SHELLY_MAX_DEVICES
+    Device1,
+    Device2,
+    Device3,
+    Device4,
+    Device5,
     MAX,
 };
 
+#define RAMBUFFER_TYPE_COUNT static_cast<size_t>(RamDataType_t::MAX)
+
 #pragma pack(2)
 typedef struct
 {
@@ -26,12 +47,21 @@ typedef struct
     float value;
 } dataEntry_t; // 2 + 4 + 4 => 10 Bytes
 
+// One ring per RamDataType_t. All values are entry indices, so the layout does not depend on the buffer address.
+typedef struct
+{
+    uint16_t start; // first slot of this segment in the entry array
+    uint16_t capacity; // number of slots of this segment
+    uint16_t first; // oldest entry, relative to start
+    uint16_t count; // number of valid entries
+} dataSegment_t;
+
 typedef struct
 {
-    dataEntry_t* start;
-    dataEntry_t* first;
-    dataEntry_t* last;
-    dataEntry_t* end;
+    uint32_t id; // RAMBUFFER_HEADER_ID
+    uint32_t timeBase; // added to millis(), keeps the entry times increasing after a reset
+    dataSegment_t segment[RAMBUFFER_TYPE_COUNT];
+    uint32_t crc; // of all fields above
 } dataEntryHeader_t;
 
 #pragma pack()
@@ -40,19 +70,98 @@ typedef struct
 
 class RamBuffer {
 public:
-    RamBuffer(uint8_t* buffer, size_t size);
+    // capacities: number of entries per RamDataType_t, RAMBUFFER_TYPE_COUNT elements
+    RamBuffer(uint8_t* buffer, size_t size, const uint16_t* capacities);
     void PowerOnInitialize();
+    // After a reset: keeps the entries if the header is valid and matches the capacities
+    bool Restore();
+
+    static constexpr size_t requiredSize(const uint16_t* capacities)
+    {
+        size_t elements = 0;
+        for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+            elements += capacities[i];
+        }
+        return sizeof(dataEntryHeader_t) + elements * sizeof(dataEntry_t);
+    }
+
+    // time base of all entries
+    time_t now() const { return millis() + _header->timeBase; }
+
+    // Entries of one segment, oldest first
+    class Iterator {
+    public:
+        Iterator(RamBuffer& buffer, const dataSegment_t& seg, uint16_t pos)
+            : _buffer(buffer)
+            , _seg(seg)
+            , _pos(pos)
+        {
+        }
+        dataEntry_t& operator*() const { return *_buffer.entryAt(_seg, _pos); }
+        dataEntry_t* operator->() const { return _buffer.entryAt(_seg, _pos); }
+        Iterator& operator++()
+        {
+            _pos++;
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const { return _pos != other._pos; }
+
+    private:
+        RamBuffer& _buffer;
+        const dataSegment_t& _seg;
+        uint16_t _pos;
+    };
+
+    class Range {
+    public:
+        Range(RamBuffer& buffer, const dataSegment_t& seg, uint16_t first)
+            : _buffer(buffer)
+            , _seg(seg)
+            , _first(first)
+        {
+        }
+        Iterator begin() const { return Iterator(_buffer, _seg, _first); }
+        Iterator end() const { return Iterator(_buffer, _seg, _seg.count); }
+
+    private:
+        RamBuffer& _buffer;
+        const dataSegment_t& _seg;
+        uint16_t _first;
+    };
 
     void writeValue(RamDataType_t type, time_t time, float value);
     dataEntry_t* getLastEntry(RamDataType_t type);
-    void forAllEntriesReverse(RamDataType_t type, time_t lastMillis, const std::function<void(dataEntry_t*)>& doDataEntry);
-    void forAllEntries(RamDataType_t type, time_t lastMillis, const std::function<void(dataEntry_t*)>& doDataEntry);
+
+    // entries of the last lastMillis, e.g. for (auto& entry : buffer.entries(type, 5000))
+    Range entries(RamDataType_t type, time_t lastMillis)
+    {
+        dataSegment_t& seg = segment(type);
+        return Range(*this, seg, toStartPosition(seg, now() - lastMillis));
+    }
+
+    // doDataEntry(dataEntry_t*) is called for each entry of the last lastMillis, oldest first
+    template <typename F>
+    void forAllEntries(RamDataType_t type, time_t lastMillis, F&& doDataEntry)
+    {
+        for (auto& entry : entries(type, lastMillis)) {
+            doDataEntry(&entry);
+        }
+    }
+
+    // copies up to maxEntries entries with startTime <= time <= endTime, oldest first, the first skip entries are left out
+    size_t copyEntries(RamDataType_t type, time_t startTime, size_t skip, time_t endTime, dataEntry_t* entries, size_t maxEntries);
 
 private:
-    int toIndex(const dataEntry_t* entry) { return entry - _header->start; }
-    dataEntry_t* toStartEntry(RamDataType_t type, time_t lastMillis);
+    dataSegment_t& segment(RamDataType_t type) { return _header->segment[static_cast<size_t>(type)]; }
+    // pos: 0 is the oldest entry of the segment, seg.count - 1 the newest
+    dataEntry_t* entryAt(const dataSegment_t& seg, uint16_t pos) { return &_entries[seg.start + (seg.first + pos) % seg.capacity]; }
+    uint16_t toStartPosition(const dataSegment_t& seg, time_t startTime);
+    uint32_t calculateCrc() const;
+    void updateCrc() { _header->crc = calculateCrc(); }
 
 private:
     dataEntryHeader_t* _header;
+    dataEntry_t* _entries;
     size_t _elements;
+    uint16_t _capacities[RAMBUFFER_TYPE_COUNT];
 };
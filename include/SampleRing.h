@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free ring with one producer and one consumer. push() never blocks, it fails if the
+// ring is full. N must be a power of 2.
+template <typename T, size_t N>
+class SampleRing {
+    static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+
+public:
+    SampleRing()
+        : _head(0)
+        , _tail(0)
+    {
+    }
+
+    // producer
+    bool push(const T& element)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+        _elements[head % N] = element;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer
+    bool pop(T& element)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        element = _elements[tail % N];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const { return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire); }
+
+private:
+    T _elements[N];
+    std::atomic<uint32_t> _head; // next element to write
+    std::atomic<uint32_t> _tail; // next element to read
+};
@@ -4,10 +4,23 @@
 #include "Configuration.h"
 #include "ShellyClientData.h"
 #include "ShellyClientMqtt.h"
+#include "ShellyDeviceClock.h"
+#include "ShellyHttpBackoff.h"
+#include "ShellyJsonPaths.h"
+#include "ShellyJsonScanner.h"
+#include "ShellySamplePath.h"
 #include <ArduinoJson.h>
+#include <HTTPClient.h>
 #include <TaskSchedulerDeclarations.h>
+#include <ThreadSafeQueue.h>
 #include <WebSocketsClient.h>
+#include <WiFiClient.h>
+#include <atomic>
+#include <espMqttClient.h>
 #include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -17,28 +30,128 @@
 
 #define SHELLY_DTU_VERSION "0.9"
 
+// The websocket I/O runs in its own task, the Arduino loop with the radio runs on core 1
+#ifndef SHELLY_TASK_CORE
+#define SHELLY_TASK_CORE 0
+#endif
+#define SHELLY_TASK_STACK 6144
+#define SHELLY_TASK_PRIORITY 1
+#define SHELLY_HTTP_TIMEOUT 1000 // [ms] the network task is blocked during a request
+#define SHELLY_MQTT_QUEUE_SIZE 8 // messages from the MQTT client to the network task
+#define SHELLY_MQTT_MAX_PAYLOAD 4096
+
 ////////////////////////
 
+enum class ShellyRole_t : uint8_t {
+    GridMeter, // summed up in RamDataType_t::Pro3EM, > 0 import
+    Generation, // summed up in RamDataType_t::PlugS
+    Consumer, // only the own series
+    MAX,
+};
+
+enum class ShellyTransport_t : uint8_t {
+    WebSocket,
+    Http, // fallback of the websocket
+    Mqtt, // NotifyStatus on <prefix>/events/rpc of the broker of MqttSettings
+    MAX,
+};
+
+typedef struct
+{
+    uint32_t messages; // received replies, websocket: also the notifications
+    uint32_t failures; // websocket: disconnects, http: failed requests, mqtt: dropped messages
+    shellyLatency_t latency; // request until the reply is complete
+} shellyTransportStats_t;
+
+typedef struct
+{
+    uint8_t device;
+    uint32_t arrivalMicros; // first fragment
+    std::string payload;
+} shellyMqttMessage_t;
+
+// upper bounds of the histogram buckets [us], the last bucket is +Inf
+static const uint32_t ShellyHistogramBounds[] = { 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000 };
+#define SHELLY_HISTOGRAM_BUCKETS (sizeof(ShellyHistogramBounds) / sizeof(ShellyHistogramBounds[0]) + 1)
+
+typedef struct
+{
+    uint32_t buckets[SHELLY_HISTOGRAM_BUCKETS]; // not cumulative
+    uint64_t sumMicros;
+    uint32_t count;
+} shellyHistogram_t;
+
+typedef struct
+{
+    bool connected; // websocket
+    uint32_t frames; // websocket frames and fragments
+    uint32_t messages; // complete messages of all transports
+    uint32_t parseFailures; // truncated or malformed JSON
+    uint32_t connects;
+    bool hasSample;
+    uint32_t lastSampleMillis; // last real value
+    uint32_t lastSampleMicros;
+    shellyHistogram_t rpcLatency; // Shelly.GetStatus over the websocket until the reply
+    shellyHistogram_t interval; // between real values
+    uint32_t lastIntervalMicros;
+    float jitterMicros; // smoothed difference of consecutive intervals (RFC 3550)
+} shellyDeviceHealth_t;
+
 class WebSocketData {
 public:
     WebSocketData()
         : Host("")
         , Client(nullptr)
+        , Http(nullptr)
+        , HttpSocket(nullptr)
+        , RequestMicros(0)
+        , RequestPending(false)
         , LastValue(0)
         , LastTime(0)
-        , UpdatedTime(0)
-        , ShellyType(RamDataType_t::PlugS)
+        , Connected(false)
+        , HasValue(false)
+        , SeriesType(RamDataType_t::Device0)
+        , Role(ShellyRole_t::Consumer)
+        , Type(ShellyDeviceType_t::Generic)
+        , Transport(ShellyTransport_t::WebSocket)
+        , MaxInterval(5000)
+        , LastSampleTime(0)
+        , ArrivalMicros(0)
+        , Scanner(Paths, static_cast<size_t>(ShellyPath_t::MAX))
     {
+        for (size_t i = 0; i < static_cast<size_t>(ShellyPath_t::MAX); i++) {
+            Paths[i] = ShellyJsonPaths[i];
+        }
+        JsonPath[0] = '\0';
+        Paths[static_cast<size_t>(ShellyPath_t::Value)] = JsonPath;
     }
 
+    // the scanner refers to Paths
+    WebSocketData(const WebSocketData&) = delete;
+    WebSocketData& operator=(const WebSocketData&) = delete;
+
     std::string Host;
     WebSocketsClient* Client;
+    HTTPClient* Http; // fallback, created with the first request
+    WiFiClient* HttpSocket; // kept open between the requests (keep-alive)
+    ShellyHttpBackoff HttpBackoff;
+    uint32_t RequestMicros; // Shelly.GetStatus sent over the websocket
+    bool RequestPending; // no reply to RequestMicros yet
     double LastValue;
-    unsigned long LastTime;
-    unsigned long UpdatedTime;
+    unsigned long LastTime; // last value received or request sent
     bool Connected;
-    RamDataType_t ShellyType;
-    uint32_t MaxInterval;
+    bool HasValue; // LastValue is part of the sum of the role
+    RamDataType_t SeriesType;
+    ShellyRole_t Role;
+    ShellyDeviceType_t Type;
+    ShellyTransport_t Transport; // WebSocket or Mqtt
+    char JsonPath[SHELLY_MAX_JSONPATH_STRLEN + 1];
+    const char* Paths[static_cast<size_t>(ShellyPath_t::MAX)];
+    uint32_t MaxInterval; // without notifications the status is polled after this time
+    ShellyDeviceClock Clock; // device time of the notifications
+    time_t LastSampleTime;
+    uint32_t ArrivalMicros; // first frame of the actual message
+    ShellyJsonScanner Scanner; // a message can be split into several fragments
 };
 
 class ShellyClientClass {
@@ -48,17 +161,72 @@ public:
     void loop();
     ShellyClientData& getShellyData() { return _shellyClientData; }
 
+    // called by the loop task for each stored sample, e.g. to wake LimitControl
+    void SetSampleCallback(const std::function<void(RamDataType_t type)>& callback) { _sampleCallback = callback; }
+
+    // LimitControl used the latest value of type -> latency of the control stage
+    void MarkUsed(RamDataType_t type) { _samples.markUsed(type); }
+    // a limit command based on the latest value of type was sent -> latency of the command stage
+    void MarkSent(RamDataType_t type) { _samples.markSent(type); }
+    shellyLatency_t GetLatency(ShellyLatencyStage_t stage) { return _samples.getLatency(stage); }
+    uint32_t GetDroppedSamples() const { return _samples.getDropped(); }
+    shellyTransportStats_t GetTransportStats(ShellyTransport_t transport);
+    shellyDeviceHealth_t GetDeviceHealth(uint8_t device);
+
 private:
-    void HandleWebsocket(WebSocketData& data, const char* hostname, std::function<void(WStype_t type, uint8_t* payload, size_t length)> cbEvent);
-    static void EventsPro3EM(WStype_t type, uint8_t* payload, size_t length);
-    static void EventsPlugS(WStype_t type, uint8_t* payload, size_t length);
+    // network task: websockets, JSON and the sums of the roles
+    static void NetworkTask(void* parameter);
+    void NetworkLoop();
+    void HandleWebsocket(WebSocketData& data, const SHELLY_DEVICE_CONFIG_T& device, bool enable);
     void Events(WebSocketData& data, WStype_t type, uint8_t* payload, size_t length);
+    bool HandleHttp(WebSocketData& data, uint32_t interval);
+    void HttpFailed(WebSocketData& data, const char* uri, int error, uint32_t interval);
+    void DeleteHttp(WebSocketData& data);
+    void HandleWebsocketMessage(WebSocketData& data);
+    void HandleMessage(WebSocketData& data);
+    void AddTransport(ShellyTransport_t transport, bool success, uint32_t micros);
+    void HandleMqtt();
+    shellyDeviceHealth_t& Health(const WebSocketData& data); // _mutex must be locked
+    void UpdateRole(ShellyRole_t role, time_t time, uint32_t arrivalMicros);
+    void Push(RamDataType_t type, float value, time_t time, uint32_t arrivalMicros);
+
+    // loop task
+    void UpdateMqttSubscriptions();
+
+    // MQTT client
+    void OnMqttMessage(uint8_t device, const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total);
 
 private:
-    std::mutex _mutex;
+    std::mutex _mutex; // _config, _transport and _health
     Task _loopTask;
-    WebSocketData _Pro3EM;
-    WebSocketData _PlugS;
+    TaskHandle_t _taskHandle;
+
+    // configuration of the devices, copied by the loop task, Configuration is only safe there
+    SHELLY_DEVICE_CONFIG_T _config[SHELLY_MAX_DEVICES];
+    bool _enable;
+    uint32_t _httpInterval;
+    bool _configChanged;
+
+    // only used by the network task
+    SHELLY_DEVICE_CONFIG_T _taskConfig[SHELLY_MAX_DEVICES];
+    bool _taskEnable;
+    uint32_t _taskHttpInterval;
+    uint8_t _httpNext; // device of the next HTTP request
+    WebSocketData _devices[SHELLY_MAX_DEVICES];
+    time_t _roleTime[static_cast<size_t>(ShellyRole_t::MAX)]; // last sample of the sum
+
+    ShellySamplePath _samples; // to the loop task
+    shellyTransportStats_t _transport[static_cast<size_t>(ShellyTransport_t::MAX)];
+    shellyDeviceHealth_t _health[SHELLY_MAX_DEVICES];
+
+    // only used by the loop task
+    String _mqttTopic[SHELLY_MAX_DEVICES]; // subscribed, empty: none
+    std::function<void(RamDataType_t type)> _sampleCallback;
+
+    // only used by the MQTT client, a message can be split into several parts
+    shellyMqttMessage_t _mqttPartial[SHELLY_MAX_DEVICES];
+    ThreadSafeQueue<shellyMqttMessage_t> _mqttQueue; // to the network task
+
     ShellyClientData _shellyClientData;
 };
 
@@ -1,23 +1,94 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "CompressedRamBuffer.h"
+#include "HistoryTiers.h"
 #include "RamBuffer.h"
+#include "SampleRing.h"
+#include "SlidingWindow.h"
 #include <Arduino.h>
 #include <mutex>
+#include <vector>
+
+#ifndef SHELLY_RAMBUFFER_COMPRESSED
+#define SHELLY_RAMBUFFER_COMPRESSED 0 // -DSHELLY_RAMBUFFER_COMPRESSED=1 keeps more entries in the same memory
+#endif
+
+#if SHELLY_RAMBUFFER_COMPRESSED
+using ShellyRamBuffer = CompressedRamBuffer;
+#else
+using ShellyRamBuffer = RamBuffer;
+#endif
+
+#define SHELLY_CARRY_INTERVAL (10 * 1000) // min. distance of carried forward entries in the RamBuffer [ms]
+
+enum class SampleKind_t : uint8_t {
+    Real, // measured or calculated at this time
+    Carried, // repeats the last value, e.g. an unchanged limit
+};
+
+// value encoding of WriteLastDataBinary
+enum class GraphEncoding_t : uint8_t {
+    Float, // float32
+    Int16, // int16, 1 W
+    Int16Deci, // int16, 0.1 W
+};
 
 class ShellyClientData {
 public:
     ShellyClientData();
     ~ShellyClientData();
 
-    void Update(RamDataType_t type, float value);
+    // Min/Max/Mean/Factored queries with this type and lastMillis are answered in O(1) afterwards
+    void RegisterWindow(RamDataType_t type, time_t lastMillis);
+
+    // time base of all values, millis() continued over resets
+    time_t Now();
+
+    // Single writer: Update is only called from the loop task and never blocks behind a reader.
+    // Carried samples don't count for min, max and mean and are only stored every SHELLY_CARRY_INTERVAL.
+    void Update(RamDataType_t type, float value, SampleKind_t kind = SampleKind_t::Real);
+    // time: measurement time in the time base of Now(), not before the last Update of this type
+    void Update(RamDataType_t type, float value, time_t time, SampleKind_t kind = SampleKind_t::Real);
     float GetActValue(RamDataType_t type);
     float GetMinValue(RamDataType_t type, time_t lastMillis);
     float GetMaxValue(RamDataType_t type, time_t lastMillis);
+    float GetMeanValue(RamDataType_t type, time_t lastMillis);
     float GetFactoredValue(RamDataType_t type, time_t lastMillis);
-    String& GetLastData(RamDataType_t type, time_t lastMillis, String& result);
+    void WriteLastDataBinary(RamDataType_t type, time_t lastMillis, Print& output);
+    // like WriteLastDataBinary, but long spans are read from the downsampled history
+    void WriteHistoryBinary(RamDataType_t type, time_t lastMillis, size_t minPoints, Print& output);
+    // longest span of WriteHistoryBinary [ms]
+    time_t GetHistoryLength() const;
+    size_t GetEntries(RamDataType_t type, time_t startTime, size_t skip, time_t endTime, dataEntry_t* entries, size_t maxEntries);
 
 private:
-    std::mutex _mutex;
-    RamBuffer* _ramBuffer;
+    void StorePending();
+    struct pendingSample_t {
+        dataEntry_t entry;
+        SampleKind_t kind;
+    };
+
+    void StoreSample(const pendingSample_t& sample);
+    SlidingWindow* FindWindow(RamDataType_t type, time_t lastMillis);
+    void ScanMinMax(RamDataType_t type, time_t lastMillis, float& min, float& max);
+    HistoryTiers* FindHistory(RamDataType_t type);
+    void WriteRawColumn(RamDataType_t type, time_t lastMillis, Print& output);
+
+    struct window_t {
+        RamDataType_t type;
+        SlidingWindow window;
+    };
+
+    std::mutex _mutex; // held by the readers and while the pending samples are stored
+    SampleRing<pendingSample_t, 32> _pending; // samples of Update, not yet stored
+    ShellyRamBuffer* _ramBuffer;
+    std::vector<window_t> _windows;
+
+    struct history_t {
+        RamDataType_t type;
+        HistoryTiers history;
+    };
+
+    std::vector<history_t> _histories;
 };
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ctime>
+#include <stdint.h>
+
+#define SHELLY_CLOCK_MAX_DRIFT 500 // [ppm] the offset follows a device clock, which is this much slower
+#define SHELLY_CLOCK_MAX_JUMP 2000 // [ms] a larger offset means the device clock was set
+
+// Maps the device time of the notifications of a Shelly [s] to the time base of ShellyClientData.
+// The smallest offset seen has the least transport delay.
+class ShellyDeviceClock {
+public:
+    ShellyDeviceClock()
+        : _offset(0)
+        , _lastNow(0)
+        , _valid(false)
+    {
+    }
+
+    // e.g. after a reconnect, the device clock may have been set
+    void reset() { _valid = false; }
+
+    // notBefore: time of the last sample of the device, the entries of one type must be ordered by time
+    time_t toLocalTime(double deviceTime, time_t now, time_t notBefore)
+    {
+        int64_t deviceMillis = static_cast<int64_t>(deviceTime * 1000.0);
+        int64_t offset = (now - deviceMillis) * 1000;
+        if (_valid) {
+            _offset += (now - _lastNow) * SHELLY_CLOCK_MAX_DRIFT / 1000; // follows a slower device clock
+        }
+        if (!_valid || offset < _offset || offset - _offset > SHELLY_CLOCK_MAX_JUMP * 1000) {
+            _offset = offset; // first value, less delay or the device clock was set
+            _valid = true;
+        }
+        _lastNow = now;
+
+        time_t time = deviceMillis + _offset / 1000;
+        time = time > now ? now : time;
+        time = time < notBefore ? notBefore : time;
+        return time;
+    }
+
+private:
+    int64_t _offset; // [us]
+    time_t _lastNow;
+    bool _valid;
+};
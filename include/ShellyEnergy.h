@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "ShellyClient.h"
+#include "ShellyClientData.h"
+#include <TaskSchedulerDeclarations.h>
+#include <functional>
+#include <mutex>
+
+#define SHELLY_ENERGY_FILENAME "/shelly_energy.bin"
+#define SHELLY_ENERGY_FILE_ID 0x53450001 // 'SE' + version
+#define SHELLY_ENERGY_HOURS 48
+#define SHELLY_ENERGY_DAYS 62
+#define SHELLY_ENERGY_WRITE_INTERVAL (10 * TASK_MINUTE) // [ms] max. loss after a crash
+#define SHELLY_ENERGY_STALE_TIME (30 * TASK_SECOND) // [ms] without a real value the power isn't integrated
+
+typedef struct
+{
+    uint32_t time; // start of the bucket, local time [s]
+    float importWh; // from the grid
+    float exportWh; // to the grid
+    float selfConsumedWh; // generated and not exported
+    float curtailedWh; // not generated because of the limit, upper bound
+} energyBucket_t;
+
+typedef struct
+{
+    double importWh;
+    double exportWh;
+    double selfConsumedWh;
+    double curtailedWh;
+} energyTotals_t;
+
+typedef struct
+{
+    uint32_t id; // SHELLY_ENERGY_FILE_ID
+    energyTotals_t totals;
+    energyBucket_t openHour;
+    energyBucket_t openDay;
+    uint16_t hourFirst;
+    uint16_t hourCount;
+    uint16_t dayFirst;
+    uint16_t dayCount;
+    energyBucket_t hours[SHELLY_ENERGY_HOURS];
+    energyBucket_t days[SHELLY_ENERGY_DAYS];
+} energyStore_t;
+
+enum class EnergyPeriod_t {
+    Hour,
+    Day,
+};
+
+// Integrates the Pro3EM grid power and the PlugS generated power into Wh counters.
+// The counters are written to LittleFS every 10 minutes, when an hour is closed and before a restart.
+// While a meter delivers no values, nothing is integrated.
+class ShellyEnergyClass {
+public:
+    ShellyEnergyClass();
+    void init(Scheduler& scheduler);
+    void loop();
+
+    // writes the counters, if they changed since the last write
+    void write();
+
+    energyTotals_t getTotals();
+    energyBucket_t getOpenBucket(EnergyPeriod_t period);
+    // closed buckets, oldest first
+    void forAllBuckets(EnergyPeriod_t period, const std::function<void(const energyBucket_t&)>& doBucket);
+
+private:
+    void read();
+    bool closeBuckets(time_t now); // true if an hour was closed
+    bool isStale(ShellyRole_t role); // a device of this role has no recent real value
+    static void addBucket(energyBucket_t* buckets, uint16_t capacity, uint16_t& first, uint16_t& count, const energyBucket_t& bucket);
+
+    std::mutex _mutex;
+    Task _loopTask;
+    ShellyClientData& _shellyClientData;
+
+    energyStore_t _store;
+    unsigned long _lastMillis;
+    unsigned long _lastWrite;
+    bool _dirty;
+    bool _gridStale;
+};
+
+extern ShellyEnergyClass ShellyEnergy;
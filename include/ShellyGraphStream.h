@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "ShellyClientData.h"
+#include <Arduino.h>
+#include <vector>
+
+// Serializes the graph series as JSON into the send buffer of a chunked response.
+// The series are read from the RamBuffer in small batches, so the memory used per
+// request does not depend on the length of the window.
+class ShellyGraphStream {
+public:
+    // head: JSON object with all other fields, the series are appended to it
+    ShellyGraphStream(ShellyClientData& shellyData, const String& head, time_t lastMillis);
+
+    size_t fill(uint8_t* buffer, size_t maxLen);
+
+private:
+    bool nextToken();
+    bool nextPoint();
+
+    enum class State {
+        Head,
+        SeriesStart,
+        Points,
+        Done,
+    };
+
+    static constexpr size_t BATCH_SIZE = 16;
+
+    ShellyClientData& _shellyData;
+    String _head;
+    State _state;
+    size_t _series;
+    time_t _lastTime; // time of the last written entry of the actual series
+    size_t _lastTimeCnt; // number of written entries with _lastTime
+    time_t _startTime;
+    time_t _endTime;
+    bool _firstPoint;
+
+    dataEntry_t _batch[BATCH_SIZE];
+    size_t _batchSize;
+    size_t _batchPos;
+
+    char _token[64]; // formatted text which is not yet copied to the send buffer
+    const char* _tokenPtr;
+    size_t _tokenLen;
+    size_t _tokenPos;
+};
+
+// Writes the binary series of /api/livedata/graph_bin into the send buffer of a chunked
+// response. Only one series is held in memory at a time.
+class ShellyBinaryStream : public Print {
+public:
+    // span > 0: history of the last span [ms] with at least minPoints, otherwise the raw values of the last lastMillis
+    ShellyBinaryStream(ShellyClientData& shellyData, time_t lastMillis, time_t span, size_t minPoints);
+
+    size_t fill(uint8_t* buffer, size_t maxLen);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+
+private:
+    ShellyClientData& _shellyData;
+    time_t _lastMillis;
+    time_t _span;
+    size_t _minPoints;
+    size_t _series; // next series to serialize
+    bool _headerDone;
+
+    std::vector<uint8_t> _data; // serialized, not yet sent part
+    size_t _dataPos;
+};
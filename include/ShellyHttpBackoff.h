@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <algorithm>
+#include <stdint.h>
+
+#define SHELLY_HTTP_MAX_BACKOFF (60 * TASK_SECOND) // [ms] longest interval of a host which does not answer
+
+// Schedule of the HTTP requests of a device. A host which does not answer blocks the network task
+// until the timeout, so each failed request in a row doubles the interval up to SHELLY_HTTP_MAX_BACKOFF.
+class ShellyHttpBackoff {
+public:
+    ShellyHttpBackoff()
+        : _lastTime(0)
+        , _failures(0)
+    {
+    }
+
+    // e.g. another device
+    void reset() { _failures = 0; }
+
+    // [ms] between the requests
+    uint32_t getInterval(uint32_t interval) const
+    {
+        return std::max<uint32_t>(interval, std::min<uint32_t>(interval << _failures, SHELLY_HTTP_MAX_BACKOFF));
+    }
+
+    // true if a request is due, it counts from now
+    bool isDue(unsigned long nowMillis, uint32_t interval)
+    {
+        if (nowMillis - _lastTime < getInterval(interval)) {
+            return false;
+        }
+        _lastTime = nowMillis;
+        return true;
+    }
+
+    void succeeded() { _failures = 0; }
+    void failed(uint32_t interval)
+    {
+        // no further doubling beyond the maximum, the shift would overflow
+        if ((interval << _failures) < SHELLY_HTTP_MAX_BACKOFF) {
+            _failures++;
+        }
+    }
+
+    uint8_t getFailures() const { return _failures; }
+
+private:
+    unsigned long _lastTime; // last request
+    uint8_t _failures; // failed requests in a row
+};
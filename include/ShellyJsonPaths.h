@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <stdint.h>
+
+// The values of the Shelly Gen2 RPC frames, without framework dependencies for the native tests
+
+enum class ShellyDeviceType_t : uint8_t {
+    Pro3EM,
+    PlugS,
+    Generic, // the JSON path of the configuration is required
+    MAX,
+};
+
+// default JSON path of the value per ShellyDeviceType_t
+static const char* const ShellyDefaultValuePaths[] = {
+    "*.em:0.total_act_power", // Pro3EM
+    "*.switch:0.apower", // PlugS
+    "", // Generic
+};
+
+// RPC over HTTP while the websocket is down. The reply is only the status of the component,
+// prefix and suffix embed it like a websocket reply, so the JSON paths are the same.
+typedef struct
+{
+    const char* uri;
+    const char* prefix;
+    const char* suffix;
+} shellyHttpRpc_t;
+
+static const shellyHttpRpc_t ShellyHttpRpc[] = {
+    { "/rpc/EM.GetStatus?id=0", "{\"result\":{\"em:0\":", "}}" }, // Pro3EM
+    { "/rpc/Switch.GetStatus?id=0", "{\"result\":{\"switch:0\":", "}}" }, // PlugS
+    { "/rpc/Shelly.GetStatus", "{\"result\":", "}" }, // Generic or own JSON path
+};
+
+// JSON paths of the values in NotifyStatus ("params") and the reply of Shelly.GetStatus ("result")
+enum class ShellyPath_t : uint8_t {
+    Id, // only in replies
+    Ts,
+    Value, // path of the device
+    ActPowerA,
+    ActPowerB,
+    ActPowerC,
+    VoltageA,
+    VoltageB,
+    VoltageC,
+    CurrentA,
+    CurrentB,
+    CurrentC,
+    PfA,
+    PfB,
+    PfC,
+    MAX,
+};
+
+static const char* const ShellyJsonPaths[] = {
+    "id", // id of the request
+    "params.ts", // device time of the notification [s]
+    "", // replaced by the path of the device
+    "*.em:0.a_act_power", // Pro3EM phases
+    "*.em:0.b_act_power",
+    "*.em:0.c_act_power",
+    "*.em:0.a_voltage",
+    "*.em:0.b_voltage",
+    "*.em:0.c_voltage",
+    "*.em:0.a_current",
+    "*.em:0.b_current",
+    "*.em:0.c_current",
+    "*.em:0.a_pf",
+    "*.em:0.b_pf",
+    "*.em:0.c_pf",
+};
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHELLY_JSON_MAX_PATHS 16
+#define SHELLY_JSON_MAX_DEPTH 6
+#define SHELLY_JSON_MAX_KEY 24
+
+// Incremental JSON scanner, which extracts the numbers of some paths in one pass.
+// A message can be fed in several fragments, nothing is allocated.
+class ShellyJsonScanner {
+public:
+    // paths: keys separated by '.', '*' matches any key, e.g. "*.em:0.total_act_power"
+    // The array must exist as long as the scanner.
+    ShellyJsonScanner(const char* const* paths, size_t count);
+
+    // start of a new message
+    void reset();
+    void feed(const char* data, size_t length);
+
+    // false if the path was not found in the message
+    bool getValue(size_t path, double& value) const;
+
+    // false for a truncated or malformed message
+    bool isComplete() const;
+
+private:
+    void finishNumber();
+    bool matches(const char* path) const;
+
+    const char* const* _paths;
+    size_t _count;
+    double _values[SHELLY_JSON_MAX_PATHS];
+    uint32_t _found; // bit per path
+
+    // actual position
+    uint8_t _depth; // 0: outside of all objects
+    uint8_t _ignoredDepth; // levels deeper than SHELLY_JSON_MAX_DEPTH
+    bool _isObject[SHELLY_JSON_MAX_DEPTH + 1];
+    char _key[SHELLY_JSON_MAX_DEPTH + 1][SHELLY_JSON_MAX_KEY + 1];
+    uint8_t _keyLen[SHELLY_JSON_MAX_DEPTH + 1]; // > SHELLY_JSON_MAX_KEY: truncated, never matches
+    bool _expectKey;
+    bool _started; // first object or array opened
+    bool _malformed; // more closing than opening brackets
+
+    bool _inString;
+    bool _isKey;
+    bool _escape;
+
+    char _number[24];
+    uint8_t _numberLen; // 0: not in a number
+};
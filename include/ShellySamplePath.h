@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "RamBuffer.h"
+#include "SampleRing.h"
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#define SHELLY_QUEUE_SIZE 128 // samples from the network task to the loop task
+#define SHELLY_QUEUE_RETRIES 100 // waits of the network task for a full queue, then the sample is dropped
+
+typedef struct
+{
+    dataEntry_t entry;
+    uint32_t arrivalMicros; // first frame of the message
+} shellySample_t;
+
+enum class ShellyLatencyStage_t : uint8_t {
+    Queue, // frame arrival until stored in ShellyClientData
+    Control, // frame arrival until used by LimitControl
+    Command, // frame arrival until the limit command is sent to the inverter
+    MAX,
+};
+
+typedef struct
+{
+    uint32_t lastMicros;
+    uint32_t maxMicros;
+    uint64_t sumMicros;
+    uint32_t count;
+} shellyLatency_t;
+
+// Hands the samples of the network task to the loop task and measures the latency of each
+// stage since the arrival of the frame.
+class ShellySamplePath {
+public:
+    ShellySamplePath();
+
+    // network task: wait() is called while the queue is full, false if the sample was dropped
+    template <typename W>
+    bool push(const shellySample_t& sample, W&& wait)
+    {
+        // a short wait only delays the sockets, the loop task empties the queue on every pass
+        for (uint8_t retry = 0; !_queue.push(sample); retry++) {
+            if (retry >= SHELLY_QUEUE_RETRIES) {
+                // the loop task is blocked, e.g. by a flash write
+                _dropped++;
+                return false;
+            }
+            wait();
+        }
+        return true;
+    }
+
+    // loop task
+    bool pop(shellySample_t& sample) { return _queue.pop(sample); }
+    // the sample is stored in ShellyClientData
+    void stored(const shellySample_t& sample);
+    // LimitControl used the latest value of type
+    void markUsed(RamDataType_t type);
+    // a limit command based on the latest value of type was sent
+    void markSent(RamDataType_t type);
+
+    // any task
+    shellyLatency_t getLatency(ShellyLatencyStage_t stage);
+    uint32_t getDropped() const { return _dropped.load(); }
+
+    static void AddMicros(shellyLatency_t& latency, uint32_t micros);
+
+private:
+    void addLatency(ShellyLatencyStage_t stage, uint32_t micros);
+
+    SampleRing<shellySample_t, SHELLY_QUEUE_SIZE> _queue;
+    std::atomic<uint32_t> _dropped;
+
+    // only used by the loop task
+    uint32_t _arrival[RAMBUFFER_TYPE_COUNT]; // newest stored sample per type
+    bool _arrivalPending[RAMBUFFER_TYPE_COUNT]; // not used by LimitControl yet
+
+    std::mutex _mutex; // _latency
+    shellyLatency_t _latency[static_cast<size_t>(ShellyLatencyStage_t::MAX)];
+};
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ctime>
+#include <deque>
+
+// Min, max and mean of all real samples of the last 'length' milliseconds.
+// Every sample is added and removed once, queries are O(1).
+// Without a real sample in the window, the last value (real or carried forward) is returned.
+class SlidingWindow {
+public:
+    explicit SlidingWindow(time_t length);
+
+    void add(time_t time, float value);
+    // the value is unchanged since the last sample, it doesn't count for min, max and mean
+    void carry(float value);
+    void expire(time_t now);
+
+    time_t getLength() const { return _length; }
+    bool isEmpty() const { return _samples.empty(); }
+    float getMin() const;
+    float getMax() const;
+    float getMean() const;
+
+private:
+    float getLast() const { return _hasLast ? _last : 0; }
+
+    struct sample_t {
+        time_t time;
+        float value;
+    };
+
+    time_t _length;
+    double _sum;
+    float _last;
+    bool _hasLast;
+    std::deque<sample_t> _samples;
+    std::deque<sample_t> _min; // increasing values
+    std::deque<sample_t> _max; // decreasing values
+};
@@ -24,6 +24,13 @@ enum WebApiError {
     MinPowerLimit,
     LimitPowerLimit,
     TargetValueLimit,
+    GridPhaseInvalid,
+    ShellyJsonPathLength,
+    ShellyDeviceInvalid,
+    ShellyHttpIntervalInvalid,
+    ShellyControlStrategyInvalid,
+    ShellyControlParameterInvalid,
+    ShellyTooManyDevices,
 
     FileBase = 3000,
     FileNotDeleted,
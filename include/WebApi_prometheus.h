@@ -17,6 +17,9 @@ private:
 
     void addPanelInfo(AsyncResponseStream* stream, const String& serial, const uint8_t idx, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel);
 
+    void addShellyDeviceHealth(AsyncResponseStream* stream);
+    void addRadioQueue(AsyncResponseStream* stream);
+
     enum MetricType_t {
         NONE = 0,
         GAUGE,
@@ -12,4 +12,6 @@ public:
 private:
     void onShellyAdminGet(AsyncWebServerRequest* request);
     void onShellyAdminPost(AsyncWebServerRequest* request);
+    void onShellyEnergyGet(AsyncWebServerRequest* request);
+    void onShellyStatusGet(AsyncWebServerRequest* request);
 };
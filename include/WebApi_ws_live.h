@@ -31,9 +31,11 @@ private:
     static void addField(JsonObject& root, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, String topic = "");
     static void addTotalField(JsonObject& root, const String& name, const float value, const String& unit, const uint8_t digits);
     static void generateDiagramJsonResponse(JsonVariant& root, String name, const RamDataType_t* types, int size);
+    static uint32_t getGraphInterval(AsyncWebServerRequest* request, long long& timestamp);
 
     void onLivedataStatus(AsyncWebServerRequest* request);
     void onGraphUpdate(AsyncWebServerRequest* request);
+    void onGraphBinary(AsyncWebServerRequest* request);
     void onWebsocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len);
 
     AsyncWebSocket _ws;
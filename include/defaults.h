@@ -93,9 +93,16 @@
 #define SHELLY_MIN_POWER 0
 #define SHELLY_LIMIT_POWER 300U
 #define SHELLY_HOST ""
+#define SHELLY_JSON_PATH ""
 #define SHELLY_TARGET_VALUE 0
 #define SHELLY_FEED_IN_LEVEL 0U
 #define SHELLY_VIEW_OPTION 0U
+#define SHELLY_GRID_PHASE 0U
+#define SHELLY_HTTP_INTERVAL 1000U
+#define SHELLY_CONTROL_STRATEGY 0U
+#define SHELLY_PI_KP 0.5f
+#define SHELLY_PI_KI 0.05f
+#define SHELLY_PI_KFF 1.0f
 
 #define MQTT_HASS_ENABLED false
 #define MQTT_HASS_EXPIRE true
@@ -5,6 +5,7 @@
 #include "HoymilesRadio.h"
 #include "Hoymiles.h"
 #include "crc.h"
+#include <algorithm>
 
 serial_u HoymilesRadio::DtuSerial() const
 {
@@ -180,3 +181,38 @@ uint32_t HoymilesRadio::getQueueSize() const
 {
     return _commandQueue.size();
 }
+
+uint32_t HoymilesRadio::getCommandsReplaced() const
+{
+    return _commandsReplaced;
+}
+
+uint32_t HoymilesRadio::getCommandsDropped() const
+{
+    return _commandsDropped;
+}
+
+uint32_t HoymilesRadio::getCommandsPrioritized() const
+{
+    return _commandsPrioritized;
+}
+
+bool HoymilesRadio::takePriorityToken()
+{
+    const uint32_t now = millis();
+    if (_priorityTokens >= HOY_PRIORITY_TOKEN_BURST) {
+        _priorityTokenMillis = now;
+    } else {
+        const uint32_t earned = (now - _priorityTokenMillis) / HOY_PRIORITY_TOKEN_INTERVAL;
+        if (earned > 0) {
+            _priorityTokens = std::min<uint32_t>(HOY_PRIORITY_TOKEN_BURST, _priorityTokens + earned);
+            _priorityTokenMillis += earned * HOY_PRIORITY_TOKEN_INTERVAL;
+        }
+    }
+
+    if (_priorityTokens == 0) {
+        return false;
+    }
+    _priorityTokens--;
+    return true;
+}
@@ -13,6 +13,11 @@
 #define DEBUG_PRINT(fmt, args...) /* Don't do anything in release builds */
 #endif
 
+// Token bucket for commands overtaking the queue (power limit). Without a token
+// they are appended like polling requests, so neither side starves the other.
+#define HOY_PRIORITY_TOKEN_INTERVAL 5000 // [ms] one token per interval
+#define HOY_PRIORITY_TOKEN_BURST 2
+
 class HoymilesRadio {
 public:
     serial_u DtuSerial() const;
@@ -26,21 +31,26 @@ public:
     void removeCommands(InverterAbstract* inv);
     uint8_t countSimilarCommands(std::shared_ptr<CommandAbstract> cmd);
 
+    uint32_t getCommandsReplaced() const;
+    uint32_t getCommandsDropped() const;
+    uint32_t getCommandsPrioritized() const;
+
     void enqueCommand(std::shared_ptr<CommandAbstract> cmd)
     {
         DEBUG_PRINT("Queue size before: %ld\r\n", _commandQueue.size());
         DEBUG_PRINT("Handling command %s with type %d\r\n", cmd.get()->getCommandName().c_str(), static_cast<uint8_t>(cmd.get()->getQueueInsertType()));
         switch (cmd.get()->getQueueInsertType()) {
         case QueueInsertType::RemoveOldest:
-            _commandQueue.removeDuplicatedEntries(cmd);
+            _commandsDropped += _commandQueue.removeDuplicatedEntries(cmd);
             break;
         case QueueInsertType::ReplaceExistent:
             // Checks if the queue already contains a command like the new one
             // and replaces the existing one with the new one.
             // (The new one will not be pushed at the end of the queue)
-            if (_commandQueue.countSimilarCommands(cmd) > 0) {
-                DEBUG_PRINT("    ... existing entry will be replaced\r\n");
-                _commandQueue.replaceEntries(cmd);
+            // An entry in transmission is not replaced, the new one is appended.
+            if (_commandQueue.replaceEntries(cmd) > 0) {
+                DEBUG_PRINT("    ... existing entry was replaced\r\n");
+                _commandsReplaced++;
                 return;
             }
             break;
@@ -49,6 +59,7 @@ public:
             // and drops the new one. The new one will not be inserted.
             if (_commandQueue.countSimilarCommands(cmd) > 0) {
                 DEBUG_PRINT("    ... new entry will be dropped\r\n");
+                _commandsDropped++;
                 return;
             }
             break;
@@ -57,6 +68,13 @@ public:
             break;
         }
 
+        if (cmd.get()->hasPriority() && takePriorityToken()) {
+            DEBUG_PRINT("    ... new entry will overtake the queue\r\n");
+            _commandQueue.pushPriority(cmd);
+            _commandsPrioritized++;
+            return;
+        }
+
         // Push the command into the queue if we reach this position of the code
         DEBUG_PRINT("    ... new entry will be appended\r\n");
         _commandQueue.push(cmd);
@@ -75,6 +93,7 @@ protected:
     static void dumpBuf(const uint8_t buf[], const uint8_t len, const bool appendNewline = true);
 
     bool checkFragmentCrc(const fragment_t& fragment) const;
+    bool takePriorityToken();
     virtual void sendEsbPacket(CommandAbstract& cmd) = 0;
     void sendRetransmitPacket(const uint8_t fragment_id);
     void sendLastPacketAgain();
@@ -86,4 +105,11 @@ protected:
     bool _busyFlag = false;
 
     TimeoutHelper _rxTimeout;
+
+    uint8_t _priorityTokens = HOY_PRIORITY_TOKEN_BURST;
+    uint32_t _priorityTokenMillis = 0;
+
+    uint32_t _commandsReplaced = 0;
+    uint32_t _commandsDropped = 0;
+    uint32_t _commandsPrioritized = 0;
 };
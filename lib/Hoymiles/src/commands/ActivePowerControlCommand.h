@@ -15,8 +15,9 @@ public:
     explicit ActivePowerControlCommand(InverterAbstract* inv, const uint64_t router_address = 0);
 
     virtual String getCommandName() const;
-    virtual QueueInsertType getQueueInsertType() const { return QueueInsertType::RemoveOldest; }
+    virtual QueueInsertType getQueueInsertType() const { return QueueInsertType::ReplaceExistent; }
     virtual bool areSameParameter(CommandAbstract* other);
+    virtual bool hasPriority() const { return true; }
 
     virtual bool handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id);
     virtual void gotTimeout();
@@ -62,6 +62,9 @@ public:
     virtual QueueInsertType getQueueInsertType() const { return QueueInsertType::RemoveNewest; }
     virtual bool areSameParameter(CommandAbstract* other);
 
+    // Returns whether the command may overtake the queue, as long as the radio has priority tokens.
+    virtual bool hasPriority() const { return false; }
+
 protected:
     uint8_t _payload[RF_LEN];
     uint8_t _payload_size;
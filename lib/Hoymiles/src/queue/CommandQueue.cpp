@@ -15,29 +15,59 @@ void CommandQueue::removeAllEntriesForInverter(InverterAbstract* inv)
     _queue.erase(it, _queue.end());
 }
 
-void CommandQueue::removeDuplicatedEntries(std::shared_ptr<CommandAbstract> cmd)
+uint8_t CommandQueue::removeDuplicatedEntries(std::shared_ptr<CommandAbstract> cmd)
 {
     std::lock_guard<std::mutex> lock(_mutex);
 
+    if (_queue.empty()) {
+        return 0;
+    }
+
     auto it = std::remove_if(_queue.begin() + 1, _queue.end(),
         [&cmd](std::shared_ptr<CommandAbstract> v) -> bool {
             return cmd->areSameParameter(v.get())
                 && cmd.get()->getQueueInsertType() == QueueInsertType::RemoveOldest;
         });
+    const uint8_t removed = std::distance(it, _queue.end());
     _queue.erase(it, _queue.end());
+    return removed;
 }
 
-void CommandQueue::replaceEntries(std::shared_ptr<CommandAbstract> cmd)
+uint8_t CommandQueue::replaceEntries(std::shared_ptr<CommandAbstract> cmd)
 {
     std::lock_guard<std::mutex> lock(_mutex);
 
+    if (_queue.empty()) {
+        return 0;
+    }
+
+    // The front entry is currently transmitted and not replaced
+    uint8_t replaced = 0;
     std::replace_if(_queue.begin() + 1, _queue.end(),
-        [&cmd](std::shared_ptr<CommandAbstract> v)-> bool {
-            return cmd.get()->getQueueInsertType() == QueueInsertType::ReplaceExistent
+        [&cmd, &replaced](std::shared_ptr<CommandAbstract> v)-> bool {
+            const bool same = cmd.get()->getQueueInsertType() == QueueInsertType::ReplaceExistent
                 && cmd->areSameParameter(v.get());
+            replaced += same;
+            return same;
             },
         cmd
     );
+    return replaced;
+}
+
+void CommandQueue::pushPriority(std::shared_ptr<CommandAbstract> cmd)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_queue.empty()) {
+        _queue.push_back(cmd);
+        return;
+    }
+
+    // Behind the entry in transmission and the priority entries which are already waiting
+    auto it = std::find_if(_queue.begin() + 1, _queue.end(),
+        [](std::shared_ptr<CommandAbstract> v) -> bool { return !v->hasPriority(); });
+    _queue.insert(it, cmd);
 }
 
 uint8_t CommandQueue::countSimilarCommands(std::shared_ptr<CommandAbstract> cmd)
@@ -10,8 +10,9 @@ class InverterAbstract;
 class CommandQueue : public ThreadSafeQueue<std::shared_ptr<CommandAbstract>> {
 public:
     void removeAllEntriesForInverter(InverterAbstract* inv);
-    void removeDuplicatedEntries(std::shared_ptr<CommandAbstract> cmd);
-    void replaceEntries(std::shared_ptr<CommandAbstract> cmd);
+    uint8_t removeDuplicatedEntries(std::shared_ptr<CommandAbstract> cmd);
+    uint8_t replaceEntries(std::shared_ptr<CommandAbstract> cmd);
+    void pushPriority(std::shared_ptr<CommandAbstract> cmd);
 
     uint8_t countSimilarCommands(std::shared_ptr<CommandAbstract> cmd);
 };
@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "CompressedRamBuffer.h"
+#include "MessageOutput.h"
+#include <cstring>
+#include <esp_rom_crc.h>
+
+// Bits of the payload of one block, a sample needs at most 36 (time) + 44 (value) bits
+#define BLOCK_BITS ((COMPRESSEDBUFFER_BLOCK_SIZE - 10) * 8)
+#define MAX_SAMPLE_BITS 80
+#define NO_WINDOW 0xff
+
+static void writeBits(uint8_t* data, uint16_t& pos, uint32_t value, uint8_t bits)
+{
+    while (bits > 0) {
+        bits--;
+        if ((value >> bits) & 1) {
+            data[pos >> 3] |= 0x80 >> (pos & 7);
+        }
+        pos++;
+    }
+}
+
+static uint32_t readBits(const uint8_t* data, uint16_t& pos, uint8_t bits)
+{
+    uint32_t value = 0;
+    while (bits > 0) {
+        bits--;
+        value = (value << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+        pos++;
+    }
+    return value;
+}
+
+static int32_t signExtend(uint32_t value, uint8_t bits)
+{
+    // values above the positive limit are negative
+    return value > (1u << (bits - 1)) ? static_cast<int32_t>(value) - (1 << bits) : static_cast<int32_t>(value);
+}
+
+static void encodeTime(uint8_t* data, uint16_t& pos, int32_t dod)
+{
+    if (dod == 0) {
+        writeBits(data, pos, 0b0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        writeBits(data, pos, 0b10, 2);
+        writeBits(data, pos, dod & 0x7f, 7);
+    } else if (dod >= -255 && dod <= 256) {
+        writeBits(data, pos, 0b110, 3);
+        writeBits(data, pos, dod & 0x1ff, 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        writeBits(data, pos, 0b1110, 4);
+        writeBits(data, pos, dod & 0xfff, 12);
+    } else {
+        writeBits(data, pos, 0b1111, 4);
+        writeBits(data, pos, static_cast<uint32_t>(dod), 32);
+    }
+}
+
+static int32_t decodeTime(const uint8_t* data, uint16_t& pos)
+{
+    if (readBits(data, pos, 1) == 0) {
+        return 0;
+    }
+    if (readBits(data, pos, 1) == 0) {
+        return signExtend(readBits(data, pos, 7), 7);
+    }
+    if (readBits(data, pos, 1) == 0) {
+        return signExtend(readBits(data, pos, 9), 9);
+    }
+    if (readBits(data, pos, 1) == 0) {
+        return signExtend(readBits(data, pos, 12), 12);
+    }
+    return static_cast<int32_t>(readBits(data, pos, 32));
+}
+
+CompressedBlockDecoder::CompressedBlockDecoder(const compressedBlock_t* block, RamDataType_t type)
+    : _block(block)
+    , _type(type)
+    , _index(0)
+    , _pos(0)
+    , _time(block != nullptr ? block->time : 0)
+    , _delta(0)
+    , _value(0)
+    , _leading(NO_WINDOW)
+    , _trailing(0)
+{
+    if (block != nullptr) {
+        memcpy(&_value, &block->value, sizeof(_value));
+    }
+}
+
+bool CompressedBlockDecoder::next(dataEntry_t& entry)
+{
+    if (_block == nullptr || _index >= _block->count) {
+        return false;
+    }
+
+    if (_index > 0) {
+        _delta += decodeTime(_block->data, _pos);
+        _time += _delta;
+
+        if (readBits(_block->data, _pos, 1) == 1) {
+            if (readBits(_block->data, _pos, 1) == 1) {
+                _leading = readBits(_block->data, _pos, 5);
+                uint8_t length = readBits(_block->data, _pos, 5) + 1;
+                _trailing = 32 - _leading - length;
+            }
+            _value ^= readBits(_block->data, _pos, 32 - _leading - _trailing) << _trailing;
+        }
+    }
+    _index++;
+
+    entry.type = _type;
+    entry.time = _time;
+    memcpy(&entry.value, &_value, sizeof(_value));
+    return true;
+}
+
+CompressedRamBuffer::CompressedRamBuffer(uint8_t* buffer, size_t size, const uint16_t* capacities)
+    : _header(reinterpret_cast<compressedHeader_t*>(buffer))
+    , _blocks(reinterpret_cast<compressedBlock_t*>(&_header[1]))
+    , _elements((size - sizeof(compressedHeader_t)) / sizeof(compressedBlock_t))
+{
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        _capacities[i] = blocksFor(capacities[i]);
+    }
+}
+
+void CompressedRamBuffer::PowerOnInitialize()
+{
+    memset(_header, 0, sizeof(compressedHeader_t));
+
+    size_t start = 0;
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        // a too small buffer cuts the capacity of the last segments
+        size_t capacity = _capacities[i];
+        if (start + capacity > _elements) {
+            capacity = _elements - start;
+        }
+
+        compressedSegment_t& seg = _header->segment[i];
+        seg.start = start;
+        seg.capacity = capacity;
+
+        start += capacity;
+    }
+
+    _header->id = COMPRESSEDBUFFER_HEADER_ID;
+    _header->timeBase = 0;
+    updateCrc();
+}
+
+bool CompressedRamBuffer::Restore()
+{
+    if (_header->id != COMPRESSEDBUFFER_HEADER_ID || _header->crc != calculateCrc()) {
+        return false;
+    }
+
+    // the layout must match the actual capacities
+    size_t start = 0;
+    time_t lastTime = 0;
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        size_t capacity = _capacities[i];
+        if (start + capacity > _elements) {
+            capacity = _elements - start;
+        }
+
+        const compressedSegment_t& seg = _header->segment[i];
+        if (seg.start != start || seg.capacity != capacity || (capacity > 0 && seg.first >= capacity) || seg.count > capacity || seg.bitPos > BLOCK_BITS) {
+            return false;
+        }
+
+        if (seg.count > 0) {
+            lastTime = seg.last.time > lastTime ? seg.last.time : lastTime;
+        }
+        start += capacity;
+    }
+
+    // millis() starts again with 0, new entries are stored after the restored ones
+    _header->timeBase = lastTime + 1;
+    updateCrc();
+
+    MessageOutput.printf("CompressedRamBuffer restored, time base %" PRIu32 "\r\n", _header->timeBase);
+    return true;
+}
+
+uint32_t CompressedRamBuffer::calculateCrc() const
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(_header), offsetof(compressedHeader_t, crc));
+}
+
+void CompressedRamBuffer::newBlock(compressedSegment_t& seg, time_t time, float value)
+{
+    // full -> drop the oldest block
+    if (seg.count < seg.capacity) {
+        seg.count++;
+    } else {
+        seg.first = (seg.first + 1) % seg.capacity;
+    }
+
+    compressedBlock_t* block = blockAt(seg, seg.count - 1);
+    memset(block, 0, sizeof(compressedBlock_t));
+    block->count = 1;
+    block->time = time;
+    block->value = value;
+
+    seg.bitPos = 0;
+    seg.prevDelta = 0;
+    memcpy(&seg.prevValue, &value, sizeof(seg.prevValue));
+    seg.prevLeading = NO_WINDOW;
+    seg.prevTrailing = 0;
+}
+
+void CompressedRamBuffer::writeValue(RamDataType_t type, time_t time, float value)
+{
+    compressedSegment_t& seg = segment(type);
+    if (seg.capacity == 0) {
+        return;
+    }
+
+    compressedBlock_t* block = seg.count > 0 ? blockAt(seg, seg.count - 1) : nullptr;
+    if (block == nullptr || block->count >= COMPRESSEDBUFFER_BLOCK_ENTRIES || seg.bitPos + MAX_SAMPLE_BITS > BLOCK_BITS) {
+        newBlock(seg, time, value);
+    } else {
+        int32_t delta = time - seg.last.time;
+        encodeTime(block->data, seg.bitPos, delta - seg.prevDelta);
+        seg.prevDelta = delta;
+
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t x = bits ^ seg.prevValue;
+        if (x == 0) {
+            writeBits(block->data, seg.bitPos, 0b0, 1);
+        } else {
+            uint8_t leading = __builtin_clz(x);
+            uint8_t trailing = __builtin_ctz(x);
+            if (leading > 31) {
+                leading = 31; // 5 bits
+            }
+
+            if (seg.prevLeading != NO_WINDOW && leading >= seg.prevLeading && trailing >= seg.prevTrailing) {
+                // meaningful bits fit into the window of the previous value
+                writeBits(block->data, seg.bitPos, 0b10, 2);
+                writeBits(block->data, seg.bitPos, x >> seg.prevTrailing, 32 - seg.prevLeading - seg.prevTrailing);
+            } else {
+                uint8_t length = 32 - leading - trailing;
+                writeBits(block->data, seg.bitPos, 0b11, 2);
+                writeBits(block->data, seg.bitPos, leading, 5);
+                writeBits(block->data, seg.bitPos, length - 1, 5);
+                writeBits(block->data, seg.bitPos, x >> trailing, length);
+                seg.prevLeading = leading;
+                seg.prevTrailing = trailing;
+            }
+        }
+        seg.prevValue = bits;
+        block->count++;
+    }
+
+    seg.last.type = type;
+    seg.last.time = time;
+    seg.last.value = value;
+    updateCrc();
+}
+
+dataEntry_t* CompressedRamBuffer::getLastEntry(RamDataType_t type)
+{
+    compressedSegment_t& seg = segment(type);
+    if (seg.count == 0) {
+        return nullptr;
+    }
+    return &seg.last;
+}
+
+size_t CompressedRamBuffer::copyEntries(RamDataType_t type, time_t startTime, size_t skip, time_t endTime, dataEntry_t* entries, size_t maxEntries)
+{
+    compressedSegment_t& seg = segment(type);
+
+    size_t cnt = 0;
+    Iterator end(*this, seg, type, seg.count, 0);
+    for (Iterator it(*this, seg, type, toStartBlock(seg, startTime), startTime); it != end; ++it) {
+        if (it->time > endTime || cnt >= maxEntries) {
+            break;
+        }
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        entries[cnt++] = *it;
+    }
+    return cnt;
+}
+
+uint16_t CompressedRamBuffer::toStartBlock(const compressedSegment_t& seg, time_t startTime)
+{
+    // last block which starts before startTime, all later entries are in this or the following blocks
+    uint16_t low = 0;
+    uint16_t high = seg.count;
+    while (low < high) {
+        uint16_t mid = low + (high - low) / 2;
+        if (static_cast<time_t>(blockAt(seg, mid)->time) < startTime) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low > 0 ? low - 1 : 0;
+}
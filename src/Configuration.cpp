@@ -106,14 +106,27 @@ bool ConfigurationClass::write()
 
     JsonObject shelly = doc["shelly"].to<JsonObject>();
     shelly["shelly_enable"] = config.Shelly.ShellyEnable;
-    shelly["shelly_hostname_pro3em"] = config.Shelly.Hostname_Pro3EM;
-    shelly["shelly_hostname_plugs"] = config.Shelly.Hostname_PlugS;
+    JsonArray shellyDevices = shelly["devices"].to<JsonArray>();
+    for (uint8_t i = 0; i < SHELLY_MAX_DEVICES; i++) {
+        JsonObject dev = shellyDevices.add<JsonObject>();
+        dev["hostname"] = config.Shelly.Devices[i].Hostname;
+        dev["role"] = config.Shelly.Devices[i].Role;
+        dev["type"] = config.Shelly.Devices[i].Type;
+        dev["json_path"] = config.Shelly.Devices[i].JsonPath;
+        dev["transport"] = config.Shelly.Devices[i].Transport;
+    }
     shelly["limit_enable"] = config.Shelly.LimitEnable;
     shelly["max_power"] = config.Shelly.MaxPower;
     shelly["min_power"] = config.Shelly.MinPower;
     shelly["target_value"] = config.Shelly.TargetValue;
     shelly["feed_in_level"] = config.Shelly.FeedInLevel;
     shelly["view_option"] = config.Shelly.ViewOption;
+    shelly["grid_phase"] = config.Shelly.GridPhase;
+    shelly["http_interval"] = config.Shelly.HttpInterval;
+    shelly["control_strategy"] = config.Shelly.ControlStrategy;
+    shelly["pi_kp"] = config.Shelly.PiKp;
+    shelly["pi_ki"] = config.Shelly.PiKi;
+    shelly["pi_kff"] = config.Shelly.PiKff;
     
     JsonObject security = doc["security"].to<JsonObject>();
     security["password"] = config.Security.Password;
@@ -293,14 +306,27 @@ bool ConfigurationClass::read()
 
     JsonObject shelly = doc["shelly"];
     config.Shelly.ShellyEnable = shelly["shelly_enable"] | SHELLY_ENABLE;
-    strlcpy(config.Shelly.Hostname_Pro3EM, shelly["shelly_hostname_pro3em"] | SHELLY_HOST, sizeof(config.Shelly.Hostname_Pro3EM));
-    strlcpy(config.Shelly.Hostname_PlugS, shelly["shelly_hostname_plugs"] | SHELLY_HOST, sizeof(config.Shelly.Hostname_PlugS));
+    JsonArray shellyDevices = shelly["devices"];
+    for (uint8_t i = 0; i < SHELLY_MAX_DEVICES; i++) {
+        JsonObject dev = shellyDevices[i].as<JsonObject>();
+        strlcpy(config.Shelly.Devices[i].Hostname, dev["hostname"] | SHELLY_HOST, sizeof(config.Shelly.Devices[i].Hostname));
+        config.Shelly.Devices[i].Role = dev["role"] | 0U;
+        config.Shelly.Devices[i].Type = dev["type"] | 0U;
+        strlcpy(config.Shelly.Devices[i].JsonPath, dev["json_path"] | SHELLY_JSON_PATH, sizeof(config.Shelly.Devices[i].JsonPath));
+        config.Shelly.Devices[i].Transport = dev["transport"] | 0U;
+    }
     config.Shelly.LimitEnable = shelly["limit_enable"] | SHELLY_LIMIT_ENABLE;
     config.Shelly.MaxPower = shelly["max_power"] | SHELLY_MAX_POWER;
     config.Shelly.MinPower = shelly["min_power"] | SHELLY_MIN_POWER;
     config.Shelly.TargetValue = shelly["target_value"] | SHELLY_TARGET_VALUE;
     config.Shelly.FeedInLevel = shelly["feed_in_level"] | SHELLY_FEED_IN_LEVEL;
     config.Shelly.ViewOption = shelly["view_option"] | SHELLY_VIEW_OPTION;
+    config.Shelly.GridPhase = shelly["grid_phase"] | SHELLY_GRID_PHASE;
+    config.Shelly.HttpInterval = shelly["http_interval"] | SHELLY_HTTP_INTERVAL;
+    config.Shelly.ControlStrategy = shelly["control_strategy"] | SHELLY_CONTROL_STRATEGY;
+    config.Shelly.PiKp = shelly["pi_kp"] | SHELLY_PI_KP;
+    config.Shelly.PiKi = shelly["pi_ki"] | SHELLY_PI_KI;
+    config.Shelly.PiKff = shelly["pi_kff"] | SHELLY_PI_KFF;
     
     JsonObject security = doc["security"];
     strlcpy(config.Security.Password, security["password"] | ACCESS_POINT_PASSWORD, sizeof(config.Security.Password));
@@ -447,6 +473,17 @@ void ConfigurationClass::migrate()
         }
     }
 
+    if (config.Cfg.Version < 0x00011e00) {
+        // the fixed Pro3EM and PlugS became the first two devices of the list
+        JsonObject shelly = doc["shelly"];
+        strlcpy(config.Shelly.Devices[0].Hostname, shelly["shelly_hostname_pro3em"] | SHELLY_HOST, sizeof(config.Shelly.Devices[0].Hostname));
+        config.Shelly.Devices[0].Role = 0U; // ShellyRole_t::GridMeter
+        config.Shelly.Devices[0].Type = 0U; // ShellyDeviceType_t::Pro3EM
+        strlcpy(config.Shelly.Devices[1].Hostname, shelly["shelly_hostname_plugs"] | SHELLY_HOST, sizeof(config.Shelly.Devices[1].Hostname));
+        config.Shelly.Devices[1].Role = 1U; // ShellyRole_t::Generation
+        config.Shelly.Devices[1].Type = 1U; // ShellyDeviceType_t::PlugS
+    }
+
     f.close();
 
     config.Cfg.Version = CONFIG_VERSION;
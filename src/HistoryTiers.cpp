@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "HistoryTiers.h"
+
+HistoryTier::HistoryTier(uint32_t duration, uint16_t capacity)
+    : _duration(duration)
+    , _buckets(capacity)
+    , _first(0)
+    , _count(0)
+    , _open({ 0, 0, 0, 0, 0 })
+    , _openSum(0)
+{
+}
+
+bool HistoryTier::add(const historyBucket_t& bucket, historyBucket_t& closed)
+{
+    uint32_t start = bucket.time - bucket.time % _duration;
+    bool bClosed = false;
+
+    if (_open.count > 0 && start != _open.time) {
+        _open.mean = _openSum / _open.count;
+        closed = _open;
+        bClosed = true;
+
+        // full -> overwrite the oldest bucket
+        if (_count < _buckets.size()) {
+            _buckets[(_first + _count) % _buckets.size()] = _open;
+            _count++;
+        } else {
+            _buckets[_first] = _open;
+            _first = (_first + 1) % _buckets.size();
+        }
+        _open.count = 0;
+    }
+
+    if (_open.count == 0) {
+        _open.time = start;
+        _open.min = bucket.min;
+        _open.max = bucket.max;
+        _openSum = 0;
+    } else {
+        _open.min = bucket.min < _open.min ? bucket.min : _open.min;
+        _open.max = bucket.max > _open.max ? bucket.max : _open.max;
+    }
+    _openSum += static_cast<double>(bucket.mean) * bucket.count;
+    _open.count = _open.count + bucket.count < UINT16_MAX ? _open.count + bucket.count : UINT16_MAX;
+
+    return bClosed;
+}
+
+void HistoryTier::forAllBuckets(time_t startTime, const std::function<void(const historyBucket_t&)>& doBucket) const
+{
+    for (uint16_t pos = 0; pos < _count; pos++) {
+        const historyBucket_t& bucket = _buckets[(_first + pos) % _buckets.size()];
+        if (static_cast<time_t>(bucket.time) + _duration > startTime) {
+            doBucket(bucket);
+        }
+    }
+
+    // the open bucket is not complete, but contains the latest values
+    if (_open.count > 0) {
+        historyBucket_t open = _open;
+        open.mean = _openSum / _open.count;
+        doBucket(open);
+    }
+}
+
+time_t HistoryTier::getStartTime() const
+{
+    if (_count > 0) {
+        return _buckets[_first].time;
+    }
+    return _open.count > 0 ? static_cast<time_t>(_open.time) : std::numeric_limits<time_t>::max();
+}
+
+HistoryTiers::HistoryTiers()
+{
+    _tiers.reserve(3);
+    _tiers.emplace_back(10 * 1000, 180); // 30 minutes
+    _tiers.emplace_back(60 * 1000, 240); // 4 hours
+    _tiers.emplace_back(15 * 60 * 1000, 112); // 28 hours
+}
+
+void HistoryTiers::add(time_t time, float value)
+{
+    historyBucket_t bucket = { static_cast<uint32_t>(time), value, value, value, 1 };
+
+    // a closed bucket of one tier is merged into the next coarser tier
+    for (auto& tier : _tiers) {
+        historyBucket_t closed;
+        if (!tier.add(bucket, closed)) {
+            break;
+        }
+        bucket = closed;
+    }
+}
+
+const HistoryTier* HistoryTiers::selectTier(time_t now, time_t lastMillis, size_t minPoints, time_t rawStartTime) const
+{
+    const HistoryTier* selected = nullptr;
+    for (auto& tier : _tiers) {
+        if (static_cast<size_t>(lastMillis / tier.getDuration()) >= minPoints) {
+            selected = &tier;
+        }
+    }
+
+    time_t startTime = now - lastMillis;
+    if (selected != nullptr || rawStartTime <= startTime) {
+        return selected;
+    }
+
+    // the raw values would truncate the span
+    const HistoryTier* furthest = nullptr;
+    for (auto& tier : _tiers) {
+        if (tier.getStartTime() <= startTime) {
+            return &tier;
+        }
+        if (tier.getStartTime() < (furthest != nullptr ? furthest->getStartTime() : rawStartTime)) {
+            furthest = &tier;
+        }
+    }
+    return furthest;
+}
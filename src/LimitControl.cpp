@@ -6,14 +6,24 @@
 #include "LimitControl.h"
 #include "MessageOutput.h"
 #include "ShellyClient.h"
+#include <algorithm>
 #include <cfloat>
 
 LimitControlClass LimitControl;
 
 LimitControlClass::LimitControlClass()
-    : _loopTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&LimitControlClass::loop, this))
+    : _loopTask(TASK_IMMEDIATE, TASK_ONCE, std::bind(&LimitControlClass::loop, this))
     , _shellyClientData(ShellyClient.getShellyData())
     , _invLimitAbsolute(0)
+    , _actLimit(0)
+    , _lastLimitSend(0)
+    , _lastRun(0)
+    , _sendPending(false)
+    , _lastCalculate(0)
+    , _strategyType(LimitStrategy_t::Heuristic)
+    , _inverter()
+    , _inverterCount(0)
+    , _inverterMaxPower(0)
 {
     _intervalPro3em = 20000;
     _intervalPlugS = 20000;
@@ -21,12 +31,64 @@ LimitControlClass::LimitControlClass()
 
 void LimitControlClass::init(Scheduler& scheduler)
 {
+    // started by Trigger(), without new values nothing runs
     scheduler.addTask(_loopTask);
-    _loopTask.enable();
+    ShellyClient.SetSampleCallback([this](RamDataType_t type) {
+        if (type == GridType()) {
+            Trigger();
+        }
+    });
+
+    _shellyClientData.RegisterWindow(RamDataType_t::Pro3EM, _intervalPro3em);
+    _shellyClientData.RegisterWindow(RamDataType_t::Pro3EM_A, _intervalPro3em);
+    _shellyClientData.RegisterWindow(RamDataType_t::Pro3EM_B, _intervalPro3em);
+    _shellyClientData.RegisterWindow(RamDataType_t::Pro3EM_C, _intervalPro3em);
+    _shellyClientData.RegisterWindow(RamDataType_t::PlugS, _intervalPro3em);
+    _shellyClientData.RegisterWindow(RamDataType_t::PlugS, _intervalPlugS);
+}
+
+void LimitControlClass::Trigger()
+{
+    // a TASK_ONCE task stays enabled after its run until the next pass of the scheduler
+    if (_loopTask.isEnabled() && _loopTask.getIterations() > 0) {
+        return; // already scheduled, the run uses the newest values
+    }
+
+    unsigned long now = millis();
+    unsigned long wait = 0;
+    if (now - _lastRun < LIMIT_CONTROL_MIN_INTERVAL) {
+        wait = LIMIT_CONTROL_MIN_INTERVAL - (now - _lastRun);
+    }
+    _loopTask.restartDelayed(wait);
+}
+
+LimitStrategy& LimitControlClass::Strategy(const CONFIG_T& config)
+{
+    LimitStrategy_t type = config.Shelly.ControlStrategy < static_cast<uint8_t>(LimitStrategy_t::MAX)
+        ? static_cast<LimitStrategy_t>(config.Shelly.ControlStrategy)
+        : LimitStrategy_t::Heuristic;
+    LimitStrategy& strategy = type == LimitStrategy_t::PI ? static_cast<LimitStrategy&>(_pi) : static_cast<LimitStrategy&>(_heuristic);
+
+    if (type != _strategyType) {
+        _strategyType = type;
+        strategy.Reset();
+    }
+    _pi.SetParameter(config.Shelly.PiKp, config.Shelly.PiKi, config.Shelly.PiKff);
+    return strategy;
+}
+
+RamDataType_t LimitControlClass::GridType() const
+{
+    // a single phase inverter can regulate against the export of its phase
+    static const RamDataType_t gridTypes[] = { RamDataType_t::Pro3EM, RamDataType_t::Pro3EM_A, RamDataType_t::Pro3EM_B, RamDataType_t::Pro3EM_C };
+    uint8_t phase = Configuration.get().Shelly.GridPhase;
+    return phase <= 3 ? gridTypes[phase] : RamDataType_t::Pro3EM;
 }
 
 void LimitControlClass::loop()
 {
+    _lastRun = millis();
+
     float value = _shellyClientData.GetMaxValue(RamDataType_t::Pro3EM, _intervalPro3em);
     _shellyClientData.Update(RamDataType_t::Pro3EM_Max, value);
 
@@ -43,6 +105,8 @@ void LimitControlClass::loop()
     if (!(config.Shelly.ShellyEnable && config.Shelly.LimitEnable)) {
         _intervalPro3em = 20000; // 5000;
         _intervalPlugS = 20000; // 5000;
+        _pi.Reset();
+        _lastCalculate = 0;
         return;
     }
 
@@ -69,57 +133,52 @@ void LimitControlClass::loop()
 #endif
 
     CalculateLimit();
+
+    // the next run sends the pending limit with the newest values, samples until then don't wake it earlier
+    if (_sendPending) {
+        // nothing was sent, if all inverters wait for an acknowledge or the queue was full
+        unsigned long elapsed = millis() - _lastLimitSend;
+        _loopTask.restartDelayed(elapsed < LIMIT_CONTROL_SEND_INTERVAL ? LIMIT_CONTROL_SEND_INTERVAL - elapsed : LIMIT_CONTROL_RETRY_INTERVAL);
+    }
 }
 
 void LimitControlClass::CalculateLimit()
 {
     const CONFIG_T& config = Configuration.get();
+    RamDataType_t gridType = GridType();
 
-    float gridPower = _shellyClientData.GetFactoredValue(RamDataType_t::Pro3EM, _intervalPro3em);
-    float generatedPower = _shellyClientData.GetFactoredValue(RamDataType_t::PlugS, _intervalPlugS);
-    MessageOutput.printf("LimitControlClass::LimitControlClass grid:%f, generatedPower:%f \r\n", gridPower, generatedPower);
-
-    float limit = -FLT_MAX;
-    float border = 10;
-
-    if (gridPower > config.Shelly.TargetValue + border) {
-        // increase: iterate to limit
-        limit = abs(gridPower - config.Shelly.TargetValue);
-        limit *= 0.75; // IncreaseFactor(limit);
-        limit += _actLimit;
-
-        MessageOutput.printf("increase %f\r\n", limit);
-
-    } else if (gridPower < config.Shelly.TargetValue - border - 50) {
-        // decrease: set new limit
-        limit = generatedPower - abs(gridPower - config.Shelly.TargetValue) * 0.9f;
-        MessageOutput.printf("decrease full %f\r\n", limit);
+    UpdateInverters();
 
-        // Debug("D");
-    } else if (gridPower < config.Shelly.TargetValue - border) {
-        // decrease: set new limit
-
-        limit = abs(gridPower - config.Shelly.TargetValue);
-        limit *= 0.8; // DecreaseFactor(limit);
-        limit = _actLimit - limit;
+    float gridPower = _shellyClientData.GetFactoredValue(gridType, _intervalPro3em);
+    ShellyClient.MarkUsed(gridType);
+    float generatedPower = _shellyClientData.GetFactoredValue(RamDataType_t::PlugS, _intervalPlugS);
 
-        MessageOutput.printf("decrease  %f\r\n", limit);
+    unsigned long now = millis();
+    limitInput_t input;
+    input.gridPower = gridPower;
+    input.generatedPower = generatedPower;
+    input.actLimit = _actLimit;
+    input.targetValue = config.Shelly.TargetValue;
+    input.minLimit = config.Shelly.MinPower > config.Shelly.TargetValue ? config.Shelly.MinPower - config.Shelly.TargetValue : 0;
+    input.maxLimit = config.Shelly.MaxPower;
+    input.dt = _lastCalculate != 0 ? (now - _lastCalculate) / 1000.0f : 0;
+    _lastCalculate = now;
 
-        // border = min(1, 2);
-        //_shellyClientData.SetLastValue(config.Shelly.TargetValue - border);
-        // Debug("d");
-    }
+    float limit = Strategy(config).Calculate(input);
 
-    _shellyClientData.Update(RamDataType_t::Limit, _actLimit);
+    // the limit is only changed by SendLimit
+    _shellyClientData.Update(RamDataType_t::Limit, _actLimit, SampleKind_t::Carried);
 
-    if (limit == -FLT_MAX) {
+    _sendPending = false;
+    if (limit == LIMIT_STRATEGY_NO_CHANGE) {
         return;
     }
 
     _shellyClientData.Update(RamDataType_t::CalulatedLimit, limit);
     MessageOutput.printf("LimitControlClass::LimitControlClass %f, %f\r\n", limit, limit + gridPower);
 
-    if (millis() - _lastLimitSend < 10 * TASK_SECOND) {
+    if (millis() - _lastLimitSend < LIMIT_CONTROL_SEND_INTERVAL) {
+        _sendPending = true;
         return;
     }
     /*
@@ -131,10 +190,66 @@ void LimitControlClass::CalculateLimit()
     /*SendLimitResult_t result =*/SendLimit(limit, generatedPower);
 }
 
+void LimitControlClass::UpdateInverters()
+{
+    const CONFIG_T& config = Configuration.get();
+    unsigned long now = millis();
+
+    _inverterCount = 0;
+    _inverterMaxPower = 0;
+    _actLimit = 0;
+
+    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
+        limitInverter_t& inverter = _inverter[i];
+        auto inv = i < Hoymiles.getNumInverters() ? Hoymiles.getInverterByPos(i) : nullptr;
+        if (inv == nullptr) {
+            inverter = {};
+            continue;
+        }
+
+        uint16_t maxPower = inv->DevInfo()->getMaxPower();
+        inverter.maxPower = maxPower > 0 ? maxPower : config.Shelly.MaxPower;
+
+        if (inverter.serial != inv->serial()) {
+            // new at this position: start with the limit of the inverter
+            inverter = {};
+            inverter.serial = inv->serial();
+            inverter.maxPower = maxPower > 0 ? maxPower : config.Shelly.MaxPower;
+            inverter.limit = inverter.maxPower;
+            if (inv->SystemConfigPara()->getLastUpdate() > 0 && maxPower > 0) {
+                inverter.limit = inv->SystemConfigPara()->getLimitPercent() * maxPower / 100;
+            }
+        }
+
+        if (inverter.pending) {
+            bool acknowledged = inv->SystemConfigPara()->getLastLimitCommandSuccess() != CMD_PENDING;
+            uint32_t elapsed = now - inverter.sentMillis;
+            if (acknowledged || elapsed > LIMIT_CONTROL_ACK_TIMEOUT) {
+                inverter.pending = false;
+                inverter.latency = inverter.latency == 0 ? elapsed : (3 * inverter.latency + elapsed) / 4;
+            }
+        }
+
+        inverter.active = inv->isReachable() && inv->getEnableCommands();
+        if (!inverter.active) {
+            continue;
+        }
+        // without statistics the whole limit counts as used
+        inverter.production = inverter.limit;
+        if (inv->Statistics()->getLastUpdate() > 0) {
+            inverter.production = inv->Statistics()->getChannelFieldValue(TYPE_AC, CH0, FLD_PAC);
+        }
+        inverter.target = inverter.limit;
+
+        _inverterCount++;
+        _inverterMaxPower += inverter.maxPower;
+        _actLimit += inverter.limit;
+    }
+}
+
 SendLimitResult_t LimitControlClass::SendLimit(float limit, float generatedPower)
 {
-    auto inv = Hoymiles.getInverterByPos(0);
-    if (inv == nullptr || !inv->isReachable()) {
+    if (_inverterCount == 0) {
         return SendLimitResult_t::NoInverter;
     }
 
@@ -147,23 +262,77 @@ SendLimitResult_t LimitControlClass::SendLimit(float limit, float generatedPower
     if (limit > config.Shelly.MaxPower) {
         limit = config.Shelly.MaxPower;
     }
+    if (limit > _inverterMaxPower) {
+        limit = _inverterMaxPower;
+    }
 
-    if (_actLimit == limit || abs(_actLimit - limit) < 15) { // if lower than 10, more update are send
+    if (_actLimit == limit || abs(_actLimit - limit) < LIMIT_CONTROL_SIMILAR) { // if lower than 10, more update are send
         return SendLimitResult_t::Similar;
     }
 
-    _actLimit = limit;
+    LimitDistribution::Distribute(_inverter, limit - _actLimit);
 
-    float correctPanelCnt = 1.0; // 0.75 => 3 of 4 pannels installed
-    if (correctPanelCnt != 1) {
-        limit /= correctPanelCnt;
-        if (limit > config.Shelly.MaxPower) {
-            limit = config.Shelly.MaxPower;
+    // idle radios first, so the queues of NRF and CMT drain in parallel, then the fastest inverters
+    uint8_t order[INV_MAX_COUNT];
+    bool idle[INV_MAX_COUNT];
+    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
+        order[i] = i;
+        auto inv = _inverter[i].active ? Hoymiles.getInverterByPos(i) : nullptr;
+        idle[i] = inv != nullptr && inv->getRadio()->isQueueEmpty();
+    }
+    std::stable_sort(order, order + INV_MAX_COUNT, [this, &idle](uint8_t a, uint8_t b) {
+        if (idle[a] != idle[b]) {
+            return idle[a];
         }
+        return _inverter[a].latency < _inverter[b].latency;
+    });
+
+    // one command per radio and run, the others follow with the next run
+    const HoymilesRadio* used[INV_MAX_COUNT] = {};
+    uint8_t usedCount = 0;
+    bool sent = false;
+
+    for (uint8_t n = 0; n < INV_MAX_COUNT; n++) {
+        limitInverter_t& inverter = _inverter[order[n]];
+        if (!inverter.active || inverter.target == inverter.limit) {
+            continue;
+        }
+
+        auto inv = Hoymiles.getInverterByPos(order[n]);
+        const HoymilesRadio* radio = inv->getRadio();
+        if (inverter.pending || std::find(used, used + usedCount, radio) != used + usedCount) {
+            _sendPending = true;
+            continue;
+        }
+
+        float invLimit = inverter.target;
+        float correctPanelCnt = 1.0; // 0.75 => 3 of 4 pannels installed
+        if (correctPanelCnt != 1) {
+            invLimit /= correctPanelCnt;
+            if (invLimit > inverter.maxPower) {
+                invLimit = inverter.maxPower;
+            }
+        }
+        if (!inv->sendActivePowerControlRequest(invLimit, PowerLimitControlType::AbsolutNonPersistent)) {
+            continue;
+        }
+        MessageOutput.printf("LimitControlClass::SendLimit %s %f\r\n", inv->serialString().c_str(), invLimit);
+
+        _actLimit += inverter.target - inverter.limit;
+        inverter.limit = inverter.target;
+        inverter.pending = true;
+        inverter.sentMillis = millis();
+        used[usedCount++] = radio;
+        sent = true;
     }
-    inv->sendActivePowerControlRequest(limit, PowerLimitControlType::AbsolutNonPersistent);
+
+    if (!sent) {
+        return SendLimitResult_t::CommandPending;
+    }
+
+    ShellyClient.MarkSent(GridType());
     _lastLimitSend = millis();
-    _shellyClientData.Update(RamDataType_t::Limit, limit);
+    _shellyClientData.Update(RamDataType_t::Limit, _actLimit);
 
     return SendLimitResult_t::SendOk;
 }
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "LimitDistribution.h"
+#include <algorithm>
+#include <cmath>
+
+float LimitDistribution::Room(const limitInverter_t& inverter, bool increase, bool production)
+{
+    if (increase) {
+        if (production && inverter.production < inverter.target - LIMIT_CONTROL_PRODUCTION_MARGIN) {
+            return 0; // limited by the panels, a higher limit has no effect
+        }
+        return std::max(inverter.maxPower - inverter.target, 0.0f);
+    }
+    if (production) {
+        // a lower limit acts below the production only
+        return std::min(inverter.target, inverter.production + LIMIT_CONTROL_PRODUCTION_MARGIN);
+    }
+    return inverter.target;
+}
+
+void LimitDistribution::Distribute(limitInverter_t* inverters, size_t count, float delta, float* room, float* weight)
+{
+    bool increase = delta > 0;
+
+    // first to the inverters, where the change has an effect, the remainder to all
+    for (uint8_t pass = 0; pass < 2 && std::fabs(delta) >= 1; pass++) {
+        bool production = pass == 0;
+        float weightSum = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            const limitInverter_t& inverter = inverters[i];
+            room[i] = 0;
+            weight[i] = 0;
+            if (!inverter.active || inverter.pending) {
+                continue; // the limit in flight is not changed
+            }
+            room[i] = Room(inverter, increase, production);
+
+            // slow inverters take a smaller part of the change
+            float speed = 1;
+            if (inverter.latency > LIMIT_CONTROL_LATENCY_REF) {
+                speed = static_cast<float>(LIMIT_CONTROL_LATENCY_REF) / inverter.latency;
+            }
+            weight[i] = room[i] * speed;
+            weightSum += weight[i];
+        }
+        if (weightSum <= 0) {
+            continue;
+        }
+
+        // the limit above the production is lowered first, it is part of the change of the total limit
+        if (!increase && production) {
+            float excess = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (weight[i] > 0) {
+                    excess += inverters[i].target - room[i];
+                }
+            }
+            if (excess > 0) {
+                float part = std::min(std::fabs(delta) / excess, 1.0f);
+                for (size_t i = 0; i < count; i++) {
+                    if (weight[i] > 0) {
+                        float lower = (inverters[i].target - room[i]) * part;
+                        inverters[i].target -= lower;
+                        delta += lower;
+                    }
+                }
+            }
+        }
+
+        float rest = delta;
+        for (size_t i = 0; i < count; i++) {
+            if (weight[i] <= 0) {
+                continue;
+            }
+            limitInverter_t& inverter = inverters[i];
+            float share = std::min(std::fabs(delta) * weight[i] / weightSum, room[i]);
+            if (increase) {
+                inverter.target += share;
+                rest -= share;
+            } else {
+                inverter.target -= share;
+                rest += share;
+            }
+        }
+        delta = rest;
+    }
+
+    // shares below LIMIT_CONTROL_SIMILAR would not be sent, combine them on the inverter with the largest change
+    int largest = -1;
+    float small = 0;
+    for (size_t i = 0; i < count; i++) {
+        limitInverter_t& inverter = inverters[i];
+        if (!inverter.active || inverter.pending) {
+            continue;
+        }
+        float change = inverter.target - inverter.limit;
+        if (std::fabs(change) < LIMIT_CONTROL_SIMILAR) {
+            small += change;
+            inverter.target = inverter.limit;
+        } else if (largest < 0 || std::fabs(change) > std::fabs(inverters[largest].target - inverters[largest].limit)) {
+            largest = static_cast<int>(i);
+        }
+    }
+    if (largest < 0) {
+        // all shares are small, the inverter with the most room takes the change
+        for (size_t i = 0; i < count; i++) {
+            if (inverters[i].active && !inverters[i].pending && (largest < 0 || Room(inverters[i], increase, false) > Room(inverters[largest], increase, false))) {
+                largest = static_cast<int>(i);
+            }
+        }
+    }
+    if (largest >= 0) {
+        limitInverter_t& inverter = inverters[largest];
+        inverter.target = std::min(std::max(inverter.target + small, 0.0f), inverter.maxPower);
+    }
+}
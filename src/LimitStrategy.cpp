@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "LimitStrategy.h"
+#include <cmath>
+
+float HeuristicLimitStrategy::Calculate(const limitInput_t& input)
+{
+    float error = input.gridPower - input.targetValue;
+
+    if (error > Border) {
+        // increase: iterate to limit
+        return input.actLimit + error * IncreaseFactor;
+    }
+    if (error < -Border - DecreaseFullBand) {
+        // decrease: set new limit
+        return input.generatedPower - std::fabs(error) * DecreaseFullFactor;
+    }
+    if (error < -Border) {
+        return input.actLimit - std::fabs(error) * DecreaseFactor;
+    }
+    return LIMIT_STRATEGY_NO_CHANGE;
+}
+
+PiLimitStrategy::PiLimitStrategy()
+    : _kp(0)
+    , _ki(0)
+    , _kff(0)
+    , _integral(0)
+{
+}
+
+void PiLimitStrategy::SetParameter(float kp, float ki, float kff)
+{
+    _kp = kp;
+    _ki = ki;
+    _kff = kff;
+}
+
+float PiLimitStrategy::Calculate(const limitInput_t& input)
+{
+    // import -> more generation required
+    float error = input.gridPower - input.targetValue;
+    float feedForward = _kff * input.generatedPower;
+
+    float integral = _integral + _ki * error * input.dt;
+    float output = feedForward + _kp * error + integral;
+
+    // conditional integration: keep the integral, if the output is limited and the error pushes further out
+    if (!((output > input.maxLimit && error > 0) || (output < input.minLimit && error < 0))) {
+        _integral = integral;
+    }
+    output = feedForward + _kp * error + _integral;
+
+    if (output > input.maxLimit) {
+        output = input.maxLimit;
+    }
+    if (output < input.minLimit) {
+        output = input.minLimit;
+    }
+    return output;
+}
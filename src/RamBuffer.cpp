@@ -5,155 +5,143 @@
 
 #include "RamBuffer.h"
 #include "MessageOutput.h"
+#include <esp_rom_crc.h>
 
-RamBuffer::RamBuffer(uint8_t* buffer, size_t size)
+RamBuffer::RamBuffer(uint8_t* buffer, size_t size, const uint16_t* capacities)
     : _header(reinterpret_cast<dataEntryHeader_t*>(buffer))
+    , _entries(reinterpret_cast<dataEntry_t*>(&_header[1]))
     , _elements((size - sizeof(dataEntryHeader_t)) / sizeof(dataEntry_t))
 {
-    // On reset: _header, _cache and _cacheSize is set. The values in PSRAM are not changes/deleted.
-    // On power on: do additional initialisation
+    // On reset: _header, _cache and _cacheSize is set. The values in PSRAM are not changes/deleted -> Restore()
+    // On power on: do additional initialisation -> PowerOnInitialize()
     // https://www.esp32.com/viewtopic.php?t=35063
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        _capacities[i] = capacities[i];
+    }
 }
 
 void RamBuffer::PowerOnInitialize()
 {
-    _header->start = reinterpret_cast<dataEntry_t*>(&_header[1]);
-    _header->first = _header->start;
-    _header->last = _header->start;
-    _header->end = &_header->start[_elements];
+    size_t start = 0;
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        // a too small buffer cuts the capacity of the last segments
+        size_t capacity = _capacities[i];
+        if (start + capacity > _elements) {
+            capacity = _elements - start;
+        }
+
+        dataSegment_t& seg = _header->segment[i];
+        seg.start = start;
+        seg.capacity = capacity;
+        seg.first = 0;
+        seg.count = 0;
+
+        start += capacity;
+    }
+
+    _header->id = RAMBUFFER_HEADER_ID;
+    _header->timeBase = 0;
+    updateCrc();
 }
 
-void RamBuffer::writeValue(RamDataType_t type, time_t time, float value)
+bool RamBuffer::Restore()
 {
-    _header->last->type = type;
-    _header->last->time = time;
-    _header->last->value = value;
-    // MessageOutput.printf("writeValue: ## %d: 0x%x, (%d, %05.2f)\r\n", toIndex(_header->last), _header->last->type, _header->last->time, _header->last->value);
+    if (_header->id != RAMBUFFER_HEADER_ID || _header->crc != calculateCrc()) {
+        return false;
+    }
 
-    _header->last++;
+    // the layout must match the actual capacities
+    size_t start = 0;
+    time_t lastTime = 0;
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        size_t capacity = _capacities[i];
+        if (start + capacity > _elements) {
+            capacity = _elements - start;
+        }
 
-    // last on end -> begin with start
-    if (_header->last == _header->end) {
-        _header->last = _header->start;
-    }
+        const dataSegment_t& seg = _header->segment[i];
+        if (seg.start != start || seg.capacity != capacity || (capacity > 0 && seg.first >= capacity) || seg.count > capacity) {
+            return false;
+        }
 
-    // last overwrites first -> increase first
-    if (_header->last == _header->first) {
-        _header->first++;
-        if (_header->first == _header->end) {
-            _header->first = _header->start;
+        if (seg.count > 0) {
+            dataEntry_t* last = entryAt(seg, seg.count - 1);
+            lastTime = last->time > lastTime ? last->time : lastTime;
         }
+        start += capacity;
     }
+
+    // millis() starts again with 0, new entries are stored after the restored ones
+    _header->timeBase = lastTime + 1;
+    updateCrc();
+
+    MessageOutput.printf("RamBuffer restored, time base %" PRIu32 "\r\n", _header->timeBase);
+    return true;
 }
 
-dataEntry_t* RamBuffer::getLastEntry(RamDataType_t type)
+uint32_t RamBuffer::calculateCrc() const
 {
-    dataEntry_t* act = _header->last;
-
-    if (_header->last < _header->first) // buffer full
-    {
-        while (act > _header->start) {
-            act--;
-            if (act->type == type) {
-                return act;
-            }
-        }
-        act = _header->end;
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(_header), offsetof(dataEntryHeader_t, crc));
+}
+
+void RamBuffer::writeValue(RamDataType_t type, time_t time, float value)
+{
+    dataSegment_t& seg = segment(type);
+    if (seg.capacity == 0) {
+        return;
     }
 
-    while (act > _header->first) {
-        act--;
-        if (act->type == type) {
-            return act;
-        }
+    dataEntry_t* entry = entryAt(seg, seg.count < seg.capacity ? seg.count : 0);
+    entry->type = type;
+    entry->time = time;
+    entry->value = value;
+    // MessageOutput.printf("writeValue: ## %d: 0x%x, (%d, %05.2f)\r\n", entry - _entries, entry->type, entry->time, entry->value);
+
+    // segment full -> the new entry overwrote first, increase first
+    if (seg.count < seg.capacity) {
+        seg.count++;
+    } else {
+        seg.first = (seg.first + 1) % seg.capacity;
     }
-    return nullptr;
+    updateCrc();
 }
 
-void RamBuffer::forAllEntriesReverse(RamDataType_t type, time_t lastMillis, const std::function<void(dataEntry_t*)>& doDataEntry)
+dataEntry_t* RamBuffer::getLastEntry(RamDataType_t type)
 {
-    dataEntry_t* act = _header->last;
-
-    time_t startTime = millis() - lastMillis;
-    startTime = startTime < 0 ? 0 : startTime;
-
-    if (_header->last < _header->first) // buffer full
-    {
-        while (act > _header->start) {
-            act--;
-            if (act->time < startTime) {
-                return;
-            }
-            if (act->type == type) {
-                doDataEntry(act);
-            }
-        }
-        act = _header->end;
-    }
-    while (act > _header->first) {
-        act--;
-        if (act->time < startTime) {
-            return;
-        }
-        if (act->type == type) {
-            doDataEntry(act);
-        }
+    dataSegment_t& seg = segment(type);
+    if (seg.count == 0) {
+        return nullptr;
     }
+    return entryAt(seg, seg.count - 1);
 }
 
-void RamBuffer::forAllEntries(RamDataType_t type, time_t lastMillis, const std::function<void(dataEntry_t*)>& doDataEntry)
+size_t RamBuffer::copyEntries(RamDataType_t type, time_t startTime, size_t skip, time_t endTime, dataEntry_t* entries, size_t maxEntries)
 {
-    dataEntry_t* act = toStartEntry(type, lastMillis);
-    if (act == nullptr) {
-        return;
-    }
+    dataSegment_t& seg = segment(type);
 
-    for (int i = 0; i < 2; i++) {
-        while (act < _header->end) {
-            // end check
-            if (act == _header->last) {
-                return;
-            }
-
-            // type check
-            if (type == act->type) {
-                doDataEntry(act);
-            }
-            act++;
+    size_t cnt = 0;
+    for (size_t pos = toStartPosition(seg, startTime) + skip; pos < seg.count && cnt < maxEntries; pos++) {
+        dataEntry_t* act = entryAt(seg, pos);
+        if (act->time > endTime) {
+            break;
         }
-        act = _header->start; // start again with _header->start
+        entries[cnt++] = *act;
     }
+    return cnt;
 }
 
-dataEntry_t* RamBuffer::toStartEntry(RamDataType_t type, time_t lastMillis)
+uint16_t RamBuffer::toStartPosition(const dataSegment_t& seg, time_t startTime)
 {
-    time_t startTime = millis() - lastMillis;
-
-    dataEntry_t* act = _header->last;
-    dataEntry_t* found = nullptr;
-
-    if (_header->last < _header->first) // buffer full
-    {
-        while (act > _header->start) {
-            act--;
-            if (act->time < startTime) {
-                return found;
-            }
-            if (act->type == type) {
-                found = act;
-            }
+    // entries of one segment are ordered by time -> binary search for the first entry >= startTime
+    uint16_t low = 0;
+    uint16_t high = seg.count;
+    while (low < high) {
+        uint16_t mid = low + (high - low) / 2;
+        if (entryAt(seg, mid)->time < startTime) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
-        act = _header->end;
     }
-    while (act > _header->first) {
-        act--;
-        if (act->time < startTime) {
-            return found;
-        }
-        if (act->type == type) {
-            found = act;
-        }
-    }
-
-    return found;
+    return low;
 }
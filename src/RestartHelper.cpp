@@ -5,6 +5,7 @@
 #include "RestartHelper.h"
 #include "Display_Graphic.h"
 #include "Led_Single.h"
+#include "ShellyEnergy.h"
 #include <Esp.h>
 
 RestartHelperClass RestartHelper;
@@ -30,6 +31,7 @@ void RestartHelperClass::loop()
     if (_rebootTask.isFirstIteration()) {
         LedSingle.turnAllOff();
         Display.setStatus(false);
+        ShellyEnergy.write();
     } else {
         ESP.restart();
     }
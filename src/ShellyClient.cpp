@@ -9,13 +9,74 @@
 #include "SunPosition.h"
 #include <Arduino.h>
 #include <Hoymiles.h>
+#include <algorithm>
 #include <cfloat>
 
 ShellyClientClass ShellyClient;
 
+// Every request with src subscribes this connection to the notifications of the device
+#define SHELLY_GET_STATUS "{\"id\":2, \"src\":\"user_1\", \"method\":\"Shelly.GetStatus\"}"
+
+static_assert(static_cast<size_t>(ShellyPath_t::MAX) <= SHELLY_JSON_MAX_PATHS, "too many JSON paths for the scanner");
+
+// Feeds the body of a HTTP reply into the scanner, HTTPClient decodes a chunked body
+class ShellyScannerStream : public Stream {
+public:
+    explicit ShellyScannerStream(ShellyJsonScanner& scanner)
+        : _scanner(scanner)
+    {
+    }
+    size_t write(uint8_t c) override
+    {
+        char ch = static_cast<char>(c);
+        _scanner.feed(&ch, 1);
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        _scanner.feed(reinterpret_cast<const char*>(buffer), size);
+        return size;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override { }
+
+private:
+    ShellyJsonScanner& _scanner;
+};
+
+static void AddHistogram(shellyHistogram_t& histogram, uint32_t micros)
+{
+    size_t bucket = 0;
+    while (bucket < SHELLY_HISTOGRAM_BUCKETS - 1 && micros > ShellyHistogramBounds[bucket]) {
+        bucket++;
+    }
+    histogram.buckets[bucket]++;
+    histogram.sumMicros += micros;
+    histogram.count++;
+}
+
+static_assert(static_cast<size_t>(RamDataType_t::Device0) + SHELLY_MAX_DEVICES <= static_cast<size_t>(RamDataType_t::MAX),
+    "a RamDataType_t::DeviceN is required for each device");
+
 ShellyClientClass::ShellyClientClass()
     : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&ShellyClientClass::loop, this))
+    , _taskHandle(nullptr)
+    , _enable(false)
+    , _httpInterval(0)
+    , _configChanged(false)
+    , _taskEnable(false)
+    , _taskHttpInterval(0)
+    , _httpNext(0)
 {
+    memset(_config, 0, sizeof(_config));
+    memset(_taskConfig, 0, sizeof(_taskConfig));
+    memset(_transport, 0, sizeof(_transport));
+    memset(_health, 0, sizeof(_health));
+    for (auto& time : _roleTime) {
+        time = 0;
+    }
 }
 
 void ShellyClientClass::init(Scheduler& scheduler)
@@ -23,68 +84,266 @@ void ShellyClientClass::init(Scheduler& scheduler)
     scheduler.addTask(_loopTask);
     _loopTask.enable();
 
-    _Pro3EM.ShellyType = RamDataType_t::Pro3EM;
-    _Pro3EM.MaxInterval = 5000;
-    _PlugS.ShellyType = RamDataType_t::PlugS;
-    _PlugS.MaxInterval = 5000;
+    for (uint8_t i = 0; i < SHELLY_MAX_DEVICES; i++) {
+        _devices[i].SeriesType = static_cast<RamDataType_t>(static_cast<size_t>(RamDataType_t::Device0) + i);
+    }
+
+    // WebSocketsClient::loop() blocks on the sockets, it must not delay the radio and the web server
+    xTaskCreatePinnedToCore(ShellyClientClass::NetworkTask, "shelly", SHELLY_TASK_STACK, this, SHELLY_TASK_PRIORITY, &_taskHandle, SHELLY_TASK_CORE);
 }
 
 void ShellyClientClass::loop()
 {
-    while (WiFi.status() != WL_CONNECTED) {
+    // the configuration is only consistent in the loop task, the network task gets a copy
+    const CONFIG_T& config = Configuration.get();
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_enable != config.Shelly.ShellyEnable || _httpInterval != config.Shelly.HttpInterval
+            || memcmp(_config, config.Shelly.Devices, sizeof(_config)) != 0) {
+            _enable = config.Shelly.ShellyEnable;
+            _httpInterval = config.Shelly.HttpInterval;
+            memcpy(_config, config.Shelly.Devices, sizeof(_config));
+            _configChanged = true;
+            changed = true;
+        }
+    }
+    if (changed) {
+        UpdateMqttSubscriptions();
+    }
+
+    shellySample_t sample;
+    while (_samples.pop(sample)) {
+        _shellyClientData.Update(sample.entry.type, sample.entry.value, sample.entry.time);
+        _samples.stored(sample);
+
+        if (_sampleCallback) {
+            _sampleCallback(sample.entry.type);
+        }
+    }
+}
+
+void ShellyClientClass::UpdateMqttSubscriptions()
+{
+    // NotifyStatus like on the websocket, "RPC status notifications over MQTT" must be enabled in the Shelly
+    for (uint8_t i = 0; i < SHELLY_MAX_DEVICES; i++) {
+        String topic;
+        if (_enable && _config[i].Transport == static_cast<uint8_t>(ShellyTransport_t::Mqtt) && strlen(_config[i].Hostname) > 0) {
+            topic = String(_config[i].Hostname) + "/events/rpc";
+        }
+        if (topic == _mqttTopic[i]) {
+            continue;
+        }
+
+        if (!_mqttTopic[i].isEmpty()) {
+            MqttSettings.unsubscribe(_mqttTopic[i]);
+        }
+        _mqttTopic[i] = topic;
+        if (!topic.isEmpty()) {
+            MqttSettings.subscribe(topic, 0,
+                [this, i](const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total) {
+                    OnMqttMessage(i, properties, topic, payload, len, index, total);
+                });
+        }
+    }
+}
+
+void ShellyClientClass::OnMqttMessage(uint8_t device, const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total)
+{
+    if (properties.retain) {
+        return; // old value
+    }
+
+    shellyMqttMessage_t& message = _mqttPartial[device];
+    if (index == 0) {
+        message.device = device;
+        message.arrivalMicros = micros();
+        message.payload.clear();
+    }
+
+    bool lastPart = index + len >= total;
+    if (total > SHELLY_MQTT_MAX_PAYLOAD || message.payload.size() != index) {
+        // too large or a part is missing
+        if (lastPart) {
+            AddTransport(ShellyTransport_t::Mqtt, false, 0);
+        }
+        return;
+    }
+
+    message.payload.append(reinterpret_cast<const char*>(payload), len);
+    if (!lastPart) {
+        return;
+    }
+
+    if (_mqttQueue.size() >= SHELLY_MQTT_QUEUE_SIZE) {
+        AddTransport(ShellyTransport_t::Mqtt, false, 0); // the network task is blocked
+        return;
+    }
+    _mqttQueue.push(message);
+}
+
+void ShellyClientClass::AddTransport(ShellyTransport_t transport, bool success, uint32_t micros)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    shellyTransportStats_t& stats = _transport[static_cast<size_t>(transport)];
+    if (!success) {
+        stats.failures++;
+        return;
+    }
+    stats.messages++;
+    if (micros > 0) {
+        ShellySamplePath::AddMicros(stats.latency, micros);
+    }
+}
+
+shellyTransportStats_t ShellyClientClass::GetTransportStats(ShellyTransport_t transport)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _transport[static_cast<size_t>(transport)];
+}
+
+shellyDeviceHealth_t ShellyClientClass::GetDeviceHealth(uint8_t device)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _health[device < SHELLY_MAX_DEVICES ? device : 0];
+}
+
+shellyDeviceHealth_t& ShellyClientClass::Health(const WebSocketData& data)
+{
+    return _health[&data - _devices];
+}
+
+void ShellyClientClass::NetworkTask(void* parameter)
+{
+    ShellyClientClass* client = static_cast<ShellyClientClass*>(parameter);
+    for (;;) {
+        client->NetworkLoop();
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+}
+
+void ShellyClientClass::NetworkLoop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_configChanged) {
+            _taskEnable = _enable;
+            _taskHttpInterval = _httpInterval;
+            memcpy(_taskConfig, _config, sizeof(_taskConfig));
+            _configChanged = false;
+        }
+    }
+
+    if (WiFi.status() != WL_CONNECTED) {
         return;
     }
     // if (!SunPosition.isDayPeriod()) {
     //     return;
     // }
 
-    const CONFIG_T& config = Configuration.get();
+    for (uint8_t i = 0; i < SHELLY_MAX_DEVICES; i++) {
+        HandleWebsocket(_devices[i], _taskConfig[i], _taskEnable);
+    }
 
-    HandleWebsocket(_Pro3EM, config.Shelly.Hostname_Pro3EM, ShellyClientClass::EventsPro3EM);
-    HandleWebsocket(_PlugS, config.Shelly.Hostname_PlugS, ShellyClientClass::EventsPlugS);
+    // a request blocks all sockets, so at most one per pass and the devices take turns
+    for (uint8_t n = 0; n < SHELLY_MAX_DEVICES; n++) {
+        uint8_t i = (_httpNext + n) % SHELLY_MAX_DEVICES;
+        if (HandleHttp(_devices[i], _taskHttpInterval)) {
+            _httpNext = (i + 1) % SHELLY_MAX_DEVICES;
+            break;
+        }
+    }
+    HandleMqtt();
 }
 
-void ShellyClientClass::HandleWebsocket(WebSocketData& data, const char* hostname, std::function<void(WStype_t type, uint8_t* payload, size_t length)> cbEvent)
+void ShellyClientClass::Push(RamDataType_t type, float value, time_t time, uint32_t arrivalMicros)
+{
+    shellySample_t sample = { { type, time, value }, arrivalMicros };
+    _samples.push(sample, []() { vTaskDelay(pdMS_TO_TICKS(1)); });
+}
+
+void ShellyClientClass::HandleWebsocket(WebSocketData& data, const SHELLY_DEVICE_CONFIG_T& device, bool enable)
 {
-    const CONFIG_T& config = Configuration.get();
     unsigned long nowMillis = millis();
 
+    const char* hostname = device.Hostname;
+    ShellyDeviceType_t type = device.Type < static_cast<uint8_t>(ShellyDeviceType_t::MAX) ? static_cast<ShellyDeviceType_t>(device.Type) : ShellyDeviceType_t::Generic;
+    const char* path = strlen(device.JsonPath) > 0 ? device.JsonPath : ShellyDefaultValuePaths[static_cast<size_t>(type)];
+    ShellyTransport_t transport = device.Transport == static_cast<uint8_t>(ShellyTransport_t::Mqtt) ? ShellyTransport_t::Mqtt : ShellyTransport_t::WebSocket;
+
     bool bDelete = data.Host.compare(hostname) != 0; // hostname changed in configuration
+    bDelete |= data.Type != type || strcmp(data.JsonPath, path) != 0; // other value
+    bDelete |= data.Transport != transport;
     bDelete |= strlen(hostname) == 0; // IP deleted in configuration
-    bDelete |= !config.Shelly.ShellyEnable; // shelly disabled
+    bDelete |= !enable; // shelly disabled
+
+    bool bNew = bDelete && strlen(hostname) > 0 && strlen(path) > 0; // deleted and new hostname valid
+    bNew &= enable; // && shelly enable
 
-    bool bNew = bDelete && strlen(hostname) > 0; // deleted and new hostname valid
-    bNew &= config.Shelly.ShellyEnable; // && shelly enable
+    ShellyRole_t role = device.Role < static_cast<uint8_t>(ShellyRole_t::MAX) ? static_cast<ShellyRole_t>(device.Role) : ShellyRole_t::Consumer;
 
-    if (bDelete && data.Client != nullptr) {
-        MessageOutput.printf("Delete WebSocketClient. %s\r\n", data.Host.c_str());
+    // the host of an active device is set, an MQTT device has no client
+    if (bDelete && !data.Host.empty()) {
+        MessageOutput.printf("Delete Shelly device. %s\r\n", data.Host.c_str());
         delete data.Client;
         data.Client = nullptr;
+        DeleteHttp(data);
         data.Host = "";
+        data.Connected = false;
+        data.HasValue = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Health(data).connected = false;
+        }
+        UpdateRole(data.Role, _shellyClientData.Now(), micros()); // the role the value was part of
     }
 
-    if (bNew && data.Client == nullptr) {
-        MessageOutput.printf("Add WebSocketClient %s\r\n", hostname);
-        data.Client = new WebSocketsClient();
-        data.Client->begin(hostname, 80, "/rpc");
-        data.Client->onEvent(cbEvent);
-        data.Client->setReconnectInterval(2000);
-        data.Host = hostname;
-        data.LastTime = nowMillis;
-        data.UpdatedTime = data.LastTime;
+    // a new role takes effect at once, the last value moves from the sum of the old role to the new one
+    if (data.Role != role) {
+        ShellyRole_t oldRole = data.Role;
+        data.Role = role;
+        if (data.HasValue) {
+            UpdateRole(oldRole, _shellyClientData.Now(), micros());
+            UpdateRole(role, _shellyClientData.Now(), micros());
+        }
     }
 
-    if (data.Connected) {
-        if (nowMillis - data.LastTime > data.MaxInterval) {
-            data.Client->sendTXT("{\"id\":2, \"src\":\"user_1\", \"method\":\"Shelly.GetStatus\"}");
-
+    if (bNew && data.Host.empty()) {
+        data.Type = type;
+        data.Transport = transport;
+        strlcpy(data.JsonPath, path, sizeof(data.JsonPath));
+        data.LastSampleTime = 0;
+        data.Clock.reset();
+        data.HttpBackoff.reset();
+        {
             std::lock_guard<std::mutex> lock(_mutex);
-            data.LastTime = nowMillis;
-            data.UpdatedTime = data.LastTime;
-        } else if (nowMillis - data.UpdatedTime > 1000) {
-            _shellyClientData.Update(data.ShellyType, data.LastValue);
-            data.UpdatedTime += 1000;
+            memset(&Health(data), 0, sizeof(shellyDeviceHealth_t)); // other device
+        }
+
+        if (transport == ShellyTransport_t::WebSocket) {
+            MessageOutput.printf("Add WebSocketClient %s\r\n", hostname);
+
+            // one dispatcher for all connections
+            data.Client = new WebSocketsClient();
+            data.Client->begin(hostname, 80, "/rpc");
+            data.Client->onEvent([this, &data](WStype_t type, uint8_t* payload, size_t length) {
+                Events(data, type, payload, length);
+            });
+            data.Client->setReconnectInterval(2000);
+        } else {
+            MessageOutput.printf("Add Shelly MQTT device %s\r\n", hostname);
         }
+        data.Host = hostname;
+        data.LastTime = nowMillis;
+    }
+
+    // The values are sent as NotifyStatus on every change. Poll only, if the notifications stall.
+    if (data.Connected && nowMillis - data.LastTime > data.MaxInterval) {
+        data.Client->sendTXT(SHELLY_GET_STATUS);
+        data.RequestMicros = micros();
+        data.RequestPending = true;
+        data.LastTime = nowMillis;
     }
 
     if (data.Client != nullptr) {
@@ -92,64 +351,277 @@ void ShellyClientClass::HandleWebsocket(WebSocketData& data, const char* hostnam
     }
 }
 
-void ShellyClientClass::EventsPro3EM(WStype_t type, uint8_t* payload, size_t length)
+bool ShellyClientClass::HandleHttp(WebSocketData& data, uint32_t interval)
 {
-    ShellyClient.Events(ShellyClient._Pro3EM, type, payload, length);
+    // only while the websocket of a configured device is down
+    if (interval == 0 || data.Client == nullptr || data.Connected) {
+        return false;
+    }
+
+    if (!data.HttpBackoff.isDue(millis(), interval)) {
+        return false;
+    }
+
+    if (data.Http == nullptr) {
+        data.HttpSocket = new WiFiClient();
+        data.Http = new HTTPClient();
+        data.Http->setReuse(true);
+        data.Http->setTimeout(SHELLY_HTTP_TIMEOUT);
+        data.Http->setConnectTimeout(SHELLY_HTTP_TIMEOUT);
+    }
+
+    // the smaller reply of the component, unless an own JSON path may be elsewhere
+    bool defaultPath = strcmp(data.JsonPath, ShellyDefaultValuePaths[static_cast<size_t>(data.Type)]) == 0;
+    const shellyHttpRpc_t& rpc = ShellyHttpRpc[static_cast<size_t>(defaultPath ? data.Type : ShellyDeviceType_t::Generic)];
+
+    uint32_t start = micros();
+    data.Http->begin(*data.HttpSocket, data.Host.c_str(), 80, rpc.uri);
+    int httpCode = data.Http->GET();
+    if (httpCode != HTTP_CODE_OK) {
+        data.Http->end();
+        HttpFailed(data, rpc.uri, httpCode, interval);
+        return true;
+    }
+
+    data.ArrivalMicros = micros(); // header received
+    data.Scanner.reset();
+    data.Scanner.feed(rpc.prefix, strlen(rpc.prefix));
+    ShellyScannerStream stream(data.Scanner);
+    int size = data.Http->writeToStream(&stream);
+    data.Scanner.feed(rpc.suffix, strlen(rpc.suffix));
+    data.Http->end(); // the connection stays open, if the device allows keep-alive
+
+    if (size < 0) {
+        HttpFailed(data, rpc.uri, size, interval);
+        return true;
+    }
+
+    data.HttpBackoff.succeeded();
+    AddTransport(ShellyTransport_t::Http, true, micros() - start);
+    HandleMessage(data);
+    return true;
+}
+
+void ShellyClientClass::HttpFailed(WebSocketData& data, const char* uri, int error, uint32_t interval)
+{
+    MessageOutput.printf("[HTTP] %s%s failed: %s\r\n", data.Host.c_str(), uri, HTTPClient::errorToString(error).c_str());
+    AddTransport(ShellyTransport_t::Http, false, 0);
+    data.HttpBackoff.failed(interval);
+}
+
+void ShellyClientClass::HandleMqtt()
+{
+    while (auto message = _mqttQueue.pop()) {
+        WebSocketData& data = _devices[message->device];
+        if (data.Transport != ShellyTransport_t::Mqtt || data.Host.empty()) {
+            continue; // configuration changed
+        }
+
+        // the same parser and device time as a websocket notification
+        data.ArrivalMicros = message->arrivalMicros;
+        data.Scanner.reset();
+        data.Scanner.feed(message->payload.data(), message->payload.size());
+        AddTransport(ShellyTransport_t::Mqtt, true, 0);
+        HandleMessage(data);
+    }
 }
 
-void ShellyClientClass::EventsPlugS(WStype_t type, uint8_t* payload, size_t length)
+void ShellyClientClass::DeleteHttp(WebSocketData& data)
 {
-    ShellyClient.Events(ShellyClient._PlugS, type, payload, length);
+    // HTTPClient stops its WiFiClient, so the socket is deleted last
+    delete data.Http;
+    data.Http = nullptr;
+    delete data.HttpSocket;
+    data.HttpSocket = nullptr;
 }
 
 void ShellyClientClass::Events(WebSocketData& data, WStype_t type, uint8_t* payload, size_t length)
 {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        shellyDeviceHealth_t& health = Health(data);
+        switch (type) {
+        case WStype_DISCONNECTED:
+            health.connected = false;
+            break;
+        case WStype_CONNECTED:
+            health.connected = true;
+            health.connects++;
+            break;
+        case WStype_TEXT:
+        case WStype_BIN:
+        case WStype_FRAGMENT_TEXT_START:
+        case WStype_FRAGMENT_BIN_START:
+        case WStype_FRAGMENT:
+        case WStype_FRAGMENT_FIN:
+            health.frames++;
+            break;
+        default:
+            break;
+        }
+    }
+
     switch (type) {
     case WStype_DISCONNECTED:
-        MessageOutput.printf("[WSc] Disconnected!\r\n");
+        MessageOutput.printf("[WSc] Disconnected %s!\r\n", data.Host.c_str());
+        if (data.Connected) {
+            AddTransport(ShellyTransport_t::WebSocket, false, 0);
+        }
         data.Connected = false;
+        data.RequestPending = false;
         break;
     case WStype_CONNECTED:
         MessageOutput.printf("[WSc] Connected to url: %s\r\n", payload);
         data.Connected = true;
+        data.Clock.reset();
+        data.Client->sendTXT(SHELLY_GET_STATUS);
+        data.RequestMicros = micros();
+        data.RequestPending = true;
+        data.LastTime = millis();
+        break;
+    case WStype_TEXT:
+        data.ArrivalMicros = micros();
+        data.Scanner.reset();
+        data.Scanner.feed(reinterpret_cast<char*>(payload), length);
+        HandleWebsocketMessage(data);
+        break;
+    case WStype_FRAGMENT_TEXT_START:
+        data.ArrivalMicros = micros();
+        data.Scanner.reset();
+        data.Scanner.feed(reinterpret_cast<char*>(payload), length);
+        break;
+    case WStype_FRAGMENT:
+        data.Scanner.feed(reinterpret_cast<char*>(payload), length);
+        break;
+    case WStype_FRAGMENT_FIN:
+        data.Scanner.feed(reinterpret_cast<char*>(payload), length);
+        HandleWebsocketMessage(data);
         break;
-    case WStype_TEXT: {
-        auto ParseDouble = [&](const char* search, double& result) {
-            // e.g. ...ull,"total_act_power":225.658,"total
-            // e.g. ...ue, "apower":0.0, "volta
-            char* key = strstr(reinterpret_cast<char*>(payload), search);
-            if (key != nullptr) {
-                key += strlen(search);
-                result = atof(key);
-                return true;
-            }
-            return false;
-        };
-
-        if (data.ShellyType == RamDataType_t::Pro3EM) {
-            if (ParseDouble("\"total_act_power\":", data.LastValue)) {
-                _shellyClientData.Update(data.ShellyType, data.LastValue);
-            }
-        } else {
-            if (ParseDouble("\"apower\":", data.LastValue)) {
-                _shellyClientData.Update(data.ShellyType, data.LastValue);
-            }
-        }
-    } break;
     case WStype_BIN:
         MessageOutput.printf("[WSc] get binary length: %u\r\n", length);
         break;
     case WStype_ERROR:
-    case WStype_FRAGMENT_TEXT_START:
     case WStype_FRAGMENT_BIN_START:
-    case WStype_FRAGMENT:
-    case WStype_FRAGMENT_FIN:
     case WStype_PING:
     case WStype_PONG:
         break;
     }
+}
 
-    std::lock_guard<std::mutex> lock(_mutex);
-    data.LastTime = millis();
-    data.UpdatedTime = data.LastTime;
+void ShellyClientClass::HandleWebsocketMessage(WebSocketData& data)
+{
+    // only the reply of Shelly.GetStatus has an id, the notifications are not requested
+    uint32_t latency = 0;
+    double id;
+    if (data.RequestPending && data.Scanner.getValue(static_cast<size_t>(ShellyPath_t::Id), id)) {
+        latency = micros() - data.RequestMicros;
+        data.RequestPending = false;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        AddHistogram(Health(data).rpcLatency, latency);
+    }
+    AddTransport(ShellyTransport_t::WebSocket, true, latency);
+    HandleMessage(data);
+}
+
+void ShellyClientClass::HandleMessage(WebSocketData& data)
+{
+    bool hasValue = data.Scanner.getValue(static_cast<size_t>(ShellyPath_t::Value), data.LastValue);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        shellyDeviceHealth_t& health = Health(data);
+        health.messages++;
+        if (!data.Scanner.isComplete()) {
+            health.parseFailures++; // the values found so far are used anyway
+        }
+        if (hasValue) {
+            if (health.hasSample) {
+                uint32_t interval = data.ArrivalMicros - health.lastSampleMicros;
+                AddHistogram(health.interval, interval);
+                if (health.interval.count > 1) {
+                    float delta = static_cast<float>(interval) - static_cast<float>(health.lastIntervalMicros);
+                    health.jitterMicros += ((delta < 0 ? -delta : delta) - health.jitterMicros) / 16.0f;
+                }
+                health.lastIntervalMicros = interval;
+            }
+            health.hasSample = true;
+            health.lastSampleMillis = millis();
+            health.lastSampleMicros = data.ArrivalMicros;
+        }
+    }
+
+    // NotifyStatus contains only the changed values and the device time of the change
+    time_t time = _shellyClientData.Now();
+    double ts;
+    if (data.Scanner.getValue(static_cast<size_t>(ShellyPath_t::Ts), ts)) {
+        time = data.Clock.toLocalTime(ts, time, data.LastSampleTime);
+    }
+
+    if (hasValue) {
+        Push(data.SeriesType, data.LastValue, time, data.ArrivalMicros);
+        data.LastSampleTime = time;
+        data.HasValue = true;
+        UpdateRole(data.Role, time, data.ArrivalMicros);
+        data.LastTime = millis();
+    }
+
+    if (data.Type != ShellyDeviceType_t::Pro3EM || data.Role != ShellyRole_t::GridMeter) {
+        return;
+    }
+
+    // values of the phases, only the changed ones are part of a notification
+    static const struct {
+        ShellyPath_t path;
+        RamDataType_t type;
+    } phaseValues[] = {
+        { ShellyPath_t::ActPowerA, RamDataType_t::Pro3EM_A },
+        { ShellyPath_t::ActPowerB, RamDataType_t::Pro3EM_B },
+        { ShellyPath_t::ActPowerC, RamDataType_t::Pro3EM_C },
+        { ShellyPath_t::VoltageA, RamDataType_t::Pro3EM_VoltageA },
+        { ShellyPath_t::VoltageB, RamDataType_t::Pro3EM_VoltageB },
+        { ShellyPath_t::VoltageC, RamDataType_t::Pro3EM_VoltageC },
+        { ShellyPath_t::CurrentA, RamDataType_t::Pro3EM_CurrentA },
+        { ShellyPath_t::CurrentB, RamDataType_t::Pro3EM_CurrentB },
+        { ShellyPath_t::CurrentC, RamDataType_t::Pro3EM_CurrentC },
+        { ShellyPath_t::PfA, RamDataType_t::Pro3EM_PfA },
+        { ShellyPath_t::PfB, RamDataType_t::Pro3EM_PfB },
+        { ShellyPath_t::PfC, RamDataType_t::Pro3EM_PfC },
+    };
+
+    for (auto& v : phaseValues) {
+        double value;
+        if (data.Scanner.getValue(static_cast<size_t>(v.path), value)) {
+            Push(v.type, value, time, data.ArrivalMicros);
+        }
+    }
+}
+
+void ShellyClientClass::UpdateRole(ShellyRole_t role, time_t time, uint32_t arrivalMicros)
+{
+    RamDataType_t sumType;
+    switch (role) {
+    case ShellyRole_t::GridMeter:
+        sumType = RamDataType_t::Pro3EM;
+        break;
+    case ShellyRole_t::Generation:
+        sumType = RamDataType_t::PlugS;
+        break;
+    default:
+        return;
+    }
+
+    // the last value of each device with this role, e.g. several plugs of one plant
+    float sum = 0;
+    for (auto& data : _devices) {
+        if (data.HasValue && data.Role == role) {
+            sum += data.LastValue;
+        }
+    }
+
+    // the device clocks differ, but the entries of one type must be ordered by time
+    time_t& lastTime = _roleTime[static_cast<size_t>(role)];
+    time = time < lastTime ? lastTime : time;
+    lastTime = time;
+
+    Push(sumType, sum, time, arrivalMicros);
 }
@@ -8,81 +8,283 @@
 #include "MessageOutput.h"
 #include <cfloat>
 #include <esp32-hal.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+
+#ifndef SHELLY_RAMBUFFER_SCALE
+#define SHELLY_RAMBUFFER_SCALE 1 // e.g. -DSHELLY_RAMBUFFER_SCALE=4 for boards with PSRAM
+#endif
+
+// Entries per RamDataType_t. Pro3EM and PlugS are written at least once a second,
+// the Min/Max/Limit values once per LimitControl loop. Of the phases only the power is
+// used for the control, voltage, current and power factor keep only a short history.
+// Pro3EM and PlugS are the sums of the devices per role, DeviceN the single devices.
+static constexpr uint16_t RamBufferCapacities[RAMBUFFER_TYPE_COUNT] = {
+    180 * SHELLY_RAMBUFFER_SCALE, // Pro3EM
+    90 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_Min
+    90 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_Max
+    180 * SHELLY_RAMBUFFER_SCALE, // PlugS
+    90 * SHELLY_RAMBUFFER_SCALE, // PlugS_Min
+    90 * SHELLY_RAMBUFFER_SCALE, // PlugS_Max
+    90 * SHELLY_RAMBUFFER_SCALE, // CalulatedLimit
+    90 * SHELLY_RAMBUFFER_SCALE, // Limit
+    90 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_A
+    90 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_B
+    90 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_C
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_VoltageA
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_VoltageB
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_VoltageC
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_CurrentA
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_CurrentB
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_CurrentC
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_PfA
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_PfB
+    20 * SHELLY_RAMBUFFER_SCALE, // Pro3EM_PfC
+    45 * SHELLY_RAMBUFFER_SCALE, // Device0
+    45 * SHELLY_RAMBUFFER_SCALE, // Device1
+    45 * SHELLY_RAMBUFFER_SCALE, // Device2
+    45 * SHELLY_RAMBUFFER_SCALE, // Device3
+    45 * SHELLY_RAMBUFFER_SCALE, // Device4
+    45 * SHELLY_RAMBUFFER_SCALE, // Device5
+};
+
+// Not initialized on startup, so the values survive software and watchdog resets.
+// PSRAM is only used, if the sdk allows noinit variables there.
+#if defined(BOARD_HAS_PSRAM) && defined(CONFIG_SPIRAM_ALLOW_NOINIT_EXTERNAL_MEMORY)
+#define RAMBUFFER_ATTR EXT_RAM_NOINIT_ATTR
+#else
+#define RAMBUFFER_ATTR __NOINIT_ATTR
+#endif
+RAMBUFFER_ATTR alignas(4) static uint8_t RamDisk[ShellyRamBuffer::requiredSize(RamBufferCapacities)];
 
 ShellyClientData::ShellyClientData()
 {
-    int ramDiskSize = 4096; // 7 * 60 Sekunden * 10 Bytes = 4200
-    uint8_t* ramDisk = new uint8_t[ramDiskSize];
+    _ramBuffer = new ShellyRamBuffer(RamDisk, sizeof(RamDisk), RamBufferCapacities);
+
+    // the content is random after power on
+    if (esp_reset_reason() == ESP_RST_POWERON || !_ramBuffer->Restore()) {
+        _ramBuffer->PowerOnInitialize();
+    }
 
-    _ramBuffer = new RamBuffer(ramDisk, ramDiskSize);
-    _ramBuffer->PowerOnInitialize();
+    // 24 hours and more of grid, plug and limit values
+    _histories.reserve(6);
+    _histories.push_back({ RamDataType_t::Pro3EM, HistoryTiers() });
+    _histories.push_back({ RamDataType_t::PlugS, HistoryTiers() });
+    _histories.push_back({ RamDataType_t::Limit, HistoryTiers() });
+#ifdef BOARD_HAS_PSRAM
+    // about 10 kB each, without PSRAM the phases have only the raw values of the RamBuffer
+    _histories.push_back({ RamDataType_t::Pro3EM_A, HistoryTiers() });
+    _histories.push_back({ RamDataType_t::Pro3EM_B, HistoryTiers() });
+    _histories.push_back({ RamDataType_t::Pro3EM_C, HistoryTiers() });
+#endif
 }
 
 ShellyClientData::~ShellyClientData()
 {
-    // TODO(shi) change RamBuffer
     delete _ramBuffer;
 }
 
-void ShellyClientData::Update(RamDataType_t type, float value)
+time_t ShellyClientData::Now()
+{
+    return _ramBuffer->now();
+}
+
+void ShellyClientData::RegisterWindow(RamDataType_t type, time_t lastMillis)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
+
+    if (FindWindow(type, lastMillis) != nullptr) {
+        return;
+    }
+
+    _windows.push_back({ type, SlidingWindow(lastMillis) });
+
+    // fill with the values already stored
+    SlidingWindow& window = _windows.back().window;
+    for (auto& entry : _ramBuffer->entries(type, lastMillis)) {
+        window.add(entry.time, entry.value);
+    }
+}
+
+SlidingWindow* ShellyClientData::FindWindow(RamDataType_t type, time_t lastMillis)
+{
+    for (auto& w : _windows) {
+        if (w.type == type && w.window.getLength() == lastMillis) {
+            w.window.expire(_ramBuffer->now());
+            return &w.window;
+        }
+    }
+    return nullptr;
+}
+
+void ShellyClientData::Update(RamDataType_t type, float value, SampleKind_t kind)
+{
+    // the time is taken now, even if the sample is stored later
+    Update(type, value, _ramBuffer->now(), kind);
+}
+
+void ShellyClientData::Update(RamDataType_t type, float value, time_t time, SampleKind_t kind)
+{
+    pendingSample_t sample = { { type, time, value }, kind };
+    if (!_pending.push(sample)) {
+        // a reader held the lock for a very long time -> wait, no sample is lost
+        std::lock_guard<std::mutex> lock(_mutex);
+        StorePending();
+        StoreSample(sample);
+        return;
+    }
+
+    // A reader holds the lock -> don't wait, the sample is stored by the reader or the next Update
+    std::unique_lock<std::mutex> lock(_mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        StorePending();
+    }
+}
+
+void ShellyClientData::StorePending()
+{
+    pendingSample_t sample;
+    while (_pending.pop(sample)) {
+        StoreSample(sample);
+    }
+}
+
+void ShellyClientData::StoreSample(const pendingSample_t& sample)
+{
+    const dataEntry_t& entry = sample.entry;
 
-    _ramBuffer->writeValue(type, millis(), value);
+    for (auto& w : _windows) {
+        if (w.type == entry.type) {
+            if (sample.kind == SampleKind_t::Real) {
+                w.window.add(entry.time, entry.value);
+            } else {
+                w.window.carry(entry.value);
+            }
+        }
+    }
+
+    // a carried value is only needed to continue the graphs
+    if (sample.kind == SampleKind_t::Carried) {
+        dataEntry_t* last = _ramBuffer->getLastEntry(entry.type);
+        if (last != nullptr && last->value == entry.value && entry.time - last->time < SHELLY_CARRY_INTERVAL) {
+            return;
+        }
+    }
+
+    _ramBuffer->writeValue(entry.type, entry.time, entry.value);
+
+    HistoryTiers* history = FindHistory(entry.type);
+    if (history != nullptr) {
+        history->add(entry.time, entry.value);
+    }
+}
+
+HistoryTiers* ShellyClientData::FindHistory(RamDataType_t type)
+{
+    for (auto& h : _histories) {
+        if (h.type == type) {
+            return &h.history;
+        }
+    }
+    return nullptr;
 }
 
 float ShellyClientData::GetActValue(RamDataType_t type)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
 
     dataEntry_t* e = _ramBuffer->getLastEntry(type);
     return e != nullptr ? e->value : 0.0;
 }
 
+void ShellyClientData::ScanMinMax(RamDataType_t type, time_t lastMillis, float& min, float& max)
+{
+    min = FLT_MAX;
+    max = -FLT_MAX;
+    for (auto& entry : _ramBuffer->entries(type, lastMillis)) {
+        if (entry.value < min) {
+            min = entry.value;
+        }
+        if (entry.value > max) {
+            max = entry.value;
+        }
+    }
+
+    // no sample in the time -> the value is unchanged since the last one
+    if (min == FLT_MAX) {
+        dataEntry_t* last = _ramBuffer->getLastEntry(type);
+        min = max = last != nullptr ? last->value : 0;
+    }
+}
+
 float ShellyClientData::GetMinValue(RamDataType_t type, time_t lastMillis)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
 
-    float min = FLT_MAX;
-    _ramBuffer->forAllEntriesReverse(type, lastMillis, [&](dataEntry_t* entry) {
-        if (entry->value < min) {
-            min = entry->value;
-        }
-    });
-    return (min == FLT_MAX) ? 0 : min;
+    SlidingWindow* window = FindWindow(type, lastMillis);
+    if (window != nullptr) {
+        return window->getMin();
+    }
+
+    float min, max;
+    ScanMinMax(type, lastMillis, min, max);
+    return min;
 }
 
 float ShellyClientData::GetMaxValue(RamDataType_t type, time_t lastMillis)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
 
-    float max = -FLT_MAX;
+    SlidingWindow* window = FindWindow(type, lastMillis);
+    if (window != nullptr) {
+        return window->getMax();
+    }
 
-    _ramBuffer->forAllEntriesReverse(type, lastMillis, [&](dataEntry_t* entry) {
-        if (entry->value > max) {
-            max = entry->value;
-        }
-    });
-    return (max == -FLT_MAX) ? 0 : max;
+    float min, max;
+    ScanMinMax(type, lastMillis, min, max);
+    return max;
 }
 
-float ShellyClientData::GetFactoredValue(RamDataType_t type, time_t lastMillis)
+float ShellyClientData::GetMeanValue(RamDataType_t type, time_t lastMillis)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
 
-    float min = FLT_MAX;
-    float max = -FLT_MAX;
-    _ramBuffer->forAllEntriesReverse(type, lastMillis, [&](dataEntry_t* entry) {
-        if (entry->value < min) {
-            min = entry->value;
-        }
-        if (entry->value > max) {
-            max = entry->value;
-        }
-    });
+    SlidingWindow* window = FindWindow(type, lastMillis);
+    if (window != nullptr) {
+        return window->getMean();
+    }
+
+    double sum = 0;
+    int cnt = 0;
+    for (auto& entry : _ramBuffer->entries(type, lastMillis)) {
+        sum += entry.value;
+        cnt++;
+    }
+    if (cnt == 0) {
+        dataEntry_t* last = _ramBuffer->getLastEntry(type);
+        return last != nullptr ? last->value : 0;
+    }
+    return sum / cnt;
+}
+
+float ShellyClientData::GetFactoredValue(RamDataType_t type, time_t lastMillis)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
 
-    min = min == FLT_MAX ? 0 : min;
-    max = max == -FLT_MAX ? 0 : max;
+    float min, max;
+    SlidingWindow* window = FindWindow(type, lastMillis);
+    if (window != nullptr) {
+        min = window->getMin();
+        max = window->getMax();
+    } else {
+        ScanMinMax(type, lastMillis, min, max);
+    }
 
     const CONFIG_T& config = Configuration.get();
 
@@ -93,21 +295,145 @@ float ShellyClientData::GetFactoredValue(RamDataType_t type, time_t lastMillis)
     return min + (max - min) * factor;
 }
 
-String& ShellyClientData::GetLastData(RamDataType_t type, time_t lastMillis, String& result)
+size_t ShellyClientData::GetEntries(RamDataType_t type, time_t startTime, size_t skip, time_t endTime, dataEntry_t* entries, size_t maxEntries)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
 
-    int cnt = 0;
-    result = "[ ";
-    _ramBuffer->forAllEntries(type, lastMillis, [&](dataEntry_t* entry) {
-        if (cnt == 0) {
-            cnt++;
+    return _ramBuffer->copyEntries(type, startTime, skip, endTime, entries, maxEntries);
+}
+
+// Column format of one series, all numbers little endian:
+//   uint8 type, uint8 encoding, uint16 count
+//   uint32 time of first entry [ms], (count - 1) * LEB128 time delta [ms]
+//   count * value, see GraphEncoding_t
+// forAllValues(doValue) calls doValue(time_t, float) for each value, it is called three times
+template <typename F>
+static void WriteBinaryColumn(Print& output, RamDataType_t type, const F& forAllValues)
+{
+    uint16_t count = 0;
+    float min = FLT_MAX;
+    float max = -FLT_MAX;
+    forAllValues([&](time_t, float value) {
+        count++;
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    });
+
+    GraphEncoding_t encoding = GraphEncoding_t::Float;
+    if (min >= -3276.7f && max <= 3276.7f) {
+        encoding = GraphEncoding_t::Int16Deci;
+    } else if (min >= -32767.0f && max <= 32767.0f) {
+        encoding = GraphEncoding_t::Int16;
+    }
+
+    const uint8_t header[] = { static_cast<uint8_t>(type), static_cast<uint8_t>(encoding), static_cast<uint8_t>(count), static_cast<uint8_t>(count >> 8) };
+    output.write(header, sizeof(header));
+    if (count == 0) {
+        return;
+    }
+
+    bool firstEntry = true;
+    uint32_t lastTime = 0;
+    forAllValues([&](time_t entryTime, float) {
+        uint32_t time = static_cast<uint32_t>(entryTime);
+        if (firstEntry) {
+            const uint8_t t[] = { static_cast<uint8_t>(time), static_cast<uint8_t>(time >> 8), static_cast<uint8_t>(time >> 16), static_cast<uint8_t>(time >> 24) };
+            output.write(t, sizeof(t));
+            firstEntry = false;
+        } else {
+            uint32_t delta = time - lastTime;
+            do {
+                uint8_t b = delta & 0x7f;
+                delta >>= 7;
+                output.write(delta != 0 ? b | 0x80 : b);
+            } while (delta != 0);
+        }
+        lastTime = time;
+    });
+
+    forAllValues([&](time_t, float value) {
+        if (encoding == GraphEncoding_t::Float) {
+            output.write(reinterpret_cast<const uint8_t*>(&value), sizeof(float)); // ESP32 is little endian
         } else {
-            result += String(",");
+            float scaled = encoding == GraphEncoding_t::Int16Deci ? value * 10.0f : value;
+            int16_t v = static_cast<int16_t>(lroundf(scaled));
+            const uint8_t b[] = { static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8) };
+            output.write(b, sizeof(b));
         }
-        result += String("{\"x\": ") + static_cast<float>(entry->time) / TASK_SECOND + String(",\"y\": ") + entry->value + String("}");
     });
-    result += " ]";
+}
+
+void ShellyClientData::WriteRawColumn(RamDataType_t type, time_t lastMillis, Print& output)
+{
+    WriteBinaryColumn(output, type, [&](const auto& doValue) {
+        for (auto& entry : _ramBuffer->entries(type, lastMillis)) {
+            doValue(entry.time, entry.value);
+        }
+    });
+}
+
+void ShellyClientData::WriteLastDataBinary(RamDataType_t type, time_t lastMillis, Print& output)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
+
+    WriteRawColumn(type, lastMillis, output);
+}
+
+time_t ShellyClientData::GetHistoryLength() const
+{
+    // all histories have the same tiers
+    return _histories.empty() ? 0 : _histories.front().history.getLength();
+}
 
-    return result;
+void ShellyClientData::WriteHistoryBinary(RamDataType_t type, time_t lastMillis, size_t minPoints, Print& output)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    StorePending();
+
+    // Min and Max series are taken from the buckets of the measured value
+    RamDataType_t source = type;
+    switch (type) {
+    case RamDataType_t::Pro3EM_Min:
+    case RamDataType_t::Pro3EM_Max:
+        source = RamDataType_t::Pro3EM;
+        break;
+    case RamDataType_t::PlugS_Min:
+    case RamDataType_t::PlugS_Max:
+        source = RamDataType_t::PlugS;
+        break;
+    default:
+        break;
+    }
+
+    time_t now = _ramBuffer->now();
+    dataEntry_t oldest;
+    time_t rawStartTime = _ramBuffer->copyEntries(type, 0, 0, now, &oldest, 1) > 0 ? oldest.time : now;
+
+    HistoryTiers* history = FindHistory(source);
+    const HistoryTier* tier = history != nullptr ? history->selectTier(now, lastMillis, minPoints, rawStartTime) : nullptr;
+    if (tier == nullptr) {
+        WriteRawColumn(type, lastMillis, output);
+        return;
+    }
+
+    time_t startTime = now - lastMillis;
+    WriteBinaryColumn(output, type, [&](const auto& doValue) {
+        tier->forAllBuckets(startTime, [&](const historyBucket_t& bucket) {
+            switch (type) {
+            case RamDataType_t::Pro3EM_Min:
+            case RamDataType_t::PlugS_Min:
+                doValue(bucket.time, bucket.min);
+                break;
+            case RamDataType_t::Pro3EM_Max:
+            case RamDataType_t::PlugS_Max:
+                doValue(bucket.time, bucket.max);
+                break;
+            default:
+                doValue(bucket.time, bucket.mean);
+                break;
+            }
+        });
+    });
 }
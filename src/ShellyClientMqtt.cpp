@@ -7,6 +7,8 @@
 #include "Configuration.h"
 #include "MessageOutput.h"
 #include "MqttSettings.h"
+#include "ShellyClient.h"
+#include "ShellyEnergy.h"
 #include <Hoymiles.h>
 #include <cfloat>
 #include <esp32-hal.h>
@@ -57,6 +59,38 @@ void ShellyClientMqttClass::loop()
         return;
     }
 
+    if (Configuration.get().Shelly.ShellyEnable) {
+        const energyTotals_t totals = ShellyEnergy.getTotals();
+        MqttSettings.publish("shelly/energy/total/import", String(totals.importWh, 1));
+        MqttSettings.publish("shelly/energy/total/export", String(totals.exportWh, 1));
+        MqttSettings.publish("shelly/energy/total/self_consumed", String(totals.selfConsumedWh, 1));
+        MqttSettings.publish("shelly/energy/total/curtailed", String(totals.curtailedWh, 1));
+
+        const energyBucket_t today = ShellyEnergy.getOpenBucket(EnergyPeriod_t::Day);
+        MqttSettings.publish("shelly/energy/today/import", String(today.importWh, 1));
+        MqttSettings.publish("shelly/energy/today/export", String(today.exportWh, 1));
+        MqttSettings.publish("shelly/energy/today/self_consumed", String(today.selfConsumedWh, 1));
+        MqttSettings.publish("shelly/energy/today/curtailed", String(today.curtailedWh, 1));
+
+        // connection health of the devices, times in ms
+        for (uint8_t d = 0; d < SHELLY_MAX_DEVICES; d++) {
+            if (strlen(Configuration.get().Shelly.Devices[d].Hostname) == 0) {
+                continue;
+            }
+            const shellyDeviceHealth_t health = ShellyClient.GetDeviceHealth(d);
+            String topic = "shelly/device/" + String(d) + "/";
+            MqttSettings.publish(topic + "connected", String(health.connected ? 1 : 0));
+            MqttSettings.publish(topic + "frames", String(health.frames));
+            MqttSettings.publish(topic + "parse_failures", String(health.parseFailures));
+            MqttSettings.publish(topic + "reconnects", String(health.connects > 0 ? health.connects - 1 : 0));
+            if (health.hasSample) {
+                MqttSettings.publish(topic + "sample_age", String(millis() - health.lastSampleMillis));
+            }
+            MqttSettings.publish(topic + "rpc_latency", String(health.rpcLatency.count > 0 ? health.rpcLatency.sumMicros / 1000.0 / health.rpcLatency.count : 0.0, 1));
+            MqttSettings.publish(topic + "jitter", String(health.jitterMicros / 1000.0, 1));
+        }
+    }
+
 #if 0
     // TODO(shi)
     
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "ShellyEnergy.h"
+#include "Configuration.h"
+#include "MessageOutput.h"
+#include "ShellyClient.h"
+#include <LittleFS.h>
+
+ShellyEnergyClass ShellyEnergy;
+
+ShellyEnergyClass::ShellyEnergyClass()
+    : _loopTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&ShellyEnergyClass::loop, this))
+    , _shellyClientData(ShellyClient.getShellyData())
+    , _lastMillis(0)
+    , _lastWrite(0)
+    , _dirty(false)
+    , _gridStale(false)
+{
+    memset(&_store, 0, sizeof(_store));
+    _store.id = SHELLY_ENERGY_FILE_ID;
+}
+
+void ShellyEnergyClass::init(Scheduler& scheduler)
+{
+    read();
+
+    scheduler.addTask(_loopTask);
+    _loopTask.enable();
+}
+
+void ShellyEnergyClass::read()
+{
+    File f = LittleFS.open(SHELLY_ENERGY_FILENAME, "r", false);
+    if (!f) {
+        return;
+    }
+
+    energyStore_t store;
+    if (f.read(reinterpret_cast<uint8_t*>(&store), sizeof(store)) == sizeof(store) && store.id == SHELLY_ENERGY_FILE_ID
+        && store.hourFirst < SHELLY_ENERGY_HOURS && store.hourCount <= SHELLY_ENERGY_HOURS
+        && store.dayFirst < SHELLY_ENERGY_DAYS && store.dayCount <= SHELLY_ENERGY_DAYS) {
+        _store = store;
+    } else {
+        MessageOutput.printf("Invalid %s, energy counters start with 0\r\n", SHELLY_ENERGY_FILENAME);
+    }
+    f.close();
+}
+
+void ShellyEnergyClass::write()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (!_dirty) {
+        return;
+    }
+
+    File f = LittleFS.open(SHELLY_ENERGY_FILENAME, "w");
+    if (!f) {
+        MessageOutput.printf("Failed to open %s for writing\r\n", SHELLY_ENERGY_FILENAME);
+        return;
+    }
+    f.write(reinterpret_cast<const uint8_t*>(&_store), sizeof(_store));
+    f.close();
+
+    _dirty = false;
+}
+
+void ShellyEnergyClass::loop()
+{
+    unsigned long now = millis();
+    unsigned long elapsed = now - _lastMillis;
+    _lastMillis = now;
+
+    const CONFIG_T& config = Configuration.get();
+    if (!config.Shelly.ShellyEnable || elapsed > 5 * TASK_SECOND) {
+        // nothing measured or the loop was blocked -> don't extrapolate
+        return;
+    }
+
+    // the last value of a disconnected meter is not continued
+    bool gridStale = isStale(ShellyRole_t::GridMeter);
+    if (gridStale != _gridStale) {
+        _gridStale = gridStale;
+        MessageOutput.printf("ShellyEnergy: grid meter %s\r\n", gridStale ? "without values, gap in the energy balance" : "values again");
+    }
+    if (gridStale) {
+        return;
+    }
+    bool generationStale = isStale(ShellyRole_t::Generation);
+
+    float grid = _shellyClientData.GetActValue(RamDataType_t::Pro3EM); // > 0 import, < 0 export
+    float generated = _shellyClientData.GetActValue(RamDataType_t::PlugS);
+    float limit = _shellyClientData.GetActValue(RamDataType_t::Limit);
+    generated = generated > 0 ? generated : 0;
+
+    float importW = grid > 0 ? grid : 0;
+    float exportW = grid < 0 ? -grid : 0;
+    float selfConsumedW = !generationStale && generated > exportW ? generated - exportW : 0;
+
+    // The potential of the panels is unknown. If the inverter runs at its limit, up to MaxPower would be possible.
+    float curtailedW = 0;
+    if (!generationStale && config.Shelly.LimitEnable && limit > 0 && limit < config.Shelly.MaxPower && generated >= limit * 0.95f) {
+        curtailedW = config.Shelly.MaxPower - limit;
+    }
+
+    const double hours = elapsed / 3600000.0;
+
+    bool closed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        closed = closeBuckets(time(nullptr));
+
+        _store.totals.importWh += importW * hours;
+        _store.totals.exportWh += exportW * hours;
+        _store.totals.selfConsumedWh += selfConsumedW * hours;
+        _store.totals.curtailedWh += curtailedW * hours;
+
+        for (energyBucket_t* bucket : { &_store.openHour, &_store.openDay }) {
+            bucket->importWh += importW * hours;
+            bucket->exportWh += exportW * hours;
+            bucket->selfConsumedWh += selfConsumedW * hours;
+            bucket->curtailedWh += curtailedW * hours;
+        }
+        _dirty = true;
+    }
+
+    // a closed hour and every SHELLY_ENERGY_WRITE_INTERVAL, more often would wear the flash
+    if (closed || now - _lastWrite >= SHELLY_ENERGY_WRITE_INTERVAL) {
+        _lastWrite = now;
+        write();
+    }
+}
+
+bool ShellyEnergyClass::isStale(ShellyRole_t role)
+{
+    const CONFIG_T& config = Configuration.get();
+    unsigned long now = millis();
+
+    for (uint8_t d = 0; d < SHELLY_MAX_DEVICES; d++) {
+        if (strlen(config.Shelly.Devices[d].Hostname) == 0 || config.Shelly.Devices[d].Role != static_cast<uint8_t>(role)) {
+            continue;
+        }
+        shellyDeviceHealth_t health = ShellyClient.GetDeviceHealth(d);
+        if (!health.hasSample || now - health.lastSampleMillis > SHELLY_ENERGY_STALE_TIME) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShellyEnergyClass::closeBuckets(time_t now)
+{
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    if (timeinfo.tm_year < (2016 - 1900)) {
+        return false; // no time yet, the values are added to the open buckets
+    }
+
+    uint32_t hourStart = now - timeinfo.tm_min * 60 - timeinfo.tm_sec;
+
+    // the day has 23 or 25 hours at a DST change, local midnight comes from mktime
+    struct tm midnight = timeinfo;
+    midnight.tm_hour = 0;
+    midnight.tm_min = 0;
+    midnight.tm_sec = 0;
+    midnight.tm_isdst = -1;
+    uint32_t dayStart = mktime(&midnight);
+
+    bool closed = false;
+    if (_store.openHour.time != hourStart) {
+        // a bucket opened before the time was known (time 0) keeps its values, they belong to this hour
+        if (_store.openHour.time != 0) {
+            addBucket(_store.hours, SHELLY_ENERGY_HOURS, _store.hourFirst, _store.hourCount, _store.openHour);
+            closed = true;
+            memset(&_store.openHour, 0, sizeof(energyBucket_t));
+        }
+        _store.openHour.time = hourStart;
+    }
+
+    if (_store.openDay.time != dayStart) {
+        if (_store.openDay.time != 0) {
+            addBucket(_store.days, SHELLY_ENERGY_DAYS, _store.dayFirst, _store.dayCount, _store.openDay);
+            memset(&_store.openDay, 0, sizeof(energyBucket_t));
+        }
+        _store.openDay.time = dayStart;
+    }
+
+    return closed;
+}
+
+void ShellyEnergyClass::addBucket(energyBucket_t* buckets, uint16_t capacity, uint16_t& first, uint16_t& count, const energyBucket_t& bucket)
+{
+    // full -> overwrite the oldest bucket
+    if (count < capacity) {
+        buckets[(first + count) % capacity] = bucket;
+        count++;
+    } else {
+        buckets[first] = bucket;
+        first = (first + 1) % capacity;
+    }
+}
+
+energyTotals_t ShellyEnergyClass::getTotals()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _store.totals;
+}
+
+energyBucket_t ShellyEnergyClass::getOpenBucket(EnergyPeriod_t period)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return period == EnergyPeriod_t::Hour ? _store.openHour : _store.openDay;
+}
+
+void ShellyEnergyClass::forAllBuckets(EnergyPeriod_t period, const std::function<void(const energyBucket_t&)>& doBucket)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const energyBucket_t* buckets = period == EnergyPeriod_t::Hour ? _store.hours : _store.days;
+    uint16_t capacity = period == EnergyPeriod_t::Hour ? SHELLY_ENERGY_HOURS : SHELLY_ENERGY_DAYS;
+    uint16_t first = period == EnergyPeriod_t::Hour ? _store.hourFirst : _store.dayFirst;
+    uint16_t count = period == EnergyPeriod_t::Hour ? _store.hourCount : _store.dayCount;
+
+    for (uint16_t pos = 0; pos < count; pos++) {
+        doBucket(buckets[(first + pos) % capacity]);
+    }
+}
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "ShellyGraphStream.h"
+#include <TaskSchedulerDeclarations.h>
+
+static const struct {
+    RamDataType_t type;
+    const char* name;
+} GraphSeries[] = {
+    { RamDataType_t::Pro3EM, "data_pro3em" },
+    { RamDataType_t::Pro3EM_Min, "data_pro3em_min" },
+    { RamDataType_t::Pro3EM_Max, "data_pro3em_max" },
+    { RamDataType_t::PlugS, "data_plugs" },
+    { RamDataType_t::PlugS_Min, "data_plugs_min" },
+    { RamDataType_t::PlugS_Max, "data_plugs_max" },
+    { RamDataType_t::CalulatedLimit, "data_calculated_limit" },
+    { RamDataType_t::Limit, "data_limit" },
+    { RamDataType_t::Pro3EM_A, "data_pro3em_a" },
+    { RamDataType_t::Pro3EM_B, "data_pro3em_b" },
+    { RamDataType_t::Pro3EM_C, "data_pro3em_c" },
+};
+
+ShellyGraphStream::ShellyGraphStream(ShellyClientData& shellyData, const String& head, time_t lastMillis)
+    : _shellyData(shellyData)
+    , _head(head)
+    , _state(State::Head)
+    , _series(0)
+    , _lastTime(0)
+    , _lastTimeCnt(0)
+    , _firstPoint(true)
+    , _batchSize(0)
+    , _batchPos(0)
+    , _tokenPtr(_token)
+    , _tokenLen(0)
+    , _tokenPos(0)
+{
+    // the window is fixed at request time, new values are part of the next request
+    _endTime = _shellyData.Now();
+    _startTime = _endTime - lastMillis;
+}
+
+size_t ShellyGraphStream::fill(uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+
+    while (written < maxLen) {
+        if (_tokenPos == _tokenLen) {
+            if (!nextToken()) {
+                break;
+            }
+        }
+
+        size_t len = _tokenLen - _tokenPos;
+        if (len > maxLen - written) {
+            len = maxLen - written;
+        }
+        memcpy(&buffer[written], &_tokenPtr[_tokenPos], len);
+        _tokenPos += len;
+        written += len;
+    }
+
+    return written;
+}
+
+bool ShellyGraphStream::nextToken()
+{
+    _tokenPtr = _token;
+    _tokenPos = 0;
+    _tokenLen = 0;
+
+    switch (_state) {
+    case State::Head:
+        // head without the closing bracket, the series are added as additional fields
+        _tokenPtr = _head.c_str();
+        _tokenLen = _head.length() > 0 ? _head.length() - 1 : 0;
+        _state = State::SeriesStart;
+        break;
+
+    case State::SeriesStart:
+        if (_series >= sizeof(GraphSeries) / sizeof(GraphSeries[0])) {
+            _tokenLen = snprintf(_token, sizeof(_token), "}");
+            _state = State::Done;
+            break;
+        }
+        _tokenLen = snprintf(_token, sizeof(_token), ",\"%s\":[", GraphSeries[_series].name);
+        _lastTime = _startTime;
+        _lastTimeCnt = 0;
+        _batchSize = 0;
+        _batchPos = 0;
+        _firstPoint = true;
+        _state = State::Points;
+        break;
+
+    case State::Points:
+        if (!nextPoint()) {
+            _tokenLen = snprintf(_token, sizeof(_token), "]");
+            _series++;
+            _state = State::SeriesStart;
+        }
+        break;
+
+    case State::Done:
+        return false;
+    }
+
+    return true;
+}
+
+bool ShellyGraphStream::nextPoint()
+{
+    if (_batchPos == _batchSize) {
+        // continue after the last written entry, even if the ring buffer changed in between
+        _batchSize = _shellyData.GetEntries(GraphSeries[_series].type, _lastTime, _lastTimeCnt, _endTime, _batch, BATCH_SIZE);
+        _batchPos = 0;
+        if (_batchSize == 0) {
+            return false;
+        }
+    }
+
+    const dataEntry_t& entry = _batch[_batchPos++];
+    if (entry.time == _lastTime) {
+        _lastTimeCnt++;
+    } else {
+        _lastTime = entry.time;
+        _lastTimeCnt = 1;
+    }
+
+    _tokenLen = snprintf(_token, sizeof(_token), "%s{\"x\":%.3f,\"y\":%.2f}",
+        _firstPoint ? "" : ",", static_cast<float>(entry.time) / TASK_SECOND, entry.value);
+    _firstPoint = false;
+    return true;
+}
+
+ShellyBinaryStream::ShellyBinaryStream(ShellyClientData& shellyData, time_t lastMillis, time_t span, size_t minPoints)
+    : _shellyData(shellyData)
+    , _lastMillis(lastMillis)
+    , _span(span)
+    , _minPoints(minPoints)
+    , _series(0)
+    , _headerDone(false)
+    , _dataPos(0)
+{
+}
+
+size_t ShellyBinaryStream::fill(uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+
+    while (written < maxLen) {
+        if (_dataPos == _data.size()) {
+            _data.clear();
+            _dataPos = 0;
+
+            if (!_headerDone) {
+                // uint8 version, uint8 number of series, followed by the series (see ShellyClientData::WriteLastDataBinary)
+                const uint8_t header[] = { 1, sizeof(GraphSeries) / sizeof(GraphSeries[0]) };
+                write(header, sizeof(header));
+                _headerDone = true;
+            } else if (_series < sizeof(GraphSeries) / sizeof(GraphSeries[0])) {
+                RamDataType_t type = GraphSeries[_series++].type;
+                if (_span > 0) {
+                    _shellyData.WriteHistoryBinary(type, _span, _minPoints, *this);
+                } else {
+                    _shellyData.WriteLastDataBinary(type, _lastMillis, *this);
+                }
+            } else {
+                break;
+            }
+        }
+
+        size_t len = _data.size() - _dataPos;
+        if (len > maxLen - written) {
+            len = maxLen - written;
+        }
+        memcpy(&buffer[written], &_data[_dataPos], len);
+        _dataPos += len;
+        written += len;
+    }
+
+    return written;
+}
+
+size_t ShellyBinaryStream::write(uint8_t c)
+{
+    _data.push_back(c);
+    return 1;
+}
+
+size_t ShellyBinaryStream::write(const uint8_t* buffer, size_t size)
+{
+    _data.insert(_data.end(), buffer, buffer + size);
+    return size;
+}
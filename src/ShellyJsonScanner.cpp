@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "ShellyJsonScanner.h"
+#include <cstdlib>
+#include <cstring>
+
+ShellyJsonScanner::ShellyJsonScanner(const char* const* paths, size_t count)
+    : _paths(paths)
+    , _count(count < SHELLY_JSON_MAX_PATHS ? count : SHELLY_JSON_MAX_PATHS)
+{
+    reset();
+}
+
+void ShellyJsonScanner::reset()
+{
+    _found = 0;
+    _depth = 0;
+    _ignoredDepth = 0;
+    _isObject[0] = false;
+    _keyLen[0] = 0;
+    _expectKey = false;
+    _started = false;
+    _malformed = false;
+    _inString = false;
+    _isKey = false;
+    _escape = false;
+    _numberLen = 0;
+}
+
+bool ShellyJsonScanner::getValue(size_t path, double& value) const
+{
+    if (path >= _count || (_found & (1u << path)) == 0) {
+        return false;
+    }
+    value = _values[path];
+    return true;
+}
+
+bool ShellyJsonScanner::isComplete() const
+{
+    return _started && !_malformed && _depth == 0 && _ignoredDepth == 0 && !_inString;
+}
+
+void ShellyJsonScanner::feed(const char* data, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        char c = data[i];
+
+        if (_inString) {
+            if (_escape) {
+                _escape = false;
+            } else if (c == '\\') {
+                _escape = true;
+                continue;
+            } else if (c == '"') {
+                _inString = false;
+                continue;
+            }
+
+            // escaped characters are compared as written, keys of Shelly don't contain them
+            if (_isKey && _ignoredDepth == 0) {
+                uint8_t& len = _keyLen[_depth];
+                if (len < SHELLY_JSON_MAX_KEY) {
+                    _key[_depth][len] = c;
+                }
+                len = len <= SHELLY_JSON_MAX_KEY ? len + 1 : len;
+            }
+            continue;
+        }
+
+        if (_numberLen > 0) {
+            if ((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E') {
+                if (_numberLen < sizeof(_number) - 1) {
+                    _number[_numberLen++] = c;
+                }
+                continue;
+            }
+            finishNumber();
+        }
+
+        switch (c) {
+        case '{':
+        case '[':
+            _started = true;
+            if (_depth < SHELLY_JSON_MAX_DEPTH && _ignoredDepth == 0) {
+                _depth++;
+                _isObject[_depth] = c == '{';
+                _keyLen[_depth] = c == '{' ? 0 : SHELLY_JSON_MAX_KEY + 1; // array elements never match
+            } else if (_ignoredDepth < UINT8_MAX) {
+                _ignoredDepth++;
+            } else {
+                _malformed = true; // the closing brackets can't be counted anymore
+            }
+            _expectKey = c == '{';
+            break;
+        case '}':
+        case ']':
+            if (_ignoredDepth > 0) {
+                _ignoredDepth--;
+            } else if (_depth > 0) {
+                _depth--;
+            } else {
+                _malformed = true;
+            }
+            _expectKey = false;
+            break;
+        case ',':
+            _expectKey = _ignoredDepth == 0 ? _isObject[_depth] : false;
+            break;
+        case ':':
+            _expectKey = false;
+            break;
+        case '"':
+            _inString = true;
+            _isKey = _expectKey;
+            if (_isKey && _ignoredDepth == 0) {
+                _keyLen[_depth] = 0;
+            }
+            break;
+        default:
+            if ((c >= '0' && c <= '9') || c == '-') {
+                _number[0] = c;
+                _numberLen = 1;
+            }
+            // true, false, null and white space are skipped
+            break;
+        }
+    }
+}
+
+void ShellyJsonScanner::finishNumber()
+{
+    _number[_numberLen] = '\0';
+    _numberLen = 0;
+
+    if (_ignoredDepth > 0 || _depth == 0 || !_isObject[_depth]) {
+        return;
+    }
+
+    for (size_t p = 0; p < _count; p++) {
+        if (matches(_paths[p])) {
+            _values[p] = strtod(_number, nullptr);
+            _found |= 1u << p;
+        }
+    }
+}
+
+bool ShellyJsonScanner::matches(const char* path) const
+{
+    // the keys of level 1.._depth, separated by '.'
+    for (uint8_t level = 1; level <= _depth; level++) {
+        const char* end = strchr(path, '.');
+        size_t len = end != nullptr ? end - path : strlen(path);
+
+        if (_keyLen[level] > SHELLY_JSON_MAX_KEY) {
+            return false;
+        }
+        if (!(len == 1 && path[0] == '*') && (len != _keyLen[level] || memcmp(path, _key[level], len) != 0)) {
+            return false;
+        }
+
+        if (end == nullptr) {
+            return level == _depth;
+        }
+        path = end + 1;
+    }
+    return false;
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "ShellySamplePath.h"
+#include <Arduino.h>
+#include <cstring>
+
+ShellySamplePath::ShellySamplePath()
+    : _dropped(0)
+{
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        _arrival[i] = 0;
+        _arrivalPending[i] = false;
+    }
+    memset(_latency, 0, sizeof(_latency));
+}
+
+void ShellySamplePath::AddMicros(shellyLatency_t& latency, uint32_t micros)
+{
+    latency.lastMicros = micros;
+    latency.maxMicros = micros > latency.maxMicros ? micros : latency.maxMicros;
+    latency.sumMicros += micros;
+    latency.count++;
+}
+
+void ShellySamplePath::stored(const shellySample_t& sample)
+{
+    size_t index = static_cast<size_t>(sample.entry.type);
+    _arrival[index] = sample.arrivalMicros;
+    _arrivalPending[index] = true;
+    addLatency(ShellyLatencyStage_t::Queue, micros() - sample.arrivalMicros);
+}
+
+void ShellySamplePath::markUsed(RamDataType_t type)
+{
+    size_t index = static_cast<size_t>(type);
+    if (index < RAMBUFFER_TYPE_COUNT && _arrivalPending[index]) {
+        _arrivalPending[index] = false;
+        addLatency(ShellyLatencyStage_t::Control, micros() - _arrival[index]);
+    }
+}
+
+void ShellySamplePath::markSent(RamDataType_t type)
+{
+    size_t index = static_cast<size_t>(type);
+    if (index < RAMBUFFER_TYPE_COUNT && _arrival[index] != 0) {
+        addLatency(ShellyLatencyStage_t::Command, micros() - _arrival[index]);
+    }
+}
+
+void ShellySamplePath::addLatency(ShellyLatencyStage_t stage, uint32_t micros)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    AddMicros(_latency[static_cast<size_t>(stage)], micros);
+}
+
+shellyLatency_t ShellySamplePath::getLatency(ShellyLatencyStage_t stage)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _latency[static_cast<size_t>(stage)];
+}
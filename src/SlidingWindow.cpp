@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "SlidingWindow.h"
+
+SlidingWindow::SlidingWindow(time_t length)
+    : _length(length)
+    , _sum(0)
+    , _last(0)
+    , _hasLast(false)
+{
+}
+
+void SlidingWindow::add(time_t time, float value)
+{
+    _samples.push_back({ time, value });
+    _sum += value;
+    carry(value);
+
+    // monotonic queues: a new value makes all worse values in front of it useless
+    while (!_min.empty() && _min.back().value >= value) {
+        _min.pop_back();
+    }
+    _min.push_back({ time, value });
+
+    while (!_max.empty() && _max.back().value <= value) {
+        _max.pop_back();
+    }
+    _max.push_back({ time, value });
+
+    expire(time);
+}
+
+void SlidingWindow::carry(float value)
+{
+    _last = value;
+    _hasLast = true;
+}
+
+void SlidingWindow::expire(time_t now)
+{
+    time_t startTime = now - _length;
+
+    while (!_samples.empty() && _samples.front().time < startTime) {
+        _sum -= _samples.front().value;
+        _samples.pop_front();
+    }
+    while (!_min.empty() && _min.front().time < startTime) {
+        _min.pop_front();
+    }
+    while (!_max.empty() && _max.front().time < startTime) {
+        _max.pop_front();
+    }
+
+    if (_samples.empty()) {
+        _sum = 0; // no drift of rounding errors
+    }
+}
+
+float SlidingWindow::getMin() const
+{
+    return _min.empty() ? getLast() : _min.front().value;
+}
+
+float SlidingWindow::getMax() const
+{
+    return _max.empty() ? getLast() : _max.front().value;
+}
+
+float SlidingWindow::getMean() const
+{
+    return _samples.empty() ? getLast() : _sum / _samples.size();
+}
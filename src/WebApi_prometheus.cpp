@@ -7,8 +7,11 @@
 #include "Configuration.h"
 #include "MessageOutput.h"
 #include "NetworkSettings.h"
+#include "ShellyClient.h"
+#include "ShellyEnergy.h"
 #include "WebApi.h"
 #include <Hoymiles.h>
+#include <cmath>
 #include "__compiled_constants.h"
 
 void WebApiPrometheusClass::init(AsyncWebServer& server, Scheduler& scheduler)
@@ -64,6 +67,96 @@ void WebApiPrometheusClass::onPrometheusMetricsGet(AsyncWebServerRequest* reques
         stream->print("# TYPE wifi_station gauge\n");
         stream->printf("wifi_station{bssid=\"%s\"} 1\n", WiFi.BSSIDstr().c_str());
 
+        if (Configuration.get().Shelly.ShellyEnable) {
+            const energyTotals_t totals = ShellyEnergy.getTotals();
+            const energyBucket_t today = ShellyEnergy.getOpenBucket(EnergyPeriod_t::Day);
+
+            stream->print("# HELP opendtu_shelly_energy_total Energy balance of Shelly Pro3EM and PlugS in Wh\n");
+            stream->print("# TYPE opendtu_shelly_energy_total counter\n");
+            stream->printf("opendtu_shelly_energy_total{type=\"import\"} %.3f\n", totals.importWh);
+            stream->printf("opendtu_shelly_energy_total{type=\"export\"} %.3f\n", totals.exportWh);
+            stream->printf("opendtu_shelly_energy_total{type=\"self_consumed\"} %.3f\n", totals.selfConsumedWh);
+            stream->printf("opendtu_shelly_energy_total{type=\"curtailed\"} %.3f\n", totals.curtailedWh);
+
+            stream->print("# HELP opendtu_shelly_energy_today Energy balance of today in Wh\n");
+            stream->print("# TYPE opendtu_shelly_energy_today gauge\n");
+            stream->printf("opendtu_shelly_energy_today{type=\"import\"} %.3f\n", today.importWh);
+            stream->printf("opendtu_shelly_energy_today{type=\"export\"} %.3f\n", today.exportWh);
+            stream->printf("opendtu_shelly_energy_today{type=\"self_consumed\"} %.3f\n", today.selfConsumedWh);
+            stream->printf("opendtu_shelly_energy_today{type=\"curtailed\"} %.3f\n", today.curtailedWh);
+
+            static const struct {
+                const char* metric;
+                const char* help;
+                RamDataType_t types[3]; // phase A, B, C
+            } phaseMetrics[] = {
+                { "opendtu_shelly_phase_power", "Active power per phase of the Shelly Pro3EM in W",
+                    { RamDataType_t::Pro3EM_A, RamDataType_t::Pro3EM_B, RamDataType_t::Pro3EM_C } },
+                { "opendtu_shelly_phase_voltage", "Voltage per phase of the Shelly Pro3EM in V",
+                    { RamDataType_t::Pro3EM_VoltageA, RamDataType_t::Pro3EM_VoltageB, RamDataType_t::Pro3EM_VoltageC } },
+                { "opendtu_shelly_phase_current", "Current per phase of the Shelly Pro3EM in A",
+                    { RamDataType_t::Pro3EM_CurrentA, RamDataType_t::Pro3EM_CurrentB, RamDataType_t::Pro3EM_CurrentC } },
+                { "opendtu_shelly_phase_pf", "Power factor per phase of the Shelly Pro3EM",
+                    { RamDataType_t::Pro3EM_PfA, RamDataType_t::Pro3EM_PfB, RamDataType_t::Pro3EM_PfC } },
+            };
+
+            static const char* const stages[] = { "queue", "control", "command" };
+            stream->print("# HELP opendtu_shelly_latency_seconds Time from the arrival of a Shelly frame until the value is stored (queue), used by the limit control (control) or the limit command is sent (command)\n");
+            stream->print("# TYPE opendtu_shelly_latency_seconds gauge\n");
+            for (uint8_t s = 0; s < static_cast<uint8_t>(ShellyLatencyStage_t::MAX); s++) {
+                const shellyLatency_t latency = ShellyClient.GetLatency(static_cast<ShellyLatencyStage_t>(s));
+                stream->printf("opendtu_shelly_latency_seconds{stage=\"%s\",stat=\"last\"} %.6f\n", stages[s], latency.lastMicros / 1000000.0);
+                stream->printf("opendtu_shelly_latency_seconds{stage=\"%s\",stat=\"max\"} %.6f\n", stages[s], latency.maxMicros / 1000000.0);
+                stream->printf("opendtu_shelly_latency_seconds{stage=\"%s\",stat=\"avg\"} %.6f\n", stages[s],
+                    latency.count > 0 ? latency.sumMicros / 1000000.0 / latency.count : 0.0);
+            }
+
+            static const char* const transports[] = { "websocket", "http", "mqtt" };
+            shellyTransportStats_t transportStats[static_cast<size_t>(ShellyTransport_t::MAX)];
+            for (uint8_t t = 0; t < static_cast<uint8_t>(ShellyTransport_t::MAX); t++) {
+                transportStats[t] = ShellyClient.GetTransportStats(static_cast<ShellyTransport_t>(t));
+            }
+
+            stream->print("# HELP opendtu_shelly_transport_messages Messages received from the Shelly devices per transport\n");
+            stream->print("# TYPE opendtu_shelly_transport_messages counter\n");
+            for (uint8_t t = 0; t < static_cast<uint8_t>(ShellyTransport_t::MAX); t++) {
+                stream->printf("opendtu_shelly_transport_messages{transport=\"%s\"} %" PRIu32 "\n", transports[t], transportStats[t].messages);
+            }
+
+            stream->print("# HELP opendtu_shelly_transport_failures Disconnects of the websocket, failed HTTP requests or dropped MQTT messages\n");
+            stream->print("# TYPE opendtu_shelly_transport_failures counter\n");
+            for (uint8_t t = 0; t < static_cast<uint8_t>(ShellyTransport_t::MAX); t++) {
+                stream->printf("opendtu_shelly_transport_failures{transport=\"%s\"} %" PRIu32 "\n", transports[t], transportStats[t].failures);
+            }
+
+            stream->print("# HELP opendtu_shelly_transport_latency_seconds Time from a Shelly.GetStatus request until the reply is complete\n");
+            stream->print("# TYPE opendtu_shelly_transport_latency_seconds gauge\n");
+            for (uint8_t t = 0; t < static_cast<uint8_t>(ShellyTransport_t::MAX); t++) {
+                const shellyLatency_t& latency = transportStats[t].latency;
+                stream->printf("opendtu_shelly_transport_latency_seconds{transport=\"%s\",stat=\"last\"} %.6f\n", transports[t], latency.lastMicros / 1000000.0);
+                stream->printf("opendtu_shelly_transport_latency_seconds{transport=\"%s\",stat=\"max\"} %.6f\n", transports[t], latency.maxMicros / 1000000.0);
+                stream->printf("opendtu_shelly_transport_latency_seconds{transport=\"%s\",stat=\"avg\"} %.6f\n", transports[t],
+                    latency.count > 0 ? latency.sumMicros / 1000000.0 / latency.count : 0.0);
+            }
+
+            stream->print("# HELP opendtu_shelly_dropped_samples Samples lost, because the queue to the loop task was full\n");
+            stream->print("# TYPE opendtu_shelly_dropped_samples counter\n");
+            stream->printf("opendtu_shelly_dropped_samples %" PRIu32 "\n", ShellyClient.GetDroppedSamples());
+
+            ShellyClientData& shellyData = ShellyClient.getShellyData();
+            for (auto& m : phaseMetrics) {
+                stream->printf("# HELP %s %s\n", m.metric, m.help);
+                stream->printf("# TYPE %s gauge\n", m.metric);
+                for (uint8_t p = 0; p < 3; p++) {
+                    stream->printf("%s{phase=\"%c\"} %.3f\n", m.metric, 'a' + p, shellyData.GetActValue(m.types[p]));
+                }
+            }
+
+            addShellyDeviceHealth(stream);
+        }
+
+        addRadioQueue(stream);
+
         for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
             auto inv = Hoymiles.getInverterByPos(i);
 
@@ -179,3 +272,109 @@ void WebApiPrometheusClass::addPanelInfo(AsyncResponseStream* stream, const Stri
         channel,
         config->channel[channel].YieldTotalOffset);
 }
+
+static void addShellyHistogram(AsyncResponseStream* stream, const char* metric, uint8_t device, const char* host, const shellyHistogram_t& histogram)
+{
+    uint32_t cumulative = 0;
+    for (size_t b = 0; b < SHELLY_HISTOGRAM_BUCKETS; b++) {
+        cumulative += histogram.buckets[b];
+        if (b < SHELLY_HISTOGRAM_BUCKETS - 1) {
+            stream->printf("%s_bucket{device=\"%" PRIu8 "\",host=\"%s\",le=\"%g\"} %" PRIu32 "\n", metric, device, host, ShellyHistogramBounds[b] / 1000000.0, cumulative);
+        } else {
+            stream->printf("%s_bucket{device=\"%" PRIu8 "\",host=\"%s\",le=\"+Inf\"} %" PRIu32 "\n", metric, device, host, cumulative);
+        }
+    }
+    stream->printf("%s_sum{device=\"%" PRIu8 "\",host=\"%s\"} %.6f\n", metric, device, host, histogram.sumMicros / 1000000.0);
+    stream->printf("%s_count{device=\"%" PRIu8 "\",host=\"%s\"} %" PRIu32 "\n", metric, device, host, histogram.count);
+}
+
+void WebApiPrometheusClass::addShellyDeviceHealth(AsyncResponseStream* stream)
+{
+    const CONFIG_T& config = Configuration.get();
+
+    shellyDeviceHealth_t health[SHELLY_MAX_DEVICES];
+    for (uint8_t d = 0; d < SHELLY_MAX_DEVICES; d++) {
+        health[d] = ShellyClient.GetDeviceHealth(d);
+    }
+    uint32_t now = millis();
+
+    // NAN: no value yet
+    static const struct {
+        const char* metric;
+        const char* type;
+        const char* help;
+        double (*value)(const shellyDeviceHealth_t& h, uint32_t now);
+    } deviceMetrics[] = {
+        { "opendtu_shelly_device_connected", "gauge", "Websocket of the Shelly device is connected",
+            [](const shellyDeviceHealth_t& h, uint32_t) -> double { return h.connected ? 1 : 0; } },
+        { "opendtu_shelly_device_frames", "counter", "Websocket frames and fragments received",
+            [](const shellyDeviceHealth_t& h, uint32_t) -> double { return h.frames; } },
+        { "opendtu_shelly_device_messages", "counter", "Complete messages received over all transports",
+            [](const shellyDeviceHealth_t& h, uint32_t) -> double { return h.messages; } },
+        { "opendtu_shelly_device_parse_failures", "counter", "Truncated or malformed JSON messages",
+            [](const shellyDeviceHealth_t& h, uint32_t) -> double { return h.parseFailures; } },
+        { "opendtu_shelly_device_reconnects", "counter", "Websocket connections after the first one",
+            [](const shellyDeviceHealth_t& h, uint32_t) -> double { return h.connects > 0 ? h.connects - 1 : 0; } },
+        { "opendtu_shelly_device_sample_age_seconds", "gauge", "Time since the last real value",
+            [](const shellyDeviceHealth_t& h, uint32_t now) -> double { return h.hasSample ? (now - h.lastSampleMillis) / 1000.0 : NAN; } },
+        { "opendtu_shelly_device_jitter_seconds", "gauge", "Smoothed difference of consecutive sample intervals",
+            [](const shellyDeviceHealth_t& h, uint32_t) -> double { return h.jitterMicros / 1000000.0; } },
+    };
+
+    for (auto& m : deviceMetrics) {
+        stream->printf("# HELP %s %s\n", m.metric, m.help);
+        stream->printf("# TYPE %s %s\n", m.metric, m.type);
+        for (uint8_t d = 0; d < SHELLY_MAX_DEVICES; d++) {
+            const char* host = config.Shelly.Devices[d].Hostname;
+            double value = m.value(health[d], now);
+            if (strlen(host) > 0 && !std::isnan(value)) {
+                stream->printf("%s{device=\"%" PRIu8 "\",host=\"%s\"} %.10g\n", m.metric, d, host, value);
+            }
+        }
+    }
+
+    stream->print("# HELP opendtu_shelly_device_rpc_latency_seconds Shelly.GetStatus over the websocket until the reply\n");
+    stream->print("# TYPE opendtu_shelly_device_rpc_latency_seconds histogram\n");
+    for (uint8_t d = 0; d < SHELLY_MAX_DEVICES; d++) {
+        if (strlen(config.Shelly.Devices[d].Hostname) > 0) {
+            addShellyHistogram(stream, "opendtu_shelly_device_rpc_latency_seconds", d, config.Shelly.Devices[d].Hostname, health[d].rpcLatency);
+        }
+    }
+
+    stream->print("# HELP opendtu_shelly_device_sample_interval_seconds Time between two real values of the Shelly device\n");
+    stream->print("# TYPE opendtu_shelly_device_sample_interval_seconds histogram\n");
+    for (uint8_t d = 0; d < SHELLY_MAX_DEVICES; d++) {
+        if (strlen(config.Shelly.Devices[d].Hostname) > 0) {
+            addShellyHistogram(stream, "opendtu_shelly_device_sample_interval_seconds", d, config.Shelly.Devices[d].Hostname, health[d].interval);
+        }
+    }
+}
+
+void WebApiPrometheusClass::addRadioQueue(AsyncResponseStream* stream)
+{
+    const struct {
+        const char* name;
+        HoymilesRadio* radio;
+    } radios[] = {
+        { "nrf", Hoymiles.getRadioNrf() },
+        { "cmt", Hoymiles.getRadioCmt() },
+    };
+
+    stream->print("# HELP opendtu_radio_queue_depth Commands waiting in the queue of the radio\n");
+    stream->print("# TYPE opendtu_radio_queue_depth gauge\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_queue_depth{radio=\"%s\"} %" PRIu32 "\n", r.name, r.radio->getQueueSize());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_commands Queued commands replaced by a newer one, dropped as duplicate or moved ahead of the polling requests\n");
+    stream->print("# TYPE opendtu_radio_commands counter\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_commands{radio=\"%s\",type=\"replaced\"} %" PRIu32 "\n", r.name, r.radio->getCommandsReplaced());
+            stream->printf("opendtu_radio_commands{radio=\"%s\",type=\"dropped\"} %" PRIu32 "\n", r.name, r.radio->getCommandsDropped());
+            stream->printf("opendtu_radio_commands{radio=\"%s\",type=\"prioritized\"} %" PRIu32 "\n", r.name, r.radio->getCommandsPrioritized());
+        }
+    }
+}
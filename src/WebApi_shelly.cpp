@@ -4,8 +4,12 @@
  */
 #include "WebApi_shelly.h"
 #include "Configuration.h"
+#include "MessageOutput.h"
+#include "ShellyClient.h"
+#include "ShellyEnergy.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
+#include "LimitStrategy.h"
 #include "helper.h"
 #include <AsyncJson.h>
 #include <Hoymiles.h>
@@ -20,6 +24,8 @@ void WebApiShellyClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
     server.on("/api/shelly/config", HTTP_GET, std::bind(&WebApiShellyClass::onShellyAdminGet, this, _1));
     server.on("/api/shelly/config", HTTP_POST, std::bind(&WebApiShellyClass::onShellyAdminPost, this, _1));
+    server.on("/api/shelly/energy", HTTP_GET, std::bind(&WebApiShellyClass::onShellyEnergyGet, this, _1));
+    server.on("/api/shelly/status", HTTP_GET, std::bind(&WebApiShellyClass::onShellyStatusGet, this, _1));
 }
 
 void WebApiShellyClass::onShellyAdminGet(AsyncWebServerRequest* request)
@@ -33,14 +39,27 @@ void WebApiShellyClass::onShellyAdminGet(AsyncWebServerRequest* request)
     const CONFIG_T& config = Configuration.get();
 
     root["shelly_enable"] = config.Shelly.ShellyEnable;
-    root["shelly_hostname_pro3em"] = config.Shelly.Hostname_Pro3EM;
-    root["shelly_hostname_plugs"] = config.Shelly.Hostname_PlugS;
+    auto devices = root["devices"].to<JsonArray>();
+    for (uint8_t i = 0; i < SHELLY_MAX_DEVICES; i++) {
+        auto dev = devices.add<JsonObject>();
+        dev["hostname"] = config.Shelly.Devices[i].Hostname;
+        dev["role"] = config.Shelly.Devices[i].Role;
+        dev["type"] = config.Shelly.Devices[i].Type;
+        dev["json_path"] = config.Shelly.Devices[i].JsonPath;
+        dev["transport"] = config.Shelly.Devices[i].Transport;
+    }
     root["limit_enable"] = config.Shelly.LimitEnable;
     root["max_power"] = config.Shelly.MaxPower;
     root["min_power"] = config.Shelly.MinPower;
     root["target_value"] = config.Shelly.TargetValue;
     root["feed_in_level"] = config.Shelly.FeedInLevel;
     root["view_option"] = config.Shelly.ViewOption;
+    root["grid_phase"] = config.Shelly.GridPhase;
+    root["http_interval"] = config.Shelly.HttpInterval;
+    root["control_strategy"] = config.Shelly.ControlStrategy;
+    root["pi_kp"] = config.Shelly.PiKp;
+    root["pi_ki"] = config.Shelly.PiKi;
+    root["pi_kff"] = config.Shelly.PiKff;
 
     response->setLength();
     request->send(response);
@@ -78,13 +97,18 @@ void WebApiShellyClass::onShellyAdminPost(AsyncWebServerRequest* request)
     }
 
     if (!(root["shelly_enable"].is<bool>()
-            && root["shelly_hostname_pro3em"].is<String>()
-            && root["shelly_hostname_plugs"].is<String>()
+            && root["devices"].is<JsonArray>()
             && root["limit_enable"].is<bool>()
             && root["max_power"].is<uint32_t>()
             && root["min_power"].is<uint32_t>()
             && root["target_value"].is<int32_t>()
-            && root["view_option"].is<uint32_t>())) {
+            && root["view_option"].is<uint32_t>()
+            && root["grid_phase"].is<uint8_t>()
+            && root["http_interval"].is<uint32_t>()
+            && root["control_strategy"].is<uint8_t>()
+            && root["pi_kp"].is<float>()
+            && root["pi_ki"].is<float>()
+            && root["pi_kff"].is<float>())) {
         retMsg["message"] = "Values are missing!";
         retMsg["code"] = WebApiError::GenericValueMissing;
         response->setLength();
@@ -92,24 +116,101 @@ void WebApiShellyClass::onShellyAdminPost(AsyncWebServerRequest* request)
         return;
     }
 
-    if (root["shelly_enable"].as<bool>()) {
-        if (root["shelly_hostname_pro3em"].as<String>().length() > SHELLY_MAX_HOSTNAME_STRLEN) {
-            retMsg["message"] = "Shelly Pro 3EM  must maximal " STR(SHELLY_MAX_HOSTNAME_STRLEN) " characters long!";
-            retMsg["code"] = WebApiError::ShellyHostnameLength;
-            retMsg["param"]["max"] = SHELLY_MAX_HOSTNAME_STRLEN;
+    JsonArray devices = root["devices"].as<JsonArray>();
+    if (devices.size() > SHELLY_MAX_DEVICES) {
+        retMsg["message"] = "Too many Shelly devices!";
+        retMsg["code"] = WebApiError::ShellyTooManyDevices;
+        retMsg["param"]["max"] = SHELLY_MAX_DEVICES;
+        response->setLength();
+        request->send(response);
+        return;
+    }
+
+    for (JsonObject dev : devices) {
+        if (!(dev["hostname"].is<String>()
+                && dev["role"].is<uint8_t>()
+                && dev["type"].is<uint8_t>()
+                && dev["json_path"].is<String>()
+                && dev["transport"].is<uint8_t>())) {
+            retMsg["message"] = "Values are missing!";
+            retMsg["code"] = WebApiError::GenericValueMissing;
             response->setLength();
             request->send(response);
             return;
         }
-        if (root["shelly_hostname_plugs"].as<String>().length() > SHELLY_MAX_HOSTNAME_STRLEN) {
-            retMsg["message"] = "Shelly Plug S must maximal " STR(SHELLY_MAX_HOSTNAME_STRLEN) " characters long!";
+        if (dev["hostname"].as<String>().length() > SHELLY_MAX_HOSTNAME_STRLEN) {
+            retMsg["message"] = "Hostname must maximal " STR(SHELLY_MAX_HOSTNAME_STRLEN) " characters long!";
             retMsg["code"] = WebApiError::ShellyHostnameLength;
             retMsg["param"]["max"] = SHELLY_MAX_HOSTNAME_STRLEN;
             response->setLength();
             request->send(response);
             return;
         }
+        if (dev["json_path"].as<String>().length() > SHELLY_MAX_JSONPATH_STRLEN) {
+            retMsg["message"] = "JSON path must maximal " STR(SHELLY_MAX_JSONPATH_STRLEN) " characters long!";
+            retMsg["code"] = WebApiError::ShellyJsonPathLength;
+            retMsg["param"]["max"] = SHELLY_MAX_JSONPATH_STRLEN;
+            response->setLength();
+            request->send(response);
+            return;
+        }
+        // a generic device has no default path, HTTP is only the fallback of the websocket
+        if (dev["role"].as<uint8_t>() >= static_cast<uint8_t>(ShellyRole_t::MAX)
+            || (dev["transport"].as<uint8_t>() != static_cast<uint8_t>(ShellyTransport_t::WebSocket)
+                && dev["transport"].as<uint8_t>() != static_cast<uint8_t>(ShellyTransport_t::Mqtt))
+            || dev["type"].as<uint8_t>() >= static_cast<uint8_t>(ShellyDeviceType_t::MAX)
+            || (dev["type"].as<uint8_t>() == static_cast<uint8_t>(ShellyDeviceType_t::Generic)
+                && dev["hostname"].as<String>().length() > 0 && dev["json_path"].as<String>().length() == 0)) {
+            retMsg["message"] = "Invalid role, type or transport of a Shelly device!";
+            retMsg["code"] = WebApiError::ShellyDeviceInvalid;
+            response->setLength();
+            request->send(response);
+            return;
+        }
+    }
+
+    // stored also while disabled, the values are used as soon as it is enabled
+    if (root["grid_phase"].as<uint8_t>() > 3) {
+        retMsg["message"] = "The grid phase must be between 0 and 3!";
+        retMsg["code"] = WebApiError::GridPhaseInvalid;
+        retMsg["param"]["min"] = 0;
+        retMsg["param"]["max"] = 3;
+        response->setLength();
+        request->send(response);
+        return;
+    }
+    if (root["control_strategy"].as<uint8_t>() >= static_cast<uint8_t>(LimitStrategy_t::MAX)) {
+        retMsg["message"] = "Invalid control strategy!";
+        retMsg["code"] = WebApiError::ShellyControlStrategyInvalid;
+        retMsg["param"]["max"] = static_cast<uint8_t>(LimitStrategy_t::MAX) - 1;
+        response->setLength();
+        request->send(response);
+        return;
+    }
+    if (root["pi_kp"].as<float>() < 0 || root["pi_kp"].as<float>() > 10
+        || root["pi_ki"].as<float>() < 0 || root["pi_ki"].as<float>() > 10
+        || root["pi_kff"].as<float>() < 0 || root["pi_kff"].as<float>() > 2) {
+        retMsg["message"] = "The PI parameters must be between 0 and 10, the feed-forward between 0 and 2!";
+        retMsg["code"] = WebApiError::ShellyControlParameterInvalid;
+        retMsg["param"]["min"] = 0;
+        retMsg["param"]["max"] = 10;
+        response->setLength();
+        request->send(response);
+        return;
+    }
+
+    uint32_t httpInterval = root["http_interval"].as<uint32_t>();
+    if (httpInterval != 0 && (httpInterval < 200 || httpInterval > 60000)) {
+        retMsg["message"] = "The HTTP interval must be 0 or between 200 and 60000!";
+        retMsg["code"] = WebApiError::ShellyHttpIntervalInvalid;
+        retMsg["param"]["min"] = 200;
+        retMsg["param"]["max"] = 60000;
+        response->setLength();
+        request->send(response);
+        return;
+    }
 
+    if (root["shelly_enable"].as<bool>()) {
         if (root["limit_enable"].as<bool>()) {
             if (root["max_power"].as<uint32_t>() <= 0 || root["max_power"].as<uint32_t>() > 3000) {
                 retMsg["message"] = "Max power must be greater zero and less than 3000!";
@@ -146,17 +247,152 @@ void WebApiShellyClass::onShellyAdminPost(AsyncWebServerRequest* request)
         auto& config = guard.getConfig();
 
         config.Shelly.ShellyEnable = root["shelly_enable"].as<bool>();
-        strlcpy(config.Shelly.Hostname_Pro3EM, root["shelly_hostname_pro3em"].as<String>().c_str(), sizeof(config.Shelly.Hostname_Pro3EM));
-        strlcpy(config.Shelly.Hostname_PlugS, root["shelly_hostname_plugs"].as<String>().c_str(), sizeof(config.Shelly.Hostname_PlugS));
+        for (uint8_t i = 0; i < SHELLY_MAX_DEVICES; i++) {
+            // missing entries are removed
+            JsonObject dev = devices[i].as<JsonObject>();
+            strlcpy(config.Shelly.Devices[i].Hostname, dev["hostname"] | "", sizeof(config.Shelly.Devices[i].Hostname));
+            config.Shelly.Devices[i].Role = dev["role"] | 0U;
+            config.Shelly.Devices[i].Type = dev["type"] | 0U;
+            strlcpy(config.Shelly.Devices[i].JsonPath, dev["json_path"] | "", sizeof(config.Shelly.Devices[i].JsonPath));
+            config.Shelly.Devices[i].Transport = dev["transport"] | 0U;
+        }
         config.Shelly.LimitEnable = root["limit_enable"].as<bool>();
         config.Shelly.MaxPower = root["max_power"].as<uint32_t>();
         config.Shelly.MinPower = root["min_power"].as<uint32_t>();
         config.Shelly.TargetValue = root["target_value"].as<int32_t>();
         config.Shelly.FeedInLevel = root["feed_in_level"].as<uint32_t>();
         config.Shelly.ViewOption = root["view_option"].as<uint32_t>();
+        config.Shelly.GridPhase = root["grid_phase"].as<uint8_t>();
+        config.Shelly.HttpInterval = root["http_interval"].as<uint32_t>();
+        config.Shelly.ControlStrategy = root["control_strategy"].as<uint8_t>();
+        config.Shelly.PiKp = root["pi_kp"].as<float>();
+        config.Shelly.PiKi = root["pi_ki"].as<float>();
+        config.Shelly.PiKff = root["pi_kff"].as<float>();
     }
     WebApi.writeConfig(retMsg);
 
     response->setLength();
     request->send(response);
 }
+
+static void addEnergyBucket(JsonObject obj, const energyBucket_t& bucket)
+{
+    obj["time"] = bucket.time;
+    obj["import"] = bucket.importWh;
+    obj["export"] = bucket.exportWh;
+    obj["self_consumed"] = bucket.selfConsumedWh;
+    obj["curtailed"] = bucket.curtailedWh;
+}
+
+void WebApiShellyClass::onShellyEnergyGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    try {
+        AsyncJsonResponse* response = new AsyncJsonResponse();
+        auto& root = response->getRoot();
+
+        // all values in Wh
+        const energyTotals_t totals = ShellyEnergy.getTotals();
+        root["total"]["import"] = totals.importWh;
+        root["total"]["export"] = totals.exportWh;
+        root["total"]["self_consumed"] = totals.selfConsumedWh;
+        root["total"]["curtailed"] = totals.curtailedWh;
+
+        addEnergyBucket(root["hour"].to<JsonObject>(), ShellyEnergy.getOpenBucket(EnergyPeriod_t::Hour));
+        addEnergyBucket(root["today"].to<JsonObject>(), ShellyEnergy.getOpenBucket(EnergyPeriod_t::Day));
+
+        JsonArray hours = root["hours"].to<JsonArray>();
+        ShellyEnergy.forAllBuckets(EnergyPeriod_t::Hour, [&](const energyBucket_t& bucket) {
+            addEnergyBucket(hours.add<JsonObject>(), bucket);
+        });
+
+        JsonArray days = root["days"].to<JsonArray>();
+        ShellyEnergy.forAllBuckets(EnergyPeriod_t::Day, [&](const energyBucket_t& bucket) {
+            addEnergyBucket(days.add<JsonObject>(), bucket);
+        });
+
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+
+    } catch (std::bad_alloc& bad_alloc) {
+        MessageOutput.printf("Call to /api/shelly/energy temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
+
+        WebApi.sendTooManyRequests(request);
+    }
+}
+
+static void addHistogram(JsonObject obj, const shellyHistogram_t& histogram)
+{
+    // in ms, the buckets are not cumulative, the last one is +Inf
+    obj["count"] = histogram.count;
+    obj["avg"] = histogram.count > 0 ? histogram.sumMicros / 1000.0 / histogram.count : 0.0;
+    JsonArray buckets = obj["buckets"].to<JsonArray>();
+    for (size_t b = 0; b < SHELLY_HISTOGRAM_BUCKETS; b++) {
+        buckets.add(histogram.buckets[b]);
+    }
+}
+
+static void addTransport(JsonObject obj, const shellyTransportStats_t& stats)
+{
+    obj["messages"] = stats.messages;
+    obj["failures"] = stats.failures;
+    obj["latency_last"] = stats.latency.lastMicros / 1000.0;
+    obj["latency_max"] = stats.latency.maxMicros / 1000.0;
+    obj["latency_avg"] = stats.latency.count > 0 ? stats.latency.sumMicros / 1000.0 / stats.latency.count : 0.0;
+}
+
+void WebApiShellyClass::onShellyStatusGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    try {
+        AsyncJsonResponse* response = new AsyncJsonResponse();
+        auto& root = response->getRoot();
+        const CONFIG_T& config = Configuration.get();
+        uint32_t now = millis();
+
+        // all times in ms
+        JsonArray bounds = root["histogram_bounds"].to<JsonArray>();
+        for (auto bound : ShellyHistogramBounds) {
+            bounds.add(bound / 1000.0);
+        }
+
+        JsonArray devices = root["devices"].to<JsonArray>();
+        for (uint8_t d = 0; d < SHELLY_MAX_DEVICES; d++) {
+            if (strlen(config.Shelly.Devices[d].Hostname) == 0) {
+                continue;
+            }
+            const shellyDeviceHealth_t health = ShellyClient.GetDeviceHealth(d);
+            auto dev = devices.add<JsonObject>();
+            dev["index"] = d;
+            dev["hostname"] = config.Shelly.Devices[d].Hostname;
+            dev["connected"] = health.connected;
+            dev["frames"] = health.frames;
+            dev["messages"] = health.messages;
+            dev["parse_failures"] = health.parseFailures;
+            dev["reconnects"] = health.connects > 0 ? health.connects - 1 : 0;
+            if (health.hasSample) {
+                dev["sample_age"] = now - health.lastSampleMillis;
+            }
+            dev["jitter"] = health.jitterMicros / 1000.0;
+            addHistogram(dev["rpc_latency"].to<JsonObject>(), health.rpcLatency);
+            addHistogram(dev["interval"].to<JsonObject>(), health.interval);
+        }
+
+        addTransport(root["transport"]["websocket"].to<JsonObject>(), ShellyClient.GetTransportStats(ShellyTransport_t::WebSocket));
+        addTransport(root["transport"]["http"].to<JsonObject>(), ShellyClient.GetTransportStats(ShellyTransport_t::Http));
+        addTransport(root["transport"]["mqtt"].to<JsonObject>(), ShellyClient.GetTransportStats(ShellyTransport_t::Mqtt));
+        root["dropped_samples"] = ShellyClient.GetDroppedSamples();
+
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+
+    } catch (std::bad_alloc& bad_alloc) {
+        MessageOutput.printf("Call to /api/shelly/status temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
+
+        WebApi.sendTooManyRequests(request);
+    }
+}
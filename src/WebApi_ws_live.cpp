@@ -6,6 +6,7 @@
 #include "Datastore.h"
 #include "MessageOutput.h"
 #include "ShellyClient.h"
+#include "ShellyGraphStream.h"
 #include "SunPosition.h"
 #include "Utils.h"
 #include "WebApi.h"
@@ -16,6 +17,9 @@
 #define PIN_MAPPING_REQUIRED 0
 #endif
 
+// minimum number of points of a history graph, the coarsest history tier with enough buckets is used
+#define GRAPH_MIN_POINTS 120
+
 WebApiWsLiveClass::WebApiWsLiveClass()
     : _ws("/livedata")
     , _lastPublishShelly(0)
@@ -35,6 +39,7 @@ void WebApiWsLiveClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
     server.on("/api/livedata/status", HTTP_GET, std::bind(&WebApiWsLiveClass::onLivedataStatus, this, _1));
     server.on("/api/livedata/graph", HTTP_GET, std::bind(&WebApiWsLiveClass::onGraphUpdate, this, _1));
+    server.on("/api/livedata/graph_bin", HTTP_GET, std::bind(&WebApiWsLiveClass::onGraphBinary, this, _1));
 
     server.addHandler(&_ws);
     _ws.onEvent(std::bind(&WebApiWsLiveClass::onWebsocketEvent, this, _1, _2, _3, _4, _5, _6));
@@ -44,6 +49,9 @@ void WebApiWsLiveClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
     scheduler.addTask(_sendDataTask);
     _sendDataTask.enable();
+
+    ShellyClient.getShellyData().RegisterWindow(RamDataType_t::Pro3EM, 5000);
+    ShellyClient.getShellyData().RegisterWindow(RamDataType_t::PlugS, 5000);
     _simpleDigestAuth.setUsername(AUTH_USERNAME);
     _simpleDigestAuth.setRealm("live websocket");
 
@@ -397,6 +405,22 @@ void WebApiWsLiveClass::generateDiagramJsonResponse(JsonVariant& root, String na
             color = "#00aa00";
             break;
 
+        case RamDataType_t::Pro3EM_A:
+            name = "data_pro3em_a";
+            label = "L1";
+            color = "#a0522d";
+            break;
+        case RamDataType_t::Pro3EM_B:
+            name = "data_pro3em_b";
+            label = "L2";
+            color = "#000000";
+            break;
+        case RamDataType_t::Pro3EM_C:
+            name = "data_pro3em_c";
+            label = "L3";
+            color = "#808080";
+            break;
+
         default:
             break;
         };
@@ -407,6 +431,21 @@ void WebApiWsLiveClass::generateDiagramJsonResponse(JsonVariant& root, String na
     }
 }
 
+uint32_t WebApiWsLiveClass::getGraphInterval(AsyncWebServerRequest* request, long long& timestamp)
+{
+    uint32_t interval = 2 * TASK_SECOND;
+
+    if (request->hasParam("timestamp")) {
+        String s = request->getParam("timestamp")->value();
+
+        timestamp = strtoll(s.c_str(), NULL, 10);
+        if (timestamp == 0) {
+            interval = 60 * TASK_SECOND;
+        }
+    }
+    return interval;
+}
+
 void WebApiWsLiveClass::onGraphUpdate(AsyncWebServerRequest* request)
 {
     if (!WebApi.checkCredentialsReadonly(request)) {
@@ -416,12 +455,15 @@ void WebApiWsLiveClass::onGraphUpdate(AsyncWebServerRequest* request)
     try {
         std::lock_guard<std::mutex> lock(_mutex);
 
-        AsyncJsonResponse* response = new AsyncJsonResponse();
-        auto& root = response->getRoot();
+        JsonDocument doc;
+        JsonVariant root = doc;
 
         const CONFIG_T& config = Configuration.get();
         ShellyClientData& shellyData = ShellyClient.getShellyData();
 
+        uint32_t interval = 0;
+        bool withData = false;
+
         ShellyViewOptions viewOptions = static_cast<ShellyViewOptions>(config.Shelly.ViewOption);
         if (viewOptions >= ShellyViewOptions::SimpleInfo) {
             root["view_option"] = config.Shelly.ViewOption;
@@ -429,36 +471,18 @@ void WebApiWsLiveClass::onGraphUpdate(AsyncWebServerRequest* request)
             generateShellyCardJsonResponse(root, viewOptions);
 
             long long timestamp = 0;
-            uint32_t interval = 2 * TASK_SECOND;
-
-            if (request->hasParam("timestamp")) {
-                String s = request->getParam("timestamp")->value();
-
-                timestamp = strtoll(s.c_str(), NULL, 10);
-                if (timestamp == 0) {
-                    interval = 60 * TASK_SECOND;
-                }
-            }
+            interval = getGraphInterval(request, timestamp);
 
             root["timestamp"] = timestamp + interval;
             root["interval"] = interval;
 
             if (viewOptions >= ShellyViewOptions::DiagramInfo) {
-                String data;
-
-                root["data_pro3em"] = shellyData.GetLastData(RamDataType_t::Pro3EM, interval, data);
-                root["data_pro3em_min"] = shellyData.GetLastData(RamDataType_t::Pro3EM_Min, interval, data);
-                root["data_pro3em_max"] = shellyData.GetLastData(RamDataType_t::Pro3EM_Max, interval, data);
+                // data=0: the series are fetched from /api/livedata/graph_bin
+                withData = !request->hasParam("data") || request->getParam("data")->value() != "0";
 
-                root["data_plugs"] = shellyData.GetLastData(RamDataType_t::PlugS, interval, data);
-                root["data_plugs_min"] = shellyData.GetLastData(RamDataType_t::PlugS_Min, interval, data);
-                root["data_plugs_max"] = shellyData.GetLastData(RamDataType_t::PlugS_Max, interval, data);
-
-                root["data_calculated_limit"] = shellyData.GetLastData(RamDataType_t::CalulatedLimit, interval, data);
-                root["data_limit"] = shellyData.GetLastData(RamDataType_t::Limit, interval, data);
-
-                const RamDataType_t a[] = { RamDataType_t::Pro3EM, RamDataType_t::Pro3EM_Min, RamDataType_t::Pro3EM_Max };
-                generateDiagramJsonResponse(root, "diagram_pro3em", a, 3);
+                const RamDataType_t a[] = { RamDataType_t::Pro3EM, RamDataType_t::Pro3EM_Min, RamDataType_t::Pro3EM_Max,
+                    RamDataType_t::Pro3EM_A, RamDataType_t::Pro3EM_B, RamDataType_t::Pro3EM_C };
+                generateDiagramJsonResponse(root, "diagram_pro3em", a, 6);
 
                 const RamDataType_t b[] = { RamDataType_t::PlugS, RamDataType_t::PlugS_Min, RamDataType_t::PlugS_Max };
                 generateDiagramJsonResponse(root, "diagram_plugs", b, 3);
@@ -471,7 +495,28 @@ void WebApiWsLiveClass::onGraphUpdate(AsyncWebServerRequest* request)
             }
         }
 
-        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+            WebApi.sendTooManyRequests(request);
+            return;
+        }
+
+        if (!withData) {
+            AsyncJsonResponse* response = new AsyncJsonResponse();
+            response->getRoot().set(doc);
+            WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return;
+        }
+
+        // The data series are written directly from the RamBuffer into the send buffer
+        String head;
+        serializeJson(doc, head);
+        auto stream = std::make_shared<ShellyGraphStream>(shellyData, head, interval);
+
+        AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+            [stream](uint8_t* buffer, size_t maxLen, size_t /*index*/) -> size_t {
+                return stream->fill(buffer, maxLen);
+            });
+        request->send(response);
     } catch (const std::bad_alloc& bad_alloc) {
         MessageOutput.printf("Call to /api/livedata/graph temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
         WebApi.sendTooManyRequests(request);
@@ -480,3 +525,55 @@ void WebApiWsLiveClass::onGraphUpdate(AsyncWebServerRequest* request)
         WebApi.sendTooManyRequests(request);
     }
 }
+
+void WebApiWsLiveClass::onGraphBinary(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    try {
+        const CONFIG_T& config = Configuration.get();
+        if (static_cast<ShellyViewOptions>(config.Shelly.ViewOption) < ShellyViewOptions::DiagramInfo) {
+            request->send(204);
+            return;
+        }
+
+        ShellyClientData& shellyData = ShellyClient.getShellyData();
+
+        long long timestamp = 0;
+        uint32_t interval = getGraphInterval(request, timestamp);
+
+        // span [s]: history of the last span seconds, long spans are downsampled
+        time_t span = 0;
+        if (request->hasParam("span")) {
+            const String& value = request->getParam("span")->value();
+            char* end = nullptr;
+            unsigned long seconds = strtoul(value.c_str(), &end, 10);
+            if (value.isEmpty() || *end != '\0' || value[0] == '-') {
+                request->send(400, "text/plain", "span invalid");
+                return;
+            }
+
+            const unsigned long maxSeconds = shellyData.GetHistoryLength() / TASK_SECOND;
+            seconds = seconds < 1 ? 1 : seconds;
+            seconds = seconds > maxSeconds ? maxSeconds : seconds;
+            span = static_cast<time_t>(seconds) * TASK_SECOND;
+        }
+
+        // The series are written one by one from the RamBuffer into the send buffer
+        auto stream = std::make_shared<ShellyBinaryStream>(shellyData, interval, span, GRAPH_MIN_POINTS);
+
+        AsyncWebServerResponse* response = request->beginChunkedResponse("application/octet-stream",
+            [stream](uint8_t* buffer, size_t maxLen, size_t /*index*/) -> size_t {
+                return stream->fill(buffer, maxLen);
+            });
+        request->send(response);
+    } catch (const std::bad_alloc& bad_alloc) {
+        MessageOutput.printf("Call to /api/livedata/graph_bin temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
+        WebApi.sendTooManyRequests(request);
+    } catch (const std::exception& exc) {
+        MessageOutput.printf("Unknown exception in /api/livedata/graph_bin. Reason: \"%s\".\r\n", exc.what());
+        WebApi.sendTooManyRequests(request);
+    }
+}
@@ -21,6 +21,7 @@
 #include "RestartHelper.h"
 #include "Scheduler.h"
 #include "ShellyClient.h"
+#include "ShellyEnergy.h"
 #include "SunPosition.h"
 #include "Utils.h"
 #include "WebApi.h"
@@ -154,6 +155,7 @@ void setup()
     MessageOutput.print("Initialize Shelly... ");
     ShellyClient.init(scheduler);
     LimitControl.init(scheduler);
+    ShellyEnergy.init(scheduler);
     ShellyClientMqtt.init(scheduler);
     MessageOutput.println("done");
     InverterSettings.init(scheduler);
@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// Host replacement of the Arduino core for the native tests.
+// millis() only advances, when a test sets NativeMillis, micros() is the steady clock of the host.
+#include "Print.h"
+#include "Stream.h"
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstring>
+#include <math.h> // like the Arduino core
+
+extern std::atomic<unsigned long> NativeMillis; // set by the loop thread of the stress tests
+
+class String;
+
+inline unsigned long millis() { return NativeMillis; }
+unsigned long micros();
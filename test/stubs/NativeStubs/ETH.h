@@ -0,0 +1,4 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// PinMapping.h only needs the EMAC types with CONFIG_ETH_USE_ESP32_EMAC
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+#include "Configuration.h"
+#include "MessageOutput.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <esp_rom_crc.h>
+
+std::atomic<unsigned long> NativeMillis(0);
+
+unsigned long micros()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the defaults of a new configuration are zero
+ConfigurationClass Configuration;
+static CONFIG_T NativeConfig;
+
+CONFIG_T const& ConfigurationClass::get()
+{
+    return NativeConfig;
+}
+
+size_t Print::printf(const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    return write(reinterpret_cast<const uint8_t*>(buffer), std::min<size_t>(len, sizeof(buffer) - 1));
+}
+
+MessageOutputClass MessageOutput;
+
+MessageOutputClass::MessageOutputClass()
+{
+}
+
+size_t MessageOutputClass::write(uint8_t c)
+{
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t MessageOutputClass::write(const uint8_t* buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stdout);
+}
+
+// CRC-32 (IEEE 802.3), like the ROM of the ESP32
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// Only the declarations of MessageOutput, the native tests don't run tasks
+#define TASK_SECOND 1000UL
+#define TASK_MINUTE 60000UL
+
+class Task {
+};
+
+class Scheduler {
+};
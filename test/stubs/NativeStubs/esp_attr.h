@@ -0,0 +1,6 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// the host has no memory which survives a reset
+#define __NOINIT_ATTR
+#define EXT_RAM_NOINIT_ATTR
@@ -0,0 +1,329 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// CompressedRamBuffer: bit exact round trip of random and meter like traces, paging and
+// Restore() after a reset. The benchmark reports how many more entries fit into the memory
+// of a RamBuffer and the decode throughput of both.
+
+#include "CompressedRamBuffer.h"
+#include "RamBuffer.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <unity.h>
+#include <vector>
+
+#define TEST_CAPACITY 180 // uncompressed entries per type, like Pro3EM
+#define BENCHMARK_SAMPLES 20000
+#define BENCHMARK_ROUNDS 200
+
+struct traceSample_t {
+    time_t time;
+    float value;
+};
+
+static void testCapacities(uint16_t (&caps)[RAMBUFFER_TYPE_COUNT])
+{
+    for (auto& capacity : caps) {
+        capacity = 8;
+    }
+    caps[static_cast<size_t>(RamDataType_t::Pro3EM)] = TEST_CAPACITY;
+    caps[static_cast<size_t>(RamDataType_t::PlugS)] = TEST_CAPACITY;
+}
+
+static bool sameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// grid power of a Pro3EM: a notification about once a second, 0.1 W resolution,
+// load steps and noise, sometimes no change for a while
+static std::vector<traceSample_t> meterTrace(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::normal_distribution<float> noise(0, 15);
+    std::vector<traceSample_t> trace;
+    time_t time = 1000;
+    float base = 250;
+    float value = base;
+    for (size_t i = 0; i < count; i++) {
+        time += 1000 + static_cast<int>(random() % 61) - 30;
+        if (random() % 60 == 0) {
+            base = std::uniform_real_distribution<float>(-600, 2500)(random);
+        }
+        if (random() % 5 != 0) {
+            value = std::round((base + noise(random)) * 10) / 10;
+        }
+        trace.push_back({ time, value });
+    }
+    return trace;
+}
+
+// output of a plug: 0 W over night, whole watts during the day
+static std::vector<traceSample_t> plugTrace(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::vector<traceSample_t> trace;
+    time_t time = 1000;
+    for (size_t i = 0; i < count; i++) {
+        time += 1000;
+        float value = (i / 500) % 2 == 0 ? 0.0f : std::round(300 + 100 * std::sin(i / 50.0f) + random() % 5);
+        trace.push_back({ time, value });
+    }
+    return trace;
+}
+
+// any bit patterns, equal times, irregular and very long gaps
+static std::vector<traceSample_t> randomTrace(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::vector<traceSample_t> trace;
+    time_t time = 0;
+    float value = 0;
+    for (size_t i = 0; i < count; i++) {
+        switch (random() % 6) {
+        case 0:
+            break; // same time
+        case 1:
+            time += random() % 100000;
+            break;
+        case 2:
+            time += 1000 + static_cast<int>(random() % 600) - 300;
+            break;
+        default:
+            time += 1000;
+            break;
+        }
+        switch (random() % 5) {
+        case 0: {
+            uint32_t bits = random();
+            memcpy(&value, &bits, sizeof(value)); // also NaN and infinity
+            break;
+        }
+        case 1:
+            value = -value;
+            break;
+        case 2:
+            break; // unchanged
+        default:
+            value = std::uniform_real_distribution<float>(-5000, 5000)(random);
+            break;
+        }
+        trace.push_back({ time, value });
+    }
+    return trace;
+}
+
+// the buffer keeps a suffix of the trace, bit exact
+static size_t checkSuffix(CompressedRamBuffer& buffer, RamDataType_t type, const std::vector<traceSample_t>& trace)
+{
+    NativeMillis = trace.back().time;
+    std::vector<dataEntry_t> kept;
+    for (auto& entry : buffer.entries(type, NativeMillis + 1)) {
+        kept.push_back(entry);
+    }
+
+    TEST_ASSERT_TRUE(!kept.empty() && kept.size() <= trace.size());
+    size_t offset = trace.size() - kept.size();
+    for (size_t i = 0; i < kept.size(); i++) {
+        TEST_ASSERT_TRUE(kept[i].type == type);
+        TEST_ASSERT_EQUAL(trace[offset + i].time, kept[i].time);
+        TEST_ASSERT_TRUE(sameBits(trace[offset + i].value, kept[i].value));
+    }
+
+    dataEntry_t* last = buffer.getLastEntry(type);
+    TEST_ASSERT_NOT_NULL(last);
+    TEST_ASSERT_EQUAL(trace.back().time, last->time);
+    TEST_ASSERT_TRUE(sameBits(trace.back().value, last->value));
+    return kept.size();
+}
+
+static void test_round_trip()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    testCapacities(caps);
+    std::vector<uint8_t> memory(CompressedRamBuffer::requiredSize(caps));
+    CompressedRamBuffer buffer(memory.data(), memory.size(), caps);
+
+    for (unsigned seed = 0; seed < 20; seed++) {
+        buffer.PowerOnInitialize();
+        TEST_ASSERT_TRUE(buffer.getLastEntry(RamDataType_t::Pro3EM) == nullptr);
+
+        // few, some blocks and many times the capacity
+        for (size_t count : { 1, 50, 3000 }) {
+            auto random = randomTrace(count, seed);
+            auto meter = meterTrace(count, seed);
+            buffer.PowerOnInitialize();
+            for (size_t i = 0; i < count; i++) {
+                buffer.writeValue(RamDataType_t::Pro3EM, meter[i].time, meter[i].value);
+                buffer.writeValue(RamDataType_t::PlugS, random[i].time, random[i].value);
+            }
+            size_t keptMeter = checkSuffix(buffer, RamDataType_t::Pro3EM, meter);
+            size_t keptRandom = checkSuffix(buffer, RamDataType_t::PlugS, random);
+
+            // a meter trace compresses well, random bits not at all
+            if (count > TEST_CAPACITY) {
+                TEST_ASSERT_GREATER_THAN(TEST_CAPACITY, keptMeter);
+                TEST_ASSERT_GREATER_THAN(TEST_CAPACITY / 4, keptRandom);
+            }
+        }
+    }
+}
+
+static void test_paging()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    testCapacities(caps);
+    std::vector<uint8_t> memory(CompressedRamBuffer::requiredSize(caps));
+    CompressedRamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+
+    auto trace = meterTrace(2000, 7);
+    for (auto& s : trace) {
+        buffer.writeValue(RamDataType_t::Pro3EM, s.time, s.value);
+    }
+    NativeMillis = trace.back().time;
+
+    // like the graph API: pages of 50 entries between two times, which don't start at a block
+    std::vector<dataEntry_t> all;
+    for (auto& entry : buffer.entries(RamDataType_t::Pro3EM, NativeMillis + 1)) {
+        all.push_back(entry);
+    }
+    time_t startTime = all[all.size() / 3].time - 1;
+    time_t endTime = all[all.size() * 2 / 3].time + 1;
+
+    std::vector<dataEntry_t> paged;
+    dataEntry_t page[50];
+    for (size_t skip = 0;; skip += 50) {
+        size_t count = buffer.copyEntries(RamDataType_t::Pro3EM, startTime, skip, endTime, page, 50);
+        paged.insert(paged.end(), page, page + count);
+        if (count < 50) {
+            break;
+        }
+    }
+
+    std::vector<dataEntry_t> expected;
+    for (auto& e : all) {
+        if (e.time >= startTime && e.time <= endTime) {
+            expected.push_back(e);
+        }
+    }
+    TEST_ASSERT_EQUAL(expected.size(), paged.size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), paged.data(), expected.size() * sizeof(dataEntry_t));
+
+    // entries(lastMillis) starts within a block
+    size_t count = 0;
+    for (auto& entry : buffer.entries(RamDataType_t::Pro3EM, NativeMillis - startTime)) {
+        TEST_ASSERT_GREATER_OR_EQUAL(startTime, entry.time);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(all.size() - all.size() / 3, count);
+}
+
+static void test_restore_after_reset()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    testCapacities(caps);
+    std::vector<uint8_t> memory(CompressedRamBuffer::requiredSize(caps));
+    auto trace = meterTrace(1000, 9);
+    {
+        CompressedRamBuffer buffer(memory.data(), memory.size(), caps);
+        buffer.PowerOnInitialize();
+        for (size_t i = 0; i < 900; i++) {
+            buffer.writeValue(RamDataType_t::Pro3EM, trace[i].time, trace[i].value);
+        }
+    }
+
+    // reset: a new buffer over the same memory, the open block is continued
+    NativeMillis = 0;
+    CompressedRamBuffer restored(memory.data(), memory.size(), caps);
+    TEST_ASSERT_TRUE(restored.Restore());
+    TEST_ASSERT_EQUAL(trace[899].time + 1, restored.now());
+    for (size_t i = 900; i < trace.size(); i++) {
+        restored.writeValue(RamDataType_t::Pro3EM, trace[i].time, trace[i].value);
+    }
+    checkSuffix(restored, RamDataType_t::Pro3EM, trace);
+
+    // a changed header byte or a RamBuffer in the same memory
+    memory[sizeof(uint32_t) * 2 + 3] ^= 0x10;
+    TEST_ASSERT_FALSE(CompressedRamBuffer(memory.data(), memory.size(), caps).Restore());
+    RamBuffer plain(memory.data(), memory.size(), caps);
+    plain.PowerOnInitialize();
+    TEST_ASSERT_FALSE(CompressedRamBuffer(memory.data(), memory.size(), caps).Restore());
+}
+
+////////////////////////
+
+template <typename Buffer>
+static double decodeRate(Buffer& buffer, size_t& entries)
+{
+    volatile float sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+        entries = 0;
+        for (auto& entry : buffer.entries(RamDataType_t::Pro3EM, NativeMillis + 1)) {
+            sink = sink + entry.value;
+            entries++;
+        }
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    return entries * BENCHMARK_ROUNDS / seconds.count();
+}
+
+static void benchmark(const char* name, const std::vector<traceSample_t>& trace)
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    testCapacities(caps);
+
+    std::vector<uint8_t> plainMemory(RamBuffer::requiredSize(caps));
+    RamBuffer plain(plainMemory.data(), plainMemory.size(), caps);
+    plain.PowerOnInitialize();
+    std::vector<uint8_t> compressedMemory(CompressedRamBuffer::requiredSize(caps));
+    CompressedRamBuffer compressed(compressedMemory.data(), compressedMemory.size(), caps);
+    compressed.PowerOnInitialize();
+
+    for (auto& s : trace) {
+        plain.writeValue(RamDataType_t::Pro3EM, s.time, s.value);
+        compressed.writeValue(RamDataType_t::Pro3EM, s.time, s.value);
+    }
+    NativeMillis = trace.back().time;
+
+    size_t plainEntries, compressedEntries;
+    double plainRate = decodeRate(plain, plainEntries);
+    double compressedRate = decodeRate(compressed, compressedEntries);
+
+    char message[160];
+    snprintf(message, sizeof(message), "%s: %zu entries in %zu bytes (RamBuffer %zu), ratio %.1f, decode %.1f M entries/s (RamBuffer %.1f M)",
+        name, compressedEntries, CompressedRamBuffer::blocksFor(TEST_CAPACITY) * sizeof(compressedBlock_t), plainEntries,
+        static_cast<double>(compressedEntries) / plainEntries, compressedRate / 1e6, plainRate / 1e6);
+    TEST_MESSAGE(message);
+}
+
+static void test_benchmark()
+{
+    benchmark("Pro3EM", meterTrace(BENCHMARK_SAMPLES, 11));
+    benchmark("PlugS", plugTrace(BENCHMARK_SAMPLES, 11));
+}
+
+void setUp()
+{
+    NativeMillis = 0;
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_paging);
+    RUN_TEST(test_restore_after_reset);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// Fuzz tests of the JSON scanner: random fragments give the same values as whole frames,
+// mutated frames never read or write out of bounds (run with the sanitizers of env:native)
+// and a reset always starts clean. The benchmark compares the throughput on Pro3EM
+// frames with the former strstr/atof extraction.
+
+#include "ShellyJsonPaths.h"
+#include "ShellyJsonScanner.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unity.h>
+
+#define FUZZ_ITERATIONS 20000
+#define BENCHMARK_FRAMES 20000
+
+static const char Pro3EMStatus[] = R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100064.20,)"
+                                   R"("em:0":{"id":0,"a_act_power":512.6,"a_aprt_power":530.1,"a_current":2.291,"a_pf":0.97,)"
+                                   R"("total_act_power":739.5,"total_aprt_power":829.2,"total_current":3.578}}})";
+
+static const char Pro3EMFullStatus[] = R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyFullStatus","params":{"ts":1718100065.00,)"
+                                       R"("em:0":{"id":0,"a_current":2.301,"a_voltage":231.8,"a_act_power":514.0,"a_aprt_power":532.4,"a_pf":0.97,"a_freq":50.0,)"
+                                       R"("b_current":0.468,"b_voltage":231.2,"b_act_power":75.2,"b_aprt_power":108.2,"b_pf":0.69,"b_freq":50.0,)"
+                                       R"("c_current":0.861,"c_voltage":232.7,"c_act_power":152.0,"c_aprt_power":200.4,"c_pf":0.76,"c_freq":50.0,)"
+                                       R"("n_current":null,"total_current":3.630,"total_act_power":741.2,"total_aprt_power":841.0,"user_calibrated_phase":[]},)"
+                                       R"("emdata:0":{"id":0,"a_total_act_energy":1523456.12,"a_total_act_ret_energy":845124.02,"b_total_act_energy":985412.31,)"
+                                       R"("b_total_act_ret_energy":12.5,"c_total_act_energy":1245789.02,"c_total_act_ret_energy":5.1,"total_act":3754660.11,"total_act_ret":845141.62},)"
+                                       R"("sys":{"mac":"08F9E0E5A1B4","uptime":86417,"ram_size":247104,"ram_free":113200,"fs_size":524288,"fs_free":188416},)"
+                                       R"("temperature:0":{"id":0,"tC":41.9,"tF":107.3},"wifi":{"sta_ip":"192.168.1.52","status":"got ip","ssid":"home","rssi":-61}}})";
+
+static const char* const* pro3emPaths()
+{
+    static const char* paths[static_cast<size_t>(ShellyPath_t::MAX)];
+    for (size_t i = 0; i < static_cast<size_t>(ShellyPath_t::MAX); i++) {
+        paths[i] = ShellyJsonPaths[i];
+    }
+    paths[static_cast<size_t>(ShellyPath_t::Value)] = ShellyDefaultValuePaths[static_cast<size_t>(ShellyDeviceType_t::Pro3EM)];
+    return paths;
+}
+
+static const size_t PathCount = static_cast<size_t>(ShellyPath_t::MAX);
+
+static bool sameValues(const ShellyJsonScanner& a, const ShellyJsonScanner& b)
+{
+    for (size_t p = 0; p < PathCount; p++) {
+        double va, vb;
+        bool fa = a.getValue(p, va);
+        bool fb = b.getValue(p, vb);
+        if (fa != fb || (fa && !(va == vb || (std::isnan(va) && std::isnan(vb))))) {
+            return false;
+        }
+    }
+    return a.isComplete() == b.isComplete();
+}
+
+static void feedRandomFragments(ShellyJsonScanner& scanner, const std::string& frame, std::mt19937& random)
+{
+    size_t pos = 0;
+    while (pos < frame.size()) {
+        size_t length = std::min<size_t>(random() % 64 + 1, frame.size() - pos);
+        scanner.feed(frame.data() + pos, length);
+        pos += length;
+    }
+}
+
+// random fragments of any frame give the same result as the whole frame
+static void test_fuzz_fragments()
+{
+    std::mt19937 random(12);
+    ShellyJsonScanner whole(pro3emPaths(), PathCount);
+    ShellyJsonScanner fragmented(pro3emPaths(), PathCount);
+
+    for (size_t i = 0; i < FUZZ_ITERATIONS; i++) {
+        std::string frame = i % 2 ? Pro3EMStatus : Pro3EMFullStatus;
+        // mutate some frames, the results must still agree
+        if (i % 4 >= 2) {
+            for (unsigned m = random() % 8; m > 0; m--) {
+                frame[random() % frame.size()] = "{}[]\":,.-e0123456789 \\a"[random() % 24];
+            }
+        }
+
+        whole.reset();
+        whole.feed(frame.data(), frame.size());
+        fragmented.reset();
+        feedRandomFragments(fragmented, frame, random);
+        TEST_ASSERT_TRUE_MESSAGE(sameValues(whole, fragmented), frame.c_str());
+    }
+}
+
+// random bytes, deep nesting, long keys and numbers, then a valid frame after reset
+static void test_fuzz_garbage()
+{
+    std::mt19937 random(34);
+    ShellyJsonScanner scanner(pro3emPaths(), PathCount);
+    ShellyJsonScanner reference(pro3emPaths(), PathCount);
+    reference.feed(Pro3EMStatus, strlen(Pro3EMStatus));
+    TEST_ASSERT_TRUE(reference.isComplete());
+
+    std::string garbage;
+    for (size_t i = 0; i < FUZZ_ITERATIONS; i++) {
+        garbage.clear();
+        switch (i % 4) {
+        case 0: // any byte
+            for (unsigned n = random() % 512; n > 0; n--) {
+                garbage += static_cast<char>(random());
+            }
+            break;
+        case 1: // only structure
+            for (unsigned n = random() % 512; n > 0; n--) {
+                garbage += "{{[\"\":,}]"[random() % 9];
+            }
+            break;
+        case 2: // long keys and numbers
+            garbage = "{\"params\":{\"em:0\":{\"";
+            garbage.append(random() % 100, 'k');
+            garbage += "\":";
+            garbage.append(random() % 100, "0123456789.e-"[random() % 13]);
+            garbage += ",\"total_act_power\":-";
+            garbage.append(random() % 100, '9');
+            garbage += "}}}";
+            break;
+        case 3: // nesting beyond the depth counters
+            garbage.append(random() % 600, random() % 2 ? '{' : '[');
+            garbage += "\"ts\":1,\"total_act_power\":2";
+            garbage.append(random() % 600, '}');
+            break;
+        }
+
+        scanner.reset();
+        feedRandomFragments(scanner, garbage, random);
+        double value;
+        for (size_t p = 0; p < PathCount; p++) {
+            scanner.getValue(p, value);
+        }
+
+        scanner.reset();
+        scanner.feed(Pro3EMStatus, strlen(Pro3EMStatus));
+        TEST_ASSERT_TRUE_MESSAGE(sameValues(reference, scanner), garbage.c_str());
+    }
+}
+
+static void test_deep_nesting_is_not_complete()
+{
+    // more levels than the ignored depth can count
+    ShellyJsonScanner scanner(pro3emPaths(), PathCount);
+    std::string frame(SHELLY_JSON_MAX_DEPTH + 256, '{');
+    frame.append(SHELLY_JSON_MAX_DEPTH, '}');
+    scanner.feed(frame.data(), frame.size());
+    TEST_ASSERT_FALSE(scanner.isComplete());
+}
+
+////////////////////////
+
+// the former extraction of ShellyClientClass::Events
+static bool strstrValue(const char* payload, const char* key, double& value)
+{
+    const char* pos = strstr(payload, key);
+    if (pos == nullptr) {
+        return false;
+    }
+    value = atof(pos + strlen(key));
+    return true;
+}
+
+template <typename F>
+static double framesPerSecond(F&& extract)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCHMARK_FRAMES; i++) {
+        extract(i % 2 ? Pro3EMStatus : Pro3EMFullStatus);
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    return BENCHMARK_FRAMES / seconds.count();
+}
+
+static void test_benchmark()
+{
+    ShellyJsonScanner scanner(pro3emPaths(), PathCount);
+    volatile double sink = 0;
+
+    double scannerRate = framesPerSecond([&](const char* frame) {
+        scanner.reset();
+        scanner.feed(frame, strlen(frame));
+        double value;
+        for (size_t p = 0; p < PathCount; p++) {
+            if (scanner.getValue(p, value)) {
+                sink = sink + value;
+            }
+        }
+    });
+
+    static const char* const keys[] = { "\"ts\":", "\"total_act_power\":", "\"a_act_power\":", "\"b_act_power\":", "\"c_act_power\":" };
+    double strstrRate = framesPerSecond([&](const char* frame) {
+        double value;
+        for (const char* key : keys) {
+            if (strstrValue(frame, key, value)) {
+                sink = sink + value;
+            }
+        }
+    });
+
+    double bytes = (strlen(Pro3EMStatus) + strlen(Pro3EMFullStatus)) / 2.0;
+    char message[128];
+    snprintf(message, sizeof(message), "scanner %.0f frames/s (%.1f MB/s), strstr/atof %.0f frames/s (%.1f MB/s), %zu paths",
+        scannerRate, scannerRate * bytes / 1e6, strstrRate, strstrRate * bytes / 1e6, PathCount);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, scannerRate);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fuzz_fragments);
+    RUN_TEST(test_fuzz_garbage);
+    RUN_TEST(test_deep_nesting_is_not_complete);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
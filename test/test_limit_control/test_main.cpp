@@ -0,0 +1,429 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// Closed loop of the limit strategies against a simple plant and the split of the limit
+// across several inverters. The metrics of each run are printed, so tuning changes can
+// be compared with: pio test -e native -f test_limit_control -v
+// test_benchmark_strategies runs all strategies through the same random load and sun profile.
+
+#include "LimitDistribution.h"
+#include "LimitStrategy.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unity.h>
+
+#define PLANT_MAX_POWER 1600.0f // [W] of the inverter
+#define PLANT_SEND_INTERVAL 10 // [s] command budget, like LIMIT_CONTROL_SEND_INTERVAL
+#define PLANT_APPLY_DELAY 2 // [s] command round trip until the inverter uses a new limit
+#define PLANT_BAND 30.0f // [W] grid power around the target, which counts as settled
+#define BENCHMARK_STEPS 200 // changes of load and sun
+#define BENCHMARK_STEP_TIME 120 // [s] between the changes
+#define BENCHMARK_NOISE 10.0f // [W] standard deviation of the meter
+
+typedef struct {
+    float importWh;
+    float exportWh;
+    unsigned commands;
+    unsigned outside; // [s] outside of the band
+    unsigned settled; // [s] after the start of the phase, the grid stays in the band from then on
+    float overshoot; // [W] largest error against the direction of the first error
+} plantResult_t;
+
+// The meter is read every second and every sample runs the strategy, like LimitControl.
+// The inverter produces min(limit, sun), a sent limit acts after PLANT_APPLY_DELAY.
+class Plant {
+public:
+    explicit Plant(LimitStrategy& strategy, float limit)
+        : _strategy(strategy)
+        , _time(0)
+        , _limit(limit)
+        , _actLimit(limit)
+        , _sent(limit)
+        , _applyAt(0)
+        , _lastSend(-PLANT_SEND_INTERVAL)
+        , _random(1)
+        , _noise(0, 0)
+    {
+        _strategy.Reset();
+    }
+
+    // the meter reads the grid power with a normal distributed error
+    void SetMeterNoise(float stddev) { _noise = std::normal_distribution<float>(0, stddev); }
+
+    plantResult_t Run(const char* name, unsigned seconds, float load, float sun)
+    {
+        plantResult_t result = {};
+        float firstError = load - std::min(_limit, sun);
+
+        for (unsigned t = 0; t < seconds; t++, _time++) {
+            if (_time == _applyAt) {
+                _limit = _sent;
+            }
+            float production = std::min(_limit, sun);
+            float grid = load - production;
+
+            result.importWh += std::max(grid, 0.0f) / 3600;
+            result.exportWh += std::max(-grid, 0.0f) / 3600;
+            if (std::fabs(grid) > PLANT_BAND) {
+                result.outside++;
+                result.settled = t + 1;
+            }
+            float against = firstError > 0 ? -grid : grid;
+            result.overshoot = std::max(result.overshoot, against);
+
+            limitInput_t input;
+            input.gridPower = grid + (_noise.stddev() > 0 ? _noise(_random) : 0);
+            input.generatedPower = production;
+            input.actLimit = _actLimit;
+            input.targetValue = 0;
+            input.minLimit = 0;
+            input.maxLimit = PLANT_MAX_POWER;
+            input.dt = 1;
+            float limit = _strategy.Calculate(input);
+            if (limit == LIMIT_STRATEGY_NO_CHANGE) {
+                continue;
+            }
+            limit = std::min(std::max(limit, 0.0f), PLANT_MAX_POWER);
+            if (_time - _lastSend >= PLANT_SEND_INTERVAL && std::fabs(limit - _actLimit) >= LIMIT_CONTROL_SIMILAR) {
+                _actLimit = limit;
+                _sent = limit;
+                _applyAt = _time + PLANT_APPLY_DELAY;
+                _lastSend = _time;
+                result.commands++;
+            }
+        }
+
+        if (name == nullptr) {
+            return result;
+        }
+        char message[200];
+        snprintf(message, sizeof(message), "%-28s settled %3us, overshoot %5.1f W, %2u commands, import %5.2f Wh, export %5.2f Wh, outside %3us",
+            name, result.settled, result.overshoot, result.commands, result.importWh, result.exportWh, result.outside);
+        TEST_MESSAGE(message);
+        return result;
+    }
+
+private:
+    LimitStrategy& _strategy;
+    long _time; // [s]
+    float _limit; // used by the inverter
+    float _actLimit; // sent last
+    float _sent;
+    long _applyAt;
+    long _lastSend;
+    std::mt19937 _random;
+    std::normal_distribution<float> _noise;
+};
+
+static void assertSettled(const plantResult_t& result, unsigned settled, float overshoot, unsigned commands)
+{
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(settled, result.settled, "settling time");
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(overshoot, result.overshoot, "overshoot");
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(commands, result.commands, "commands");
+}
+
+// Load and sun of the phases: start, less load, cloud and the sun back.
+// limits are the upper bounds of settled, overshoot, commands and exportWh per phase.
+static void runScenario(LimitStrategy& strategy, const char* name, const plantResult_t (&limits)[4])
+{
+    char phase[40];
+    Plant plant(strategy, 0);
+
+    snprintf(phase, sizeof(phase), "%s start 500 W", name);
+    plantResult_t result = plant.Run(phase, 180, 500, 1500);
+    assertSettled(result, limits[0].settled, limits[0].overshoot, limits[0].commands);
+
+    snprintf(phase, sizeof(phase), "%s load 500 -> 200 W", name);
+    result = plant.Run(phase, 180, 200, 1500);
+    assertSettled(result, limits[1].settled, limits[1].overshoot, limits[1].commands);
+
+    // the sun limits the production, the import can't be avoided
+    snprintf(phase, sizeof(phase), "%s cloud, sun 100 W", name);
+    result = plant.Run(phase, 120, 200, 100);
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(limits[2].commands, result.commands, "commands");
+
+    // the limit raised during the cloud must come down without a long export
+    snprintf(phase, sizeof(phase), "%s sun back", name);
+    result = plant.Run(phase, 180, 200, 1500);
+    assertSettled(result, limits[3].settled, limits[3].overshoot, limits[3].commands);
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(limits[3].exportWh, result.exportWh, "export");
+}
+
+static void test_heuristic_closed_loop()
+{
+    HeuristicLimitStrategy heuristic;
+    static const plantResult_t limits[4] = {
+        { 0, 0, 4, 0, 30, 20 },
+        { 0, 0, 3, 0, 20, 20 },
+        { 0, 0, 12, 0, 0, 0 },
+        { 0, 2, 3, 0, 20, 20 },
+    };
+    runScenario(heuristic, "heuristic", limits);
+}
+
+static void test_pi_closed_loop()
+{
+    PiLimitStrategy pi;
+    pi.SetParameter(0.5f, 0.05f, 1.0f); // defaults of the configuration
+
+    // the integral follows every sample, while the command budget holds the limit: it overshoots
+    static const plantResult_t limits[4] = {
+        { 0, 0, 13, 0, 110, 200 },
+        { 0, 0, 11, 0, 60, 120 },
+        { 0, 0, 12, 0, 0, 0 },
+        { 0, 6, 15, 0, 130, 200 },
+    };
+    runScenario(pi, "pi", limits);
+}
+
+static void test_pi_anti_windup()
+{
+    PiLimitStrategy pi;
+    pi.SetParameter(0.5f, 0.05f, 0);
+
+    // the output stays at the maximum for a long time, the integral must not grow beyond it
+    limitInput_t input = { 5000, 0, PLANT_MAX_POWER, 0, 0, PLANT_MAX_POWER, 1 };
+    for (int i = 0; i < 600; i++) {
+        TEST_ASSERT_EQUAL_FLOAT(PLANT_MAX_POWER, pi.Calculate(input));
+    }
+
+    // an export reduces the limit at the next step
+    input.gridPower = -100;
+    TEST_ASSERT_LESS_THAN(PLANT_MAX_POWER, pi.Calculate(input));
+}
+
+typedef struct {
+    float settledMean; // [s] of the changes, which the inverter can follow
+    unsigned settledMax; // [s]
+    unsigned unsettled; // changes, which didn't settle within BENCHMARK_STEP_TIME
+    float overshootMax; // [W]
+    unsigned commands;
+    float importWh;
+    float exportWh;
+} benchmarkResult_t;
+
+// the same changes of load and sun for each strategy, a noisy meter
+static benchmarkResult_t benchmark(LimitStrategy& strategy, const char* name)
+{
+    std::mt19937 random(5);
+    Plant plant(strategy, 0);
+    plant.SetMeterNoise(BENCHMARK_NOISE);
+
+    benchmarkResult_t result = {};
+    unsigned settledSum = 0;
+    unsigned reachable = 0;
+    for (int step = 0; step < BENCHMARK_STEPS; step++) {
+        float load = 100 + random() % 800;
+        float sun = random() % 4 == 0 ? 50 + random() % 300 : 1500; // clouds
+        plantResult_t phase = plant.Run(nullptr, BENCHMARK_STEP_TIME, load, sun);
+
+        result.commands += phase.commands;
+        result.importWh += phase.importWh;
+        result.exportWh += phase.exportWh;
+        // with clouds the import can't be avoided
+        if (sun < load + PLANT_BAND) {
+            continue;
+        }
+        reachable++;
+        if (phase.settled >= BENCHMARK_STEP_TIME) {
+            result.unsettled++;
+            continue;
+        }
+        settledSum += phase.settled;
+        result.settledMax = std::max(result.settledMax, phase.settled);
+        result.overshootMax = std::max(result.overshootMax, phase.overshoot);
+    }
+    result.settledMean = reachable > result.unsettled ? static_cast<float>(settledSum) / (reachable - result.unsettled) : 0;
+
+    char message[200];
+    snprintf(message, sizeof(message), "%-16s settled mean %5.1f s, max %3u s, %2u/%u unsettled, overshoot max %5.1f W, %4u commands, import %6.1f Wh, export %6.1f Wh",
+        name, result.settledMean, result.settledMax, result.unsettled, reachable, result.overshootMax, result.commands, result.importWh, result.exportWh);
+    TEST_MESSAGE(message);
+
+    // the command budget is never exceeded
+    TEST_ASSERT_LESS_OR_EQUAL(BENCHMARK_STEPS * BENCHMARK_STEP_TIME / PLANT_SEND_INTERVAL, result.commands);
+    return result;
+}
+
+static void test_benchmark_strategies()
+{
+    // upper bounds of the behaviour as it is now, a tuning change shows up here
+    HeuristicLimitStrategy heuristic;
+    benchmarkResult_t result = benchmark(heuristic, "heuristic");
+    TEST_ASSERT_EQUAL(0, result.unsettled);
+    TEST_ASSERT_LESS_OR_EQUAL(15, result.settledMean);
+    TEST_ASSERT_LESS_OR_EQUAL(40, result.overshootMax);
+    TEST_ASSERT_LESS_OR_EQUAL(1600, result.commands);
+
+    // the feed-forward of the production, which the limit itself sets, acts like a second integrator
+    PiLimitStrategy pi;
+    pi.SetParameter(0.5f, 0.05f, 1.0f); // defaults of the configuration
+    result = benchmark(pi, "pi feed-forward");
+    TEST_ASSERT_LESS_OR_EQUAL(15, result.unsettled);
+    TEST_ASSERT_LESS_OR_EQUAL(70, result.settledMean);
+    TEST_ASSERT_LESS_OR_EQUAL(600, result.overshootMax);
+    TEST_ASSERT_LESS_OR_EQUAL(1850, result.commands);
+
+    pi.SetParameter(0.5f, 0.05f, 0);
+    result = benchmark(pi, "pi");
+    TEST_ASSERT_EQUAL(0, result.unsettled);
+    TEST_ASSERT_LESS_OR_EQUAL(65, result.settledMean);
+    TEST_ASSERT_LESS_OR_EQUAL(40, result.overshootMax);
+    TEST_ASSERT_LESS_OR_EQUAL(1900, result.commands);
+}
+
+static void test_heuristic_dead_band()
+{
+    HeuristicLimitStrategy heuristic;
+    limitInput_t input = { 5, 300, 300, 0, 0, PLANT_MAX_POWER, 1 };
+    TEST_ASSERT_TRUE(heuristic.Calculate(input) == LIMIT_STRATEGY_NO_CHANGE);
+    input.gridPower = -5;
+    TEST_ASSERT_TRUE(heuristic.Calculate(input) == LIMIT_STRATEGY_NO_CHANGE);
+}
+
+////////////////////////
+
+static limitInverter_t makeInverter(float maxPower, float limit, float production)
+{
+    limitInverter_t inverter = {};
+    inverter.serial = 1;
+    inverter.active = true;
+    inverter.maxPower = maxPower;
+    inverter.limit = limit;
+    inverter.target = limit;
+    inverter.production = production;
+    return inverter;
+}
+
+static float totalChange(const limitInverter_t* inverters, size_t count)
+{
+    float change = 0;
+    for (size_t i = 0; i < count; i++) {
+        change += inverters[i].target - inverters[i].limit;
+    }
+    return change;
+}
+
+static void test_distribute_equal_split()
+{
+    limitInverter_t inverters[3] = { makeInverter(800, 400, 400), makeInverter(800, 400, 400), makeInverter(800, 400, 400) };
+    LimitDistribution::Distribute(inverters, 300);
+
+    for (auto& inverter : inverters) {
+        TEST_ASSERT_FLOAT_WITHIN(0.1f, 500, inverter.target);
+    }
+}
+
+static void test_distribute_increase_skips_shaded()
+{
+    // the first inverter produces far below its limit, a higher limit has no effect there
+    limitInverter_t inverters[3] = { makeInverter(800, 400, 50), makeInverter(400, 200, 200), makeInverter(1600, 800, 800) };
+    LimitDistribution::Distribute(inverters, 600);
+
+    TEST_ASSERT_EQUAL_FLOAT(400, inverters[0].target);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 600, totalChange(inverters, 3));
+    // in proportion to the room: 200 W and 800 W
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 320, inverters[1].target);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 1280, inverters[2].target);
+}
+
+static void test_distribute_decrease_lowers_shaded_first()
+{
+    limitInverter_t inverters[3] = { makeInverter(800, 400, 50), makeInverter(400, 320, 320), makeInverter(1600, 1280, 1280) };
+    LimitDistribution::Distribute(inverters, -300);
+
+    // the limit above the production of the shaded inverter counts toward the change
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, -300, totalChange(inverters, 3));
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 100, inverters[0].target);
+    TEST_ASSERT_EQUAL_FLOAT(320, inverters[1].target);
+    TEST_ASSERT_EQUAL_FLOAT(1280, inverters[2].target);
+}
+
+static void test_distribute_decrease_beyond_excess()
+{
+    limitInverter_t inverters[2] = { makeInverter(800, 400, 100), makeInverter(800, 400, 400) };
+    LimitDistribution::Distribute(inverters, -500);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, -500, totalChange(inverters, 2));
+    TEST_ASSERT_LESS_OR_EQUAL(100 + LIMIT_CONTROL_PRODUCTION_MARGIN, inverters[0].target);
+    for (auto& inverter : inverters) {
+        TEST_ASSERT_GREATER_OR_EQUAL(0, inverter.target);
+    }
+}
+
+static void test_distribute_skips_pending_and_inactive()
+{
+    limitInverter_t inverters[3] = { makeInverter(800, 400, 400), makeInverter(800, 400, 400), makeInverter(800, 400, 400) };
+    inverters[0].pending = true;
+    inverters[1].active = false;
+    LimitDistribution::Distribute(inverters, 200);
+
+    TEST_ASSERT_EQUAL_FLOAT(400, inverters[0].target);
+    TEST_ASSERT_EQUAL_FLOAT(400, inverters[1].target);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 600, inverters[2].target);
+}
+
+static void test_distribute_slow_inverter_smaller_share()
+{
+    limitInverter_t inverters[2] = { makeInverter(800, 400, 400), makeInverter(800, 400, 400) };
+    inverters[0].latency = 300;
+    inverters[1].latency = 4 * LIMIT_CONTROL_LATENCY_REF;
+    LimitDistribution::Distribute(inverters, -300);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, -300, totalChange(inverters, 2));
+    TEST_ASSERT_FLOAT_WITHIN(1, 4 * (inverters[1].limit - inverters[1].target), inverters[0].limit - inverters[0].target);
+}
+
+static void test_distribute_small_change_combined()
+{
+    // 20 W split in three would be below LIMIT_CONTROL_SIMILAR on every inverter
+    limitInverter_t inverters[3] = { makeInverter(800, 400, 400), makeInverter(800, 400, 400), makeInverter(800, 400, 400) };
+    LimitDistribution::Distribute(inverters, 20);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 20, totalChange(inverters, 3));
+    int changed = 0;
+    for (auto& inverter : inverters) {
+        changed += inverter.target != inverter.limit;
+    }
+    TEST_ASSERT_EQUAL(1, changed);
+}
+
+static void test_distribute_clamped_to_max_power()
+{
+    limitInverter_t inverters[2] = { makeInverter(400, 300, 300), makeInverter(600, 500, 500) };
+    LimitDistribution::Distribute(inverters, 1000);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 400, inverters[0].target);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 600, inverters[1].target);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_heuristic_closed_loop);
+    RUN_TEST(test_pi_closed_loop);
+    RUN_TEST(test_pi_anti_windup);
+    RUN_TEST(test_heuristic_dead_band);
+    RUN_TEST(test_benchmark_strategies);
+    RUN_TEST(test_distribute_equal_split);
+    RUN_TEST(test_distribute_increase_skips_shaded);
+    RUN_TEST(test_distribute_decrease_lowers_shaded_first);
+    RUN_TEST(test_distribute_decrease_beyond_excess);
+    RUN_TEST(test_distribute_skips_pending_and_inactive);
+    RUN_TEST(test_distribute_slow_inverter_smaller_share);
+    RUN_TEST(test_distribute_small_change_combined);
+    RUN_TEST(test_distribute_clamped_to_max_power);
+    return UNITY_END();
+}
@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// RamBuffer: round trip and paging of the entries, and Restore() after a simulated reset,
+// where the memory block survives and a new RamBuffer is placed over it.
+// The benchmark compares the cost per entry of the iterations with the former std::function visitor.
+
+#include "RamBuffer.h"
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <unity.h>
+#include <vector>
+
+static void capacities(uint16_t (&caps)[RAMBUFFER_TYPE_COUNT], uint16_t capacity)
+{
+    for (size_t i = 0; i < RAMBUFFER_TYPE_COUNT; i++) {
+        caps[i] = capacity + i; // different sizes, so a wrong segment is noticed
+    }
+}
+
+// value of the n-th entry of a type
+static float valueOf(RamDataType_t type, size_t n)
+{
+    return static_cast<size_t>(type) * 1000.0f + n;
+}
+
+// n entries of each type, 100 ms apart, the types interleaved
+static void writeAll(RamBuffer& buffer, size_t n, time_t startTime = 0)
+{
+    for (size_t i = 0; i < n; i++) {
+        for (size_t t = 0; t < RAMBUFFER_TYPE_COUNT; t++) {
+            RamDataType_t type = static_cast<RamDataType_t>(t);
+            buffer.writeValue(type, startTime + i * 100 + t, valueOf(type, i));
+        }
+    }
+}
+
+// the newest count entries of writeAll(n)
+static void checkLast(RamBuffer& buffer, RamDataType_t type, size_t n, size_t count, time_t startTime = 0)
+{
+    std::vector<dataEntry_t> entries(count + 1);
+    size_t copied = buffer.copyEntries(type, 0, 0, INT32_MAX, entries.data(), entries.size());
+    TEST_ASSERT_EQUAL(count, copied);
+    for (size_t i = 0; i < copied; i++) {
+        size_t index = n - count + i;
+        TEST_ASSERT_TRUE(entries[i].type == type);
+        TEST_ASSERT_EQUAL(startTime + index * 100 + static_cast<size_t>(type), entries[i].time);
+        TEST_ASSERT_EQUAL_FLOAT(valueOf(type, index), entries[i].value);
+    }
+}
+
+static void test_round_trip()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 20);
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(caps));
+    RamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+
+    for (size_t t = 0; t < RAMBUFFER_TYPE_COUNT; t++) {
+        TEST_ASSERT_TRUE(buffer.getLastEntry(static_cast<RamDataType_t>(t)) == nullptr);
+    }
+
+    // partly filled
+    writeAll(buffer, 13);
+    for (size_t t = 0; t < RAMBUFFER_TYPE_COUNT; t++) {
+        RamDataType_t type = static_cast<RamDataType_t>(t);
+        checkLast(buffer, type, 13, 13);
+        TEST_ASSERT_EQUAL_FLOAT(valueOf(type, 12), buffer.getLastEntry(type)->value);
+    }
+
+    // entries(lastMillis) keeps the entries with time >= now - lastMillis
+    NativeMillis = 1200;
+    size_t count = 0;
+    for (auto& entry : buffer.entries(RamDataType_t::Pro3EM, 200)) {
+        TEST_ASSERT_GREATER_OR_EQUAL(1000, entry.time);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(3, count); // 1000, 1100, 1200
+    NativeMillis = 0;
+}
+
+static void test_wrap_around()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 20);
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(caps));
+    RamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+
+    for (size_t n : { 13, 20, 21, 57, 100 }) {
+        buffer.PowerOnInitialize();
+        writeAll(buffer, n);
+        for (size_t t = 0; t < RAMBUFFER_TYPE_COUNT; t++) {
+            checkLast(buffer, static_cast<RamDataType_t>(t), n, std::min<size_t>(n, caps[t]));
+        }
+    }
+}
+
+static void test_paging()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 50);
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(caps));
+    RamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+    writeAll(buffer, 73);
+
+    // like the graph API: pages of 7 entries between two times
+    const RamDataType_t type = RamDataType_t::PlugS;
+    const time_t startTime = 3000;
+    const time_t endTime = 6000;
+    std::vector<dataEntry_t> all;
+    dataEntry_t page[7];
+    for (size_t skip = 0;; skip += 7) {
+        size_t count = buffer.copyEntries(type, startTime, skip, endTime, page, 7);
+        all.insert(all.end(), page, page + count);
+        if (count < 7) {
+            break;
+        }
+    }
+
+    std::vector<float> expected;
+    for (size_t i = 0; i < 73; i++) {
+        time_t time = i * 100 + static_cast<size_t>(type);
+        if (i + caps[static_cast<size_t>(type)] >= 73 && time >= startTime && time <= endTime) {
+            expected.push_back(valueOf(type, i));
+        }
+    }
+    TEST_ASSERT_EQUAL(expected.size(), all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        TEST_ASSERT_EQUAL_FLOAT(expected[i], all[i].value);
+    }
+
+    // beyond the end
+    TEST_ASSERT_EQUAL(0, buffer.copyEntries(type, startTime, all.size(), endTime, page, 7));
+}
+
+static void test_too_small_buffer()
+{
+    // the last segments get what's left, an empty segment ignores the values
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 10);
+    std::vector<uint8_t> memory(sizeof(dataEntryHeader_t) + 25 * sizeof(dataEntry_t));
+    RamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+    writeAll(buffer, 30);
+
+    checkLast(buffer, RamDataType_t::Pro3EM, 30, 10);
+    checkLast(buffer, RamDataType_t::Pro3EM_Min, 30, 11);
+    checkLast(buffer, RamDataType_t::Pro3EM_Max, 30, 4);
+    TEST_ASSERT_TRUE(buffer.getLastEntry(RamDataType_t::PlugS) == nullptr);
+}
+
+////////////////////////
+
+static void test_restore_after_reset()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 30);
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(caps));
+    {
+        RamBuffer buffer(memory.data(), memory.size(), caps);
+        buffer.PowerOnInitialize();
+        writeAll(buffer, 45);
+    }
+
+    // reset: millis() restarts, the memory is unchanged
+    NativeMillis = 0;
+    RamBuffer restored(memory.data(), memory.size(), caps);
+    TEST_ASSERT_TRUE(restored.Restore());
+    for (size_t t = 0; t < RAMBUFFER_TYPE_COUNT; t++) {
+        checkLast(restored, static_cast<RamDataType_t>(t), 45, std::min<size_t>(45, caps[t]));
+    }
+
+    // the time continues after the newest entry of all types
+    time_t newest = 44 * 100 + RAMBUFFER_TYPE_COUNT - 1;
+    TEST_ASSERT_EQUAL(newest + 1, restored.now());
+    restored.writeValue(RamDataType_t::Pro3EM, restored.now(), -1);
+    TEST_ASSERT_GREATER_THAN(restored.getLastEntry(RamDataType_t::Pro3EM_Min)->time, restored.getLastEntry(RamDataType_t::Pro3EM)->time);
+
+    // a second reset keeps the new entry, the time continues after it
+    time_t lastTime = restored.getLastEntry(RamDataType_t::Pro3EM)->time;
+    NativeMillis = 0;
+    RamBuffer again(memory.data(), memory.size(), caps);
+    TEST_ASSERT_TRUE(again.Restore());
+    TEST_ASSERT_EQUAL_FLOAT(-1, again.getLastEntry(RamDataType_t::Pro3EM)->value);
+    TEST_ASSERT_EQUAL(lastTime + 1, again.now());
+}
+
+static void test_restore_relocated()
+{
+    // the header holds indices only, the block can be placed at another address
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 30);
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(caps));
+    RamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+    writeAll(buffer, 40);
+
+    std::vector<uint8_t> moved(memory);
+    memset(memory.data(), 0, memory.size());
+    RamBuffer relocated(moved.data(), moved.size(), caps);
+    TEST_ASSERT_TRUE(relocated.Restore());
+    for (size_t t = 0; t < RAMBUFFER_TYPE_COUNT; t++) {
+        checkLast(relocated, static_cast<RamDataType_t>(t), 40, std::min<size_t>(40, caps[t]));
+    }
+}
+
+static void test_restore_rejects_invalid()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 30);
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(caps));
+    RamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+    writeAll(buffer, 10);
+    const std::vector<uint8_t> valid(memory);
+
+    // random content after power on
+    std::mt19937 random(6);
+    for (auto& b : memory) {
+        b = random();
+    }
+    TEST_ASSERT_FALSE(RamBuffer(memory.data(), memory.size(), caps).Restore());
+
+    // every changed byte of the header
+    for (size_t i = 0; i < sizeof(dataEntryHeader_t); i++) {
+        memory = valid;
+        memory[i] ^= 0x01;
+        TEST_ASSERT_FALSE(RamBuffer(memory.data(), memory.size(), caps).Restore());
+    }
+
+    // the firmware was updated with other capacities
+    memory = valid;
+    uint16_t otherCaps[RAMBUFFER_TYPE_COUNT];
+    capacities(otherCaps, 30);
+    otherCaps[3]++;
+    TEST_ASSERT_FALSE(RamBuffer(memory.data(), memory.size(), otherCaps).Restore());
+
+    // a smaller block
+    TEST_ASSERT_FALSE(RamBuffer(memory.data(), memory.size() - 5 * sizeof(dataEntry_t), caps).Restore());
+
+    memory = valid;
+    TEST_ASSERT_TRUE(RamBuffer(memory.data(), memory.size(), caps).Restore());
+}
+
+////////////////////////
+
+#define BENCHMARK_ROUNDS 20000
+
+// the former visitor of RamBuffer, an indirect call per entry
+static void __attribute__((noinline)) forAllEntriesFunction(RamBuffer& buffer, RamDataType_t type, time_t lastMillis, const std::function<void(dataEntry_t*)>& doDataEntry)
+{
+    for (auto& entry : buffer.entries(type, lastMillis)) {
+        doDataEntry(&entry);
+    }
+}
+
+template <typename F>
+static double nsPerEntry(size_t entries, F&& scan)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+        scan();
+    }
+    std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+    return time.count() / (static_cast<double>(entries) * BENCHMARK_ROUNDS);
+}
+
+static void test_benchmark_visitor()
+{
+    uint16_t caps[RAMBUFFER_TYPE_COUNT];
+    capacities(caps, 180);
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(caps));
+    RamBuffer buffer(memory.data(), memory.size(), caps);
+    buffer.PowerOnInitialize();
+    writeAll(buffer, 200);
+    NativeMillis = 199 * 100;
+    const time_t all = NativeMillis + 1;
+    const size_t entries = caps[static_cast<size_t>(RamDataType_t::Pro3EM)];
+
+    // min and max like ShellyClientData::ScanMinMax
+    volatile float sink = 0;
+    double function = nsPerEntry(entries, [&]() {
+        float min = INFINITY, max = -INFINITY;
+        forAllEntriesFunction(buffer, RamDataType_t::Pro3EM, all, [&](dataEntry_t* entry) {
+            min = entry->value < min ? entry->value : min;
+            max = entry->value > max ? entry->value : max;
+        });
+        sink = sink + min + max;
+    });
+    double visitor = nsPerEntry(entries, [&]() {
+        float min = INFINITY, max = -INFINITY;
+        buffer.forAllEntries(RamDataType_t::Pro3EM, all, [&](dataEntry_t* entry) {
+            min = entry->value < min ? entry->value : min;
+            max = entry->value > max ? entry->value : max;
+        });
+        sink = sink + min + max;
+    });
+    double range = nsPerEntry(entries, [&]() {
+        float min = INFINITY, max = -INFINITY;
+        for (auto& entry : buffer.entries(RamDataType_t::Pro3EM, all)) {
+            min = entry.value < min ? entry.value : min;
+            max = entry.value > max ? entry.value : max;
+        }
+        sink = sink + min + max;
+    });
+
+    char message[128];
+    snprintf(message, sizeof(message), "%zu entries: std::function %.2f ns/entry, template visitor %.2f ns/entry, range %.2f ns/entry",
+        entries, function, visitor, range);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_FLOAT(2 * valueOf(RamDataType_t::Pro3EM, 199) - entries + 1, sink / (3 * BENCHMARK_ROUNDS));
+}
+
+void setUp()
+{
+    NativeMillis = 0;
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_paging);
+    RUN_TEST(test_too_small_buffer);
+    RUN_TEST(test_restore_after_reset);
+    RUN_TEST(test_restore_relocated);
+    RUN_TEST(test_restore_rejects_invalid);
+    RUN_TEST(test_benchmark_visitor);
+    return UNITY_END();
+}
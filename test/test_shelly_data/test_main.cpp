@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// Stress test of ShellyClientData: the writer (the loop task) updates the grid power while
+// readers like LimitControl, the graph API and the live data task scan the buffer.
+// Run it in env:native_tsan to check the ring and the mutex for data races.
+// The writer must never block behind a reader, every sample must be stored and each
+// reader must see a consistent, consecutive sequence.
+
+#include "ShellyClientData.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+#define STRESS_SAMPLES 100000
+#define STRESS_READERS 3
+#define STRESS_INTERVAL 10 // [ms] between the samples
+#define STRESS_WINDOW 1000 // [ms]
+#define STRESS_ENTRIES 180 // capacity of Pro3EM in the RamBuffer
+
+// counts the bytes of the graph data
+class CountingPrint : public Print {
+public:
+    size_t write(uint8_t) override { return ++bytes, 1; }
+    size_t write(const uint8_t*, size_t size) override { return bytes += size, size; }
+    size_t bytes = 0;
+};
+
+// value i at time i * STRESS_INTERVAL
+static bool isConsecutive(const dataEntry_t* entries, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        float value = entries[i].value;
+        time_t time = entries[i].time;
+        if (time != static_cast<time_t>(value) * STRESS_INTERVAL || (i > 0 && value != entries[i - 1].value + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct readerResult_t {
+    size_t reads;
+    size_t inconsistent; // gaps or entries of different writes
+    size_t backwards; // a value older than one of a previous read
+};
+
+static void reader(ShellyClientData& data, const std::atomic<bool>& done, readerResult_t& result)
+{
+    std::vector<dataEntry_t> entries(STRESS_ENTRIES);
+    float lastAct = -1;
+    float lastMax = -1;
+
+    while (!done) {
+        float act = data.GetActValue(RamDataType_t::Pro3EM);
+        // separate calls, the min of the earlier one can't exceed the max of the later one
+        float min = data.GetMinValue(RamDataType_t::Pro3EM, STRESS_WINDOW);
+        float max = data.GetMaxValue(RamDataType_t::Pro3EM, STRESS_WINDOW);
+        result.backwards += act < lastAct || max < lastMax;
+        result.inconsistent += min > max;
+        lastAct = act;
+        lastMax = max;
+
+        size_t count = data.GetEntries(RamDataType_t::Pro3EM, 0, 0, data.Now(), entries.data(), entries.size());
+        result.inconsistent += !isConsecutive(entries.data(), count);
+
+        CountingPrint output;
+        data.WriteLastDataBinary(RamDataType_t::Pro3EM, STRESS_WINDOW, output);
+        result.inconsistent += output.bytes < 4;
+        result.reads++;
+    }
+}
+
+static void test_concurrent_readers()
+{
+    ShellyClientData data;
+    data.RegisterWindow(RamDataType_t::Pro3EM, STRESS_WINDOW);
+
+    std::atomic<bool> done(false);
+    readerResult_t results[STRESS_READERS] = {};
+    std::vector<std::thread> readers;
+    for (auto& result : results) {
+        readers.emplace_back(reader, std::ref(data), std::cref(done), std::ref(result));
+    }
+
+    // the loop task
+    for (unsigned i = 0; i < STRESS_SAMPLES; i++) {
+        NativeMillis = i * STRESS_INTERVAL;
+        data.Update(RamDataType_t::Pro3EM, i);
+    }
+    done = true;
+    for (auto& r : readers) {
+        r.join();
+    }
+
+    char message[96];
+    for (auto& result : results) {
+        snprintf(message, sizeof(message), "%zu reads, %zu inconsistent, %zu backwards", result.reads, result.inconsistent, result.backwards);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_GREATER_THAN(0, result.reads);
+        TEST_ASSERT_EQUAL(0, result.inconsistent);
+        TEST_ASSERT_EQUAL(0, result.backwards);
+    }
+
+    // no sample was lost
+    dataEntry_t entries[STRESS_ENTRIES];
+    size_t count = data.GetEntries(RamDataType_t::Pro3EM, 0, 0, data.Now(), entries, STRESS_ENTRIES);
+    TEST_ASSERT_EQUAL(STRESS_ENTRIES, count);
+    TEST_ASSERT_TRUE(isConsecutive(entries, count));
+    TEST_ASSERT_EQUAL_FLOAT(STRESS_SAMPLES - 1, entries[count - 1].value);
+    TEST_ASSERT_EQUAL_FLOAT(STRESS_SAMPLES - 1, data.GetMaxValue(RamDataType_t::Pro3EM, STRESS_WINDOW));
+    TEST_ASSERT_EQUAL_FLOAT(STRESS_SAMPLES - STRESS_WINDOW / STRESS_INTERVAL - 1, data.GetMinValue(RamDataType_t::Pro3EM, STRESS_WINDOW));
+}
+
+static void test_writer_does_not_block()
+{
+    // a reader holds the lock for a long scan, the writer keeps going until the ring is full
+    ShellyClientData data;
+    std::atomic<bool> scanning(false);
+    std::atomic<bool> release(false);
+    std::atomic<unsigned> written(0);
+
+    NativeMillis = 0;
+    std::thread graph([&]() {
+        // WriteLastDataBinary calls the output with the lock held
+        class BlockingPrint : public Print {
+        public:
+            BlockingPrint(std::atomic<bool>& scanning, std::atomic<bool>& release)
+                : _scanning(scanning)
+                , _release(release)
+            {
+            }
+            size_t write(uint8_t) override
+            {
+                _scanning = true;
+                while (!_release) {
+                    std::this_thread::yield();
+                }
+                return 1;
+            }
+
+        private:
+            std::atomic<bool>& _scanning;
+            std::atomic<bool>& _release;
+        } blocking(scanning, release);
+        data.WriteLastDataBinary(RamDataType_t::Pro3EM, STRESS_WINDOW, blocking);
+    });
+    while (!scanning) {
+        std::this_thread::yield();
+    }
+
+    // fewer samples than the ring holds
+    std::thread writer([&]() {
+        for (unsigned i = 0; i < 20; i++) {
+            data.Update(RamDataType_t::Pro3EM, i, i * STRESS_INTERVAL);
+            written++;
+        }
+    });
+    writer.join();
+    TEST_ASSERT_EQUAL(20, written.load());
+
+    release = true;
+    graph.join();
+    TEST_ASSERT_EQUAL_FLOAT(19, data.GetActValue(RamDataType_t::Pro3EM));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_concurrent_readers);
+    RUN_TEST(test_writer_does_not_block);
+    return UNITY_END();
+}
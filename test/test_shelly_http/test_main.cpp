@@ -0,0 +1,436 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// The HTTP fallback of ShellyClientClass against a local HTTP stub of a Shelly: the replies of the
+// component RPCs embedded by the prefix and suffix of ShellyHttpRpc give the same values as a
+// websocket reply, the connection is reused and a failing host is asked less often.
+
+#include "ShellyHttpBackoff.h"
+#include "ShellyJsonPaths.h"
+#include "ShellyJsonScanner.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+
+#define STUB_EM_STATUS R"({"id":0,"a_current":1.21,"a_voltage":230.1,"a_act_power":250.5,"a_aprt_power":278.3,"a_pf":0.9,"b_current":0.52,"b_voltage":231.4,"b_act_power":-98.2,"b_aprt_power":120.3,"b_pf":-0.82,"c_current":0.33,"c_voltage":229.8,"c_act_power":-272.7,"c_aprt_power":75.8,"c_pf":0.99,"n_current":null,"total_current":2.06,"total_act_power":-120.4,"total_aprt_power":474.4,"user_calibrated_phase":[]})"
+#define STUB_SWITCH_STATUS R"({"id":0,"source":"init","output":true,"apower":312.7,"voltage":231.2,"current":1.36,"aenergy":{"total":11234.5,"by_minute":[5211.4,5230.1,5198.0],"minute_ts":1718100060},"temperature":{"tC":38.2,"tF":100.8}})"
+#define STUB_SHELLY_STATUS R"({"ble":{},"cloud":{"connected":true},"em:0":)" STUB_EM_STATUS R"(,"emdata:0":{"id":0,"total_act":1234.5,"total_act_ret":845141.62},"sys":{"mac":"08F9E0E5A1B4","uptime":86400,"time":"14:21"}})"
+#define STUB_CHUNK 7 // the stream of HTTPClient delivers the body in pieces
+
+// a Shelly Gen2 on the loopback interface, which answers the RPCs over HTTP/1.1 with keep-alive
+class HttpStub {
+public:
+    enum class Mode {
+        Ok,
+        Error, // 503, like a busy device
+        Close, // closes the connection without a reply
+    };
+
+    HttpStub()
+    {
+        _listen = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        bind(_listen, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        socklen_t length = sizeof(address);
+        getsockname(_listen, reinterpret_cast<sockaddr*>(&address), &length);
+        _port = ntohs(address.sin_port);
+        listen(_listen, 4);
+        _thread = std::thread(&HttpStub::run, this);
+    }
+
+    ~HttpStub()
+    {
+        _stop = true;
+        shutdown(_listen, SHUT_RDWR);
+        close(_listen);
+        _thread.join();
+    }
+
+    uint16_t port() const { return _port; }
+    void setMode(Mode mode) { _mode = mode; }
+    // the stub closes a connection after this many replies, like the limit of the device
+    void setMaxRequests(unsigned maxRequests) { _maxRequests = maxRequests; }
+    unsigned connections() const { return _connections; }
+    unsigned requests() const { return _requests; }
+
+private:
+    void run()
+    {
+        while (!_stop) {
+            int connection = accept(_listen, nullptr, nullptr);
+            if (connection < 0) {
+                break;
+            }
+            _connections++;
+            serve(connection);
+            close(connection);
+        }
+    }
+
+    void serve(int connection)
+    {
+        std::string request;
+        char buffer[512];
+        unsigned replies = 0;
+        while (!_stop) {
+            size_t end = request.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                ssize_t size = recv(connection, buffer, sizeof(buffer), 0);
+                if (size <= 0) {
+                    return;
+                }
+                request.append(buffer, size);
+                continue;
+            }
+            std::string uri = request.substr(4, request.find(' ', 4) - 4);
+            request.erase(0, end + 4);
+            _requests++;
+
+            if (_mode == Mode::Close) {
+                return;
+            }
+            const char* body = uri == ShellyHttpRpc[0].uri ? STUB_EM_STATUS
+                : uri == ShellyHttpRpc[1].uri             ? STUB_SWITCH_STATUS
+                : uri == ShellyHttpRpc[2].uri             ? STUB_SHELLY_STATUS
+                                                          : nullptr;
+            int status = _mode == Mode::Error ? 503 : body != nullptr ? 200 : 404;
+            if (status != 200) {
+                body = "";
+            }
+            bool last = ++replies >= _maxRequests;
+            char header[160];
+            snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                status, status == 200 ? "OK" : "Error", strlen(body), last ? "close" : "keep-alive");
+            std::string reply = std::string(header) + body;
+            send(connection, reply.data(), reply.size(), MSG_NOSIGNAL);
+            if (last) {
+                return;
+            }
+        }
+    }
+
+    int _listen;
+    uint16_t _port;
+    std::thread _thread;
+    std::atomic<bool> _stop { false };
+    std::atomic<Mode> _mode { Mode::Ok };
+    std::atomic<unsigned> _maxRequests { 1000000 };
+    std::atomic<unsigned> _connections { 0 };
+    std::atomic<unsigned> _requests { 0 };
+};
+
+// GET with keep-alive like HTTPClient with setReuse(true): the connection stays open until the host closes it
+class KeepAliveClient {
+public:
+    explicit KeepAliveClient(uint16_t port, bool reuse = true)
+        : _port(port)
+        , _reuse(reuse)
+    {
+    }
+    ~KeepAliveClient() { disconnect(); }
+
+    // the HTTP status, -1 if the connection failed; body is fed to scanner in pieces
+    int get(const char* uri, ShellyJsonScanner& scanner)
+    {
+        if (_socket < 0 && !connect()) {
+            return -1;
+        }
+        char request[160];
+        snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: %s\r\n\r\n", uri, _reuse ? "keep-alive" : "close");
+        send(_socket, request, strlen(request), MSG_NOSIGNAL);
+
+        std::string reply;
+        size_t end;
+        while ((end = reply.find("\r\n\r\n")) == std::string::npos) {
+            if (!receive(reply)) {
+                disconnect();
+                return -1;
+            }
+        }
+        int status = atoi(reply.c_str() + 9);
+        const char* length = strstr(reply.c_str(), "Content-Length: ");
+        size_t contentLength = length != nullptr ? strtoul(length + 16, nullptr, 10) : 0;
+        bool keepAlive = _reuse && strstr(reply.c_str(), "Connection: close") == nullptr;
+        reply.erase(0, end + 4);
+        while (reply.size() < contentLength) {
+            if (!receive(reply)) {
+                disconnect();
+                return -1;
+            }
+        }
+
+        for (size_t i = 0; i < contentLength; i += STUB_CHUNK) {
+            scanner.feed(reply.data() + i, std::min<size_t>(STUB_CHUNK, contentLength - i));
+        }
+        if (!keepAlive) {
+            disconnect();
+        }
+        return status;
+    }
+
+private:
+    bool connect()
+    {
+        _socket = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(_port);
+        if (::connect(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+    void disconnect()
+    {
+        if (_socket >= 0) {
+            close(_socket);
+            _socket = -1;
+        }
+    }
+    bool receive(std::string& reply)
+    {
+        char buffer[512];
+        ssize_t size = recv(_socket, buffer, sizeof(buffer), 0);
+        if (size <= 0) {
+            return false;
+        }
+        reply.append(buffer, size);
+        return true;
+    }
+
+    uint16_t _port;
+    bool _reuse;
+    int _socket = -1;
+};
+
+// the paths of WebSocketData for a device type
+class Device {
+public:
+    Device(ShellyDeviceType_t type, const char* jsonPath = nullptr)
+        : _scanner(_paths, static_cast<size_t>(ShellyPath_t::MAX))
+    {
+        for (size_t i = 0; i < static_cast<size_t>(ShellyPath_t::MAX); i++) {
+            _paths[i] = ShellyJsonPaths[i];
+        }
+        const char* defaultPath = ShellyDefaultValuePaths[static_cast<size_t>(type)];
+        _paths[static_cast<size_t>(ShellyPath_t::Value)] = jsonPath != nullptr ? jsonPath : defaultPath;
+        // like HandleHttp: the component RPC, unless an own JSON path may be elsewhere
+        bool ownPath = jsonPath != nullptr && strcmp(jsonPath, defaultPath) != 0;
+        _rpc = &ShellyHttpRpc[static_cast<size_t>(ownPath ? ShellyDeviceType_t::Generic : type)];
+    }
+
+    int request(KeepAliveClient& client)
+    {
+        _scanner.reset();
+        _scanner.feed(_rpc->prefix, strlen(_rpc->prefix));
+        int status = client.get(_rpc->uri, _scanner);
+        _scanner.feed(_rpc->suffix, strlen(_rpc->suffix));
+        return status;
+    }
+
+    bool getValue(ShellyPath_t path, double& value) { return _scanner.getValue(static_cast<size_t>(path), value); }
+    bool isComplete() { return _scanner.isComplete(); }
+    const char* uri() const { return _rpc->uri; }
+
+private:
+    const char* _paths[static_cast<size_t>(ShellyPath_t::MAX)];
+    ShellyJsonScanner _scanner;
+    const shellyHttpRpc_t* _rpc;
+};
+
+static void test_rpc_replies()
+{
+    HttpStub stub;
+    KeepAliveClient client(stub.port());
+    double value;
+
+    Device pro3em(ShellyDeviceType_t::Pro3EM);
+    TEST_ASSERT_EQUAL_STRING("/rpc/EM.GetStatus?id=0", pro3em.uri());
+    TEST_ASSERT_EQUAL(200, pro3em.request(client));
+    TEST_ASSERT_TRUE(pro3em.isComplete());
+    TEST_ASSERT_TRUE(pro3em.getValue(ShellyPath_t::Value, value));
+    TEST_ASSERT_EQUAL_FLOAT(-120.4, value);
+    TEST_ASSERT_TRUE(pro3em.getValue(ShellyPath_t::ActPowerB, value));
+    TEST_ASSERT_EQUAL_FLOAT(-98.2, value);
+    TEST_ASSERT_TRUE(pro3em.getValue(ShellyPath_t::PfC, value));
+    TEST_ASSERT_EQUAL_FLOAT(0.99, value);
+    // a reply has no device time, the arrival is the time of the sample
+    TEST_ASSERT_FALSE(pro3em.getValue(ShellyPath_t::Ts, value));
+
+    Device plug(ShellyDeviceType_t::PlugS);
+    TEST_ASSERT_EQUAL_STRING("/rpc/Switch.GetStatus?id=0", plug.uri());
+    TEST_ASSERT_EQUAL(200, plug.request(client));
+    TEST_ASSERT_TRUE(plug.getValue(ShellyPath_t::Value, value));
+    TEST_ASSERT_EQUAL_FLOAT(312.7, value);
+
+    // an own JSON path reads Shelly.GetStatus, the same path as for the websocket
+    Device own(ShellyDeviceType_t::Pro3EM, "*.emdata:0.total_act_ret");
+    TEST_ASSERT_EQUAL_STRING("/rpc/Shelly.GetStatus", own.uri());
+    TEST_ASSERT_EQUAL(200, own.request(client));
+    TEST_ASSERT_TRUE(own.getValue(ShellyPath_t::Value, value));
+    TEST_ASSERT_EQUAL_FLOAT(845141.62, value);
+    TEST_ASSERT_TRUE(own.getValue(ShellyPath_t::ActPowerA, value));
+    TEST_ASSERT_EQUAL_FLOAT(250.5, value);
+
+    Device generic(ShellyDeviceType_t::Generic, "*.em:0.total_act_power");
+    TEST_ASSERT_EQUAL(200, generic.request(client));
+    TEST_ASSERT_TRUE(generic.getValue(ShellyPath_t::Value, value));
+    TEST_ASSERT_EQUAL_FLOAT(-120.4, value);
+
+    TEST_ASSERT_EQUAL(4, stub.requests());
+    TEST_ASSERT_EQUAL(1, stub.connections());
+}
+
+static void test_keep_alive()
+{
+    HttpStub stub;
+    stub.setMaxRequests(40); // the device closes the connection now and then
+    Device pro3em(ShellyDeviceType_t::Pro3EM);
+    double value;
+
+    using clock = std::chrono::steady_clock;
+    clock::duration pooled {};
+    clock::duration single {};
+    {
+        KeepAliveClient client(stub.port());
+        auto start = clock::now();
+        for (int i = 0; i < 100; i++) {
+            TEST_ASSERT_EQUAL(200, pro3em.request(client));
+            TEST_ASSERT_TRUE(pro3em.getValue(ShellyPath_t::Value, value));
+        }
+        pooled = clock::now() - start;
+    }
+    // a closed connection is opened again with the next request
+    TEST_ASSERT_EQUAL(3, stub.connections());
+
+    {
+        KeepAliveClient client(stub.port(), false);
+        auto start = clock::now();
+        for (int i = 0; i < 100; i++) {
+            TEST_ASSERT_EQUAL(200, pro3em.request(client));
+        }
+        single = clock::now() - start;
+    }
+    TEST_ASSERT_EQUAL(103, stub.connections());
+
+    using us = std::chrono::microseconds;
+    char message[96];
+    snprintf(message, sizeof(message), "keep-alive %.0f us/request, a connection per request %.0f us/request",
+        std::chrono::duration_cast<us>(pooled).count() / 100.0, std::chrono::duration_cast<us>(single).count() / 100.0);
+    TEST_MESSAGE(message);
+}
+
+static void test_failures()
+{
+    HttpStub stub;
+    KeepAliveClient client(stub.port());
+    Device pro3em(ShellyDeviceType_t::Pro3EM);
+    double value;
+
+    stub.setMode(HttpStub::Mode::Error);
+    TEST_ASSERT_EQUAL(503, pro3em.request(client));
+    TEST_ASSERT_FALSE(pro3em.getValue(ShellyPath_t::Value, value));
+
+    stub.setMode(HttpStub::Mode::Close);
+    TEST_ASSERT_EQUAL(-1, pro3em.request(client));
+    TEST_ASSERT_FALSE(pro3em.getValue(ShellyPath_t::Value, value));
+
+    // the next request opens a new connection
+    stub.setMode(HttpStub::Mode::Ok);
+    TEST_ASSERT_EQUAL(200, pro3em.request(client));
+    TEST_ASSERT_TRUE(pro3em.getValue(ShellyPath_t::Value, value));
+    TEST_ASSERT_EQUAL(2, stub.connections());
+}
+
+static void test_backoff()
+{
+    // a failing host over 10 simulated minutes: each failure doubles the interval up to the maximum
+    HttpStub stub;
+    KeepAliveClient client(stub.port());
+    Device pro3em(ShellyDeviceType_t::Pro3EM);
+    ShellyHttpBackoff backoff;
+    const uint32_t interval = 1000;
+
+    auto poll = [&](unsigned long from, unsigned long to, unsigned long* times, size_t maxTimes) {
+        size_t count = 0;
+        for (unsigned long now = from; now < to; now += 10) {
+            if (!backoff.isDue(now, interval)) {
+                continue;
+            }
+            if (count < maxTimes) {
+                times[count] = now;
+            }
+            count++;
+            if (pro3em.request(client) == 200) {
+                backoff.succeeded();
+            } else {
+                backoff.failed(interval);
+            }
+        }
+        return count;
+    };
+
+    stub.setMode(HttpStub::Mode::Error);
+    unsigned long times[16];
+    size_t count = poll(1000, 600000, times, 16);
+    static const unsigned long expected[] = { 1000, 3000, 7000, 15000, 31000, 63000, 123000, 183000, 243000 };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        TEST_ASSERT_EQUAL(expected[i], times[i]);
+    }
+    TEST_ASSERT_EQUAL(SHELLY_HTTP_MAX_BACKOFF, backoff.getInterval(interval));
+    TEST_ASSERT_EQUAL(14, count);
+    TEST_ASSERT_EQUAL(count, stub.requests());
+
+    // the host answers again: after the last long interval the configured one applies
+    stub.setMode(HttpStub::Mode::Ok);
+    count = poll(600000, 610000, times, 16);
+    TEST_ASSERT_EQUAL(603000, times[0]);
+    TEST_ASSERT_EQUAL(604000, times[1]);
+    TEST_ASSERT_EQUAL(7, count);
+    TEST_ASSERT_EQUAL(0, backoff.getFailures());
+    TEST_ASSERT_EQUAL(interval, backoff.getInterval(interval));
+
+    // an interval beyond the maximum is kept
+    ShellyHttpBackoff slow;
+    slow.failed(2 * SHELLY_HTTP_MAX_BACKOFF);
+    TEST_ASSERT_EQUAL(0, slow.getFailures());
+    TEST_ASSERT_EQUAL(2 * SHELLY_HTTP_MAX_BACKOFF, slow.getInterval(2 * SHELLY_HTTP_MAX_BACKOFF));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rpc_replies);
+    RUN_TEST(test_keep_alive);
+    RUN_TEST(test_failures);
+    RUN_TEST(test_backoff);
+    return UNITY_END();
+}
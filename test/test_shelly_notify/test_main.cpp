@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// Ingestion of NotifyStatus messages like ShellyClientClass::HandleMessage does it: a mock Shelly
+// sends the changes of its power with the device time, the messages arrive after a network delay.
+// The samples must get the time of the change in the local time base, ordered and never in the future,
+// also with a drifting device clock, delay spikes and a device clock that is set.
+
+#include "ShellyDeviceClock.h"
+#include "ShellyJsonPaths.h"
+#include "ShellyJsonScanner.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+#define MOCK_DEVICE_EPOCH 1718100000000LL // [ms] device time at local time 0
+#define MOCK_MIN_DELAY 15 // [ms] transport delay without load
+#define MOCK_MAX_DELAY (MOCK_MIN_DELAY + 150)
+#define TS_RESOLUTION 10 // [ms] ts has two decimals
+#define MAX_ERROR 60 // [ms] min. delay, resolution and the time until a message with the min. delay comes
+
+// a Pro3EM which sends NotifyStatus on each change of the total power
+class MockShelly {
+public:
+    explicit MockShelly(unsigned seed)
+        : _random(seed)
+    {
+    }
+
+    // device clock: drift in ppm, a positive value is a fast clock
+    void setDrift(int ppm) { _driftPpm = ppm; }
+    void setClock(int64_t adjustMillis) { _adjustMillis += adjustMillis; }
+    // every n-th message is delayed by spikeMillis
+    void setSpikes(unsigned n, int spikeMillis)
+    {
+        _spikeEvery = n;
+        _spikeMillis = spikeMillis;
+    }
+
+    int64_t deviceMillis(time_t local) const { return MOCK_DEVICE_EPOCH + local + local * _driftPpm / 1000000 + _adjustMillis; }
+
+    // the next change and its message
+    struct message_t {
+        time_t changeTime; // local
+        time_t arrivalTime; // local
+        float value;
+        std::string frame;
+    };
+
+    message_t next(time_t changeTime)
+    {
+        message_t m;
+        m.changeTime = changeTime;
+        m.value = std::round(std::uniform_real_distribution<float>(-500, 2000)(_random) * 10) / 10;
+        int delay = MOCK_MIN_DELAY + _random() % (MOCK_MAX_DELAY - MOCK_MIN_DELAY);
+        if (_spikeEvery > 0 && ++_count % _spikeEvery == 0) {
+            delay += _spikeMillis;
+        }
+        m.arrivalTime = changeTime + delay;
+
+        char frame[256];
+        snprintf(frame, sizeof(frame),
+            R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":%.2f,"em:0":{"id":0,"total_act_power":%.1f}}})",
+            deviceMillis(changeTime) / 1000.0, m.value);
+        m.frame = frame;
+        return m;
+    }
+
+private:
+    std::mt19937 _random;
+    int _driftPpm = 0;
+    int64_t _adjustMillis = 0;
+    unsigned _spikeEvery = 0;
+    int _spikeMillis = 0;
+    unsigned _count = 0;
+};
+
+// the part of WebSocketData and HandleMessage, which turns a message into a sample
+class Ingestion {
+public:
+    Ingestion()
+        : _scanner(_paths, static_cast<size_t>(ShellyPath_t::MAX))
+    {
+        for (size_t i = 0; i < static_cast<size_t>(ShellyPath_t::MAX); i++) {
+            _paths[i] = ShellyJsonPaths[i];
+        }
+        _paths[static_cast<size_t>(ShellyPath_t::Value)] = ShellyDefaultValuePaths[static_cast<size_t>(ShellyDeviceType_t::Pro3EM)];
+    }
+
+    void reconnect() { _clock.reset(); }
+
+    // false if the message has no value
+    bool receive(const std::string& frame, time_t now, time_t& time, float& value)
+    {
+        _scanner.reset();
+        _scanner.feed(frame.data(), frame.size());
+
+        double v, ts;
+        if (!_scanner.getValue(static_cast<size_t>(ShellyPath_t::Value), v)) {
+            return false;
+        }
+        time = now;
+        if (_scanner.getValue(static_cast<size_t>(ShellyPath_t::Ts), ts)) {
+            time = _clock.toLocalTime(ts, now, _lastSampleTime);
+        }
+        _lastSampleTime = time;
+        value = v;
+        return true;
+    }
+
+private:
+    const char* _paths[static_cast<size_t>(ShellyPath_t::MAX)];
+    ShellyJsonScanner _scanner;
+    ShellyDeviceClock _clock;
+    time_t _lastSampleTime = 0;
+};
+
+struct ingestResult_t {
+    size_t samples;
+    int maxError; // |sample time - change time| after the first samples [ms]
+    size_t unordered;
+    size_t future;
+};
+
+// the changes of the mock, irregular like the grid power, in the order of arrival
+static ingestResult_t run(MockShelly& shelly, Ingestion& ingestion, time_t& local, size_t count, size_t settle = 20)
+{
+    std::mt19937 random(count);
+    ingestResult_t result = {};
+    time_t lastTime = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        local += 200 + random() % 2000;
+        MockShelly::message_t m = shelly.next(local);
+        // a later message may not overtake this one on the websocket
+        local = m.arrivalTime > local ? m.arrivalTime : local;
+
+        time_t time;
+        float value;
+        TEST_ASSERT_TRUE(ingestion.receive(m.frame, m.arrivalTime, time, value));
+        TEST_ASSERT_EQUAL_FLOAT(m.value, value);
+
+        result.samples++;
+        result.unordered += time < lastTime;
+        result.future += time > m.arrivalTime;
+        lastTime = time;
+
+        int error = std::abs(static_cast<int>(time - m.changeTime));
+        if (i >= settle && error > result.maxError) {
+            result.maxError = error;
+        }
+    }
+    return result;
+}
+
+static void report(const char* name, const ingestResult_t& result)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%-24s %zu samples, max. error %d ms", name, result.samples, result.maxError);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, result.unordered);
+    TEST_ASSERT_EQUAL(0, result.future);
+}
+
+static void test_change_time()
+{
+    // the samples get the time of the change, not the arrival
+    MockShelly shelly(1);
+    Ingestion ingestion;
+    time_t local = 0;
+    ingestResult_t result = run(shelly, ingestion, local, 500);
+    report("exact clock", result);
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR, result.maxError);
+}
+
+static void test_drift()
+{
+    static const struct {
+        int ppm;
+        int maxError;
+    } drifts[] = {
+        // a slower clock is followed up to SHELLY_CLOCK_MAX_DRIFT, beyond until the offset jumps
+        { -2 * SHELLY_CLOCK_MAX_DRIFT, SHELLY_CLOCK_MAX_JUMP + MOCK_MAX_DELAY },
+        { -SHELLY_CLOCK_MAX_DRIFT, MAX_ERROR + 20 },
+        { -100, MAX_ERROR + 20 },
+        { 100, MAX_ERROR + 20 },
+        { SHELLY_CLOCK_MAX_DRIFT, MAX_ERROR + 20 },
+        // a faster clock lowers the offset with every message, the arrival is the limit
+        { 10 * SHELLY_CLOCK_MAX_DRIFT, MOCK_MAX_DELAY + TS_RESOLUTION },
+    };
+
+    for (auto& drift : drifts) {
+        MockShelly shelly(2);
+        shelly.setDrift(drift.ppm);
+        Ingestion ingestion;
+        time_t local = 0;
+        ingestResult_t result = run(shelly, ingestion, local, 2000);
+
+        char name[32];
+        snprintf(name, sizeof(name), "drift %+d ppm", drift.ppm);
+        report(name, result);
+        TEST_ASSERT_LESS_OR_EQUAL(drift.maxError, result.maxError);
+    }
+}
+
+static void test_delay_spikes()
+{
+    // a slow message doesn't shift the following samples
+    MockShelly shelly(3);
+    shelly.setSpikes(7, 1500);
+    Ingestion ingestion;
+    time_t local = 0;
+    ingestResult_t result = run(shelly, ingestion, local, 500);
+    report("delay spikes", result);
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR, result.maxError);
+}
+
+static void test_clock_set()
+{
+    MockShelly shelly(4);
+    Ingestion ingestion;
+    time_t local = 0;
+    run(shelly, ingestion, local, 100);
+
+    // NTP sets the device clock, the next samples follow the new time
+    for (int64_t adjust : { 3600000LL, -7200000LL, 5000LL, -3000LL }) {
+        shelly.setClock(adjust);
+        ingestResult_t result = run(shelly, ingestion, local, 100, 1);
+        char name[32];
+        snprintf(name, sizeof(name), "clock set %+lld s", static_cast<long long>(adjust / 1000));
+        report(name, result);
+        TEST_ASSERT_LESS_OR_EQUAL(MOCK_MAX_DELAY + TS_RESOLUTION, result.maxError);
+    }
+
+    // after a reconnect the offset is measured again
+    ingestion.reconnect();
+    ingestResult_t result = run(shelly, ingestion, local, 100);
+    report("reconnect", result);
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR, result.maxError);
+}
+
+static void test_without_ts()
+{
+    // a reply of Shelly.GetStatus has no ts, the arrival is the time of the sample
+    Ingestion ingestion;
+    const std::string frame = R"({"id":2,"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","result":{"em:0":{"id":0,"total_act_power":-38.7}}})";
+    time_t time;
+    float value;
+    TEST_ASSERT_TRUE(ingestion.receive(frame, 12345, time, value));
+    TEST_ASSERT_EQUAL(12345, time);
+    TEST_ASSERT_EQUAL_FLOAT(-38.7, value);
+
+    // a notification without a power value is no sample
+    const std::string energy = R"({"method":"NotifyStatus","params":{"ts":1718100061.12,"emdata:0":{"id":0,"total_act_ret":845141.62}}})";
+    TEST_ASSERT_FALSE(ingestion.receive(energy, 13000, time, value));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_change_time);
+    RUN_TEST(test_drift);
+    RUN_TEST(test_delay_spikes);
+    RUN_TEST(test_clock_set);
+    RUN_TEST(test_without_ts);
+    return UNITY_END();
+}
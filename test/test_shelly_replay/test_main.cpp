@@ -0,0 +1,362 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// Replays Pro3EM and Plus Plug S traces through the JSON scanner with the paths of ShellyClient,
+// split into fragments like websocket frames, with truncated and malformed frames in between.
+// The sample path hands the values from a network thread to a loop thread through the
+// SampleRing into the RamBuffer and a SlidingWindow, like the network and the loop task.
+
+#include "RamBuffer.h"
+#include "SampleRing.h"
+#include "ShellyJsonPaths.h"
+#include "ShellyJsonScanner.h"
+#include "SlidingWindow.h"
+#include <cmath>
+#include <cstdio>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+typedef struct {
+    const char* frame;
+    double id; // NAN: not in the frame
+    double ts;
+    double value; // path of the device
+    double phaseA; // a_act_power
+} replayFrame_t;
+
+// Frames of a Pro3EM (firmware 1.x): the reply of Shelly.GetStatus, notifications with the changed values only,
+// notifications without power values and a full status.
+static const replayFrame_t Pro3EMTrace[] = {
+    { R"({"id":2,"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","result":{"ble":{},"cloud":{"connected":true},)"
+      R"("em:0":{"id":0,"a_current":1.297,"a_voltage":232.1,"a_act_power":-251.3,"a_aprt_power":301.2,"a_pf":-0.83,"a_freq":50.0,)"
+      R"("b_current":0.412,"b_voltage":231.4,"b_act_power":61.7,"b_aprt_power":95.3,"b_pf":0.65,"b_freq":50.0,)"
+      R"("c_current":0.875,"c_voltage":233.0,"c_act_power":150.9,"c_aprt_power":203.8,"c_pf":0.74,"c_freq":50.0,)"
+      R"("n_current":null,"total_current":2.584,"total_act_power":-38.7,"total_aprt_power":600.3,"user_calibrated_phase":[]},)"
+      R"("emdata:0":{"id":0,"a_total_act_energy":1523456.12,"a_total_act_ret_energy":845123.44,"b_total_act_energy":985412.31,)"
+      R"("b_total_act_ret_energy":12.5,"c_total_act_energy":1245789.02,"c_total_act_ret_energy":5.1,"total_act":3754657.45,"total_act_ret":845141.04},)"
+      R"("eth":{"ip":null},"modbus":{},"mqtt":{"connected":false},"sys":{"mac":"08F9E0E5A1B4","restart_required":false,"time":"12:01",)"
+      R"("unixtime":1718100060,"uptime":86412,"ram_size":247104,"ram_free":113464,"fs_size":524288,"fs_free":188416,"cfg_rev":21,)"
+      R"("kvs_rev":0,"schedule_rev":0,"webhook_rev":0,"available_updates":{},"reset_reason":3},"temperature:0":{"id":0,"tC":41.9,"tF":107.3},)"
+      R"("wifi":{"sta_ip":"192.168.1.52","status":"got ip","ssid":"home","rssi":-61},"ws":{"connected":true}}})",
+        2, NAN, -38.7, -251.3 },
+    { R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100061.12,)"
+      R"("em:0":{"id":0,"a_act_power":-260.4,"a_current":1.322,"total_act_power":-47.8,"total_current":2.609}}})",
+        NAN, 1718100061.12, -47.8, -260.4 },
+    { R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100062.15,)"
+      R"("em:0":{"id":0,"b_act_power":75.2,"b_current":0.468,"total_act_power":-34.3}}})",
+        NAN, 1718100062.15, -34.3, NAN },
+    { R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100062.98,)"
+      R"("emdata:0":{"id":0,"a_total_act_ret_energy":845124.02,"total_act_ret":845141.62}}})",
+        NAN, 1718100062.98, NAN, NAN },
+    { R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyEvent","params":{"ts":1718100063.01,)"
+      R"("events":[{"component":"em:0","id":0,"event":"power_update","ts":1718100063.01,"total_act_power":1.0}]}})",
+        NAN, 1718100063.01, NAN, NAN },
+    { R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100064.20,)"
+      R"("em:0":{"id":0,"a_act_power":512.6,"a_aprt_power":530.1,"a_current":2.291,"a_pf":0.97,)"
+      R"("total_act_power":739.5,"total_aprt_power":829.2,"total_current":3.578}}})",
+        NAN, 1718100064.20, 739.5, 512.6 },
+    { R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyFullStatus","params":{"ts":1718100065.00,)"
+      R"("em:0":{"id":0,"a_current":2.301,"a_voltage":231.8,"a_act_power":514.0,"a_aprt_power":532.4,"a_pf":0.97,"a_freq":50.0,)"
+      R"("b_current":0.468,"b_voltage":231.2,"b_act_power":75.2,"b_aprt_power":108.2,"b_pf":0.69,"b_freq":50.0,)"
+      R"("c_current":0.861,"c_voltage":232.7,"c_act_power":152.0,"c_aprt_power":200.4,"c_pf":0.76,"c_freq":50.0,)"
+      R"("n_current":null,"total_current":3.630,"total_act_power":741.2,"total_aprt_power":841.0,"user_calibrated_phase":[]},)"
+      R"("emdata:0":{"id":0,"total_act":3754660.11,"total_act_ret":845141.62},"sys":{"uptime":86417,"ram_free":113200}}})",
+        NAN, 1718100065.00, 741.2, 514.0 },
+    { R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100066.40,)"
+      R"("em:0":{"id":0,"a_act_power":4.12e2,"total_act_power":6.385E+2}}})",
+        NAN, 1718100066.40, 638.5, 412 },
+};
+
+// Frames of a Plus Plug S: the energy counters and the temperature contain keys like "total" and
+// "apower" is only part of some notifications
+static const replayFrame_t PlugSTrace[] = {
+    { R"({"id":2,"src":"shellyplusplugs-e465b8a3c1f0","dst":"user_1","result":{"ble":{},"cloud":{"connected":true},)"
+      R"("mqtt":{"connected":false},"plugs_ui":{},"switch:0":{"id":0,"source":"init","output":true,"apower":312.4,"voltage":231.9,)"
+      R"("current":1.384,"aenergy":{"total":45123.512,"by_minute":[5170.9,5201.3,5188.0],"minute_ts":1718100060},)"
+      R"("temperature":{"tC":38.2,"tF":100.8}},"sys":{"mac":"E465B8A3C1F0","uptime":5012,"available_updates":{"stable":{"version":"1.4.4"}}},)"
+      R"("wifi":{"sta_ip":"192.168.1.61","status":"got ip","ssid":"home","rssi":-55},"ws":{"connected":true}}})",
+        2, NAN, 312.4, NAN },
+    { R"({"src":"shellyplusplugs-e465b8a3c1f0","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100061.45,)"
+      R"("switch:0":{"id":0,"apower":318.9,"current":1.412}}})",
+        NAN, 1718100061.45, 318.9, NAN },
+    { R"({"src":"shellyplusplugs-e465b8a3c1f0","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100120.00,)"
+      R"("switch:0":{"id":0,"aenergy":{"by_minute":[5301.2,5170.9,5201.3],"minute_ts":1718100120,"total":45128.813}}}})",
+        NAN, 1718100120.00, NAN, NAN },
+    { R"({"src":"shellyplusplugs-e465b8a3c1f0","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100125.31,)"
+      R"("switch:0":{"id":0,"output":false,"source":"WS_in","apower":0,"current":0}}})",
+        NAN, 1718100125.31, 0, NAN },
+    { R"({"src":"shellyplusplugs-e465b8a3c1f0","dst":"user_1","method":"NotifyStatus","params":{"ts":1718100131.02,)"
+      R"("switch:0":{"id":0,"temperature":{"tC":39.0,"tF":102.2}}}})",
+        NAN, 1718100131.02, NAN, NAN },
+};
+
+// the paths of a device like WebSocketData sets them
+class ReplayScanner : public ShellyJsonScanner {
+public:
+    explicit ReplayScanner(ShellyDeviceType_t type)
+        : ShellyJsonScanner(_paths, static_cast<size_t>(ShellyPath_t::MAX))
+    {
+        for (size_t i = 0; i < static_cast<size_t>(ShellyPath_t::MAX); i++) {
+            _paths[i] = ShellyJsonPaths[i];
+        }
+        _paths[static_cast<size_t>(ShellyPath_t::Value)] = ShellyDefaultValuePaths[static_cast<size_t>(type)];
+    }
+
+    bool get(ShellyPath_t path, double& value) const { return getValue(static_cast<size_t>(path), value); }
+
+private:
+    const char* _paths[static_cast<size_t>(ShellyPath_t::MAX)];
+};
+
+static void checkPath(const ReplayScanner& scanner, ShellyPath_t path, double expected, const char* message)
+{
+    double value;
+    bool found = scanner.get(path, value);
+    if (std::isnan(expected)) {
+        TEST_ASSERT_FALSE_MESSAGE(found, message);
+        return;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(found, message);
+    TEST_ASSERT_TRUE_MESSAGE(value == expected, message);
+}
+
+static void checkFrame(const ReplayScanner& scanner, const replayFrame_t& frame, const char* message)
+{
+    TEST_ASSERT_TRUE_MESSAGE(scanner.isComplete(), message);
+    checkPath(scanner, ShellyPath_t::Id, frame.id, message);
+    checkPath(scanner, ShellyPath_t::Ts, frame.ts, message);
+    checkPath(scanner, ShellyPath_t::Value, frame.value, message);
+    checkPath(scanner, ShellyPath_t::ActPowerA, frame.phaseA, message);
+}
+
+// every split into two fragments and byte by byte, like fragmented websocket frames
+template <size_t N>
+static void replaySplit(ShellyDeviceType_t type, const replayFrame_t (&trace)[N])
+{
+    ReplayScanner scanner(type);
+    char message[64];
+
+    for (size_t f = 0; f < N; f++) {
+        const char* frame = trace[f].frame;
+        size_t length = strlen(frame);
+
+        for (size_t split = 0; split <= length; split++) {
+            scanner.reset();
+            scanner.feed(frame, split);
+            scanner.feed(frame + split, length - split);
+            snprintf(message, sizeof(message), "frame %zu, split at %zu", f, split);
+            checkFrame(scanner, trace[f], message);
+        }
+
+        scanner.reset();
+        for (size_t i = 0; i < length; i++) {
+            scanner.feed(frame + i, 1);
+        }
+        snprintf(message, sizeof(message), "frame %zu, byte by byte", f);
+        checkFrame(scanner, trace[f], message);
+    }
+}
+
+static void test_pro3em_trace()
+{
+    replaySplit(ShellyDeviceType_t::Pro3EM, Pro3EMTrace);
+}
+
+static void test_plugs_trace()
+{
+    replaySplit(ShellyDeviceType_t::PlugS, PlugSTrace);
+}
+
+static void test_malformed_frames()
+{
+    ReplayScanner scanner(ShellyDeviceType_t::Pro3EM);
+    double value;
+
+    // the values before the end of a truncated frame are used anyway
+    const char* frame = Pro3EMTrace[5].frame;
+    scanner.feed(frame, strstr(frame, "\"total_act_power\"") - frame);
+    TEST_ASSERT_FALSE(scanner.isComplete());
+    TEST_ASSERT_FALSE(scanner.get(ShellyPath_t::Value, value));
+    TEST_ASSERT_TRUE(scanner.get(ShellyPath_t::ActPowerA, value));
+    TEST_ASSERT_TRUE(value == 512.6);
+
+    static const char* const garbage[] = {
+        "HTTP/1.1 400 Bad Request",
+        "{\"params\":{\"em:0\":{\"total_act_power\":1}}}}",
+        "{\"params\":{\"em:0\":{\"total_act_power\":\"12.5\"}}}",
+        "",
+    };
+    for (const char* g : garbage) {
+        scanner.reset();
+        scanner.feed(g, strlen(g));
+        TEST_ASSERT_FALSE_MESSAGE(scanner.isComplete() && scanner.get(ShellyPath_t::Value, value), g);
+    }
+
+    // levels beyond SHELLY_JSON_MAX_DEPTH are skipped, the values after them are found
+    const char* deep = R"({"params":{"a":{"b":{"c":{"d":{"e":{"f":{"total_act_power":1}}}}}},"ts":5,"em:0":{"total_act_power":7}}})";
+    scanner.reset();
+    scanner.feed(deep, strlen(deep));
+    TEST_ASSERT_TRUE(scanner.isComplete());
+    TEST_ASSERT_TRUE(scanner.get(ShellyPath_t::Value, value));
+    TEST_ASSERT_EQUAL_FLOAT(7, value);
+    TEST_ASSERT_TRUE(scanner.get(ShellyPath_t::Ts, value));
+    TEST_ASSERT_EQUAL_FLOAT(5, value);
+}
+
+static void test_disconnect_within_frame()
+{
+    // the connection drops in the middle of a frame, the next connection starts with a new message
+    ReplayScanner scanner(ShellyDeviceType_t::Pro3EM);
+    const char* frame = Pro3EMTrace[5].frame;
+    scanner.feed(frame, strlen(frame) / 2);
+
+    scanner.reset();
+    frame = Pro3EMTrace[6].frame;
+    scanner.feed(frame, strlen(frame));
+    checkFrame(scanner, Pro3EMTrace[6], "after the reconnect");
+}
+
+////////////////////////
+
+#define REPLAY_RUNS 200 // of the Pro3EM trace, 10 s apart
+#define REPLAY_WINDOW 20000 // [ms] like the windows of LimitControl
+#define REPLAY_TIME_BASE 1718100000.0 // [s] device time of millis() 0
+
+static const uint16_t* replayCapacities()
+{
+    static uint16_t capacities[RAMBUFFER_TYPE_COUNT];
+    for (auto& capacity : capacities) {
+        capacity = 4;
+    }
+    capacities[static_cast<size_t>(RamDataType_t::Pro3EM)] = 256;
+    capacities[static_cast<size_t>(RamDataType_t::Pro3EM_A)] = 256;
+    return capacities;
+}
+
+// the samples of the trace, like ShellyClient::HandleMessage pushes them
+template <typename F>
+static void replaySamples(size_t fragment, F&& push)
+{
+    ReplayScanner scanner(ShellyDeviceType_t::Pro3EM);
+    time_t lastTime = 0;
+
+    for (size_t run = 0; run < REPLAY_RUNS; run++) {
+        for (auto& trace : Pro3EMTrace) {
+            scanner.reset();
+            size_t length = strlen(trace.frame);
+            for (size_t pos = 0; pos < length; pos += fragment) {
+                scanner.feed(trace.frame + pos, std::min(fragment, length - pos));
+            }
+
+            double ts;
+            time_t time = lastTime;
+            if (scanner.get(ShellyPath_t::Ts, ts)) {
+                time = static_cast<time_t>((ts - REPLAY_TIME_BASE) * 1000) + run * 10000;
+            }
+            lastTime = time;
+
+            double value;
+            if (scanner.get(ShellyPath_t::Value, value)) {
+                push({ RamDataType_t::Pro3EM, time, static_cast<float>(value) });
+            }
+            if (scanner.get(ShellyPath_t::ActPowerA, value)) {
+                push({ RamDataType_t::Pro3EM_A, time, static_cast<float>(value) });
+            }
+        }
+    }
+}
+
+static void test_sample_path()
+{
+    // reference: the same samples without threads
+    std::vector<dataEntry_t> expected;
+    replaySamples(4096, [&expected](const dataEntry_t& entry) { expected.push_back(entry); });
+
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(replayCapacities()));
+    RamBuffer buffer(memory.data(), memory.size(), replayCapacities());
+    buffer.PowerOnInitialize();
+    SlidingWindow window(REPLAY_WINDOW);
+
+    // network task: small fragments, waits if the ring is full like ShellyClientClass::Push
+    SampleRing<dataEntry_t, 16> ring;
+    std::atomic<bool> done(false);
+    std::thread network([&ring, &done]() {
+        replaySamples(7, [&ring](const dataEntry_t& entry) {
+            while (!ring.push(entry)) {
+                std::this_thread::yield();
+            }
+        });
+        done = true;
+    });
+
+    // loop task
+    size_t received = 0;
+    size_t mismatches = 0;
+    dataEntry_t entry;
+    while (!done || !ring.isEmpty()) {
+        if (!ring.pop(entry)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const dataEntry_t& reference = expected[received++];
+        mismatches += entry.type != reference.type || entry.time != reference.time || entry.value != reference.value;
+        buffer.writeValue(entry.type, entry.time, entry.value);
+        if (entry.type == RamDataType_t::Pro3EM) {
+            window.add(entry.time, entry.value);
+        }
+    }
+    network.join();
+
+    TEST_ASSERT_EQUAL(expected.size(), received);
+    TEST_ASSERT_EQUAL(0, mismatches);
+
+    // the newest samples of the ring buffer are the end of the trace
+    NativeMillis = expected.back().time;
+    std::vector<dataEntry_t> grid;
+    for (auto& e : expected) {
+        if (e.type == RamDataType_t::Pro3EM) {
+            grid.push_back(e);
+        }
+    }
+    dataEntry_t stored[256];
+    size_t count = buffer.copyEntries(RamDataType_t::Pro3EM, 0, 0, NativeMillis, stored, 256);
+    TEST_ASSERT_EQUAL(256, count);
+    for (size_t i = 0; i < count; i++) {
+        const dataEntry_t& reference = grid[grid.size() - count + i];
+        TEST_ASSERT_TRUE(stored[i].time == reference.time && stored[i].value == reference.value);
+    }
+
+    // the window and a scan of the buffer agree
+    float min = 1e9, max = -1e9;
+    for (auto& e : buffer.entries(RamDataType_t::Pro3EM, REPLAY_WINDOW)) {
+        float value = e.value; // packed
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(min, window.getMin());
+    TEST_ASSERT_EQUAL_FLOAT(max, window.getMax());
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pro3em_trace);
+    RUN_TEST(test_plugs_trace);
+    RUN_TEST(test_malformed_frames);
+    RUN_TEST(test_disconnect_within_frame);
+    RUN_TEST(test_sample_path);
+    return UNITY_END();
+}
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// The sample path of ShellyClientClass on the host: a mock Shelly sends NotifyStatus frames,
+// the network thread scans them and hands the samples to the loop thread through ShellySamplePath,
+// the loop thread stores them in ShellyClientData and uses them like LimitControl.
+// Run it in env:native_tsan to check the hand-off for data races.
+
+#include "ShellyClientData.h"
+#include "ShellyJsonPaths.h"
+#include "ShellyJsonScanner.h"
+#include "ShellySamplePath.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+#define MOCK_FRAMES 2000
+#define MOCK_INTERVAL 500 // [us] between the frames, faster than any Shelly
+#define LOOP_INTERVAL 1000 // [us] like the scheduler of the main loop
+#define COMMAND_EVERY 10 // samples per limit command
+
+// the websocket between the mock Shelly and the network thread
+class MockSocket {
+public:
+    void send(const std::string& frame)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _frames.push_back(frame);
+        _available.notify_one();
+    }
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _available.notify_one();
+    }
+    // false when closed and empty
+    bool receive(std::string& frame)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _available.wait(lock, [this]() { return _closed || !_frames.empty(); });
+        if (_frames.empty()) {
+            return false;
+        }
+        frame = _frames.front();
+        _frames.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _available;
+    std::deque<std::string> _frames;
+    bool _closed = false;
+};
+
+// a Pro3EM, the value of frame i is i
+static void mockShelly(MockSocket& socket, size_t frames)
+{
+    char frame[256];
+    for (size_t i = 0; i < frames; i++) {
+        snprintf(frame, sizeof(frame),
+            R"({"src":"shellypro3em-08f9e0e5a1b4","dst":"user_1","method":"NotifyStatus","params":{"ts":%.2f,"em:0":{"id":0,"total_act_power":%zu}}})",
+            1718100000 + i / 100.0, i);
+        socket.send(frame);
+        std::this_thread::sleep_for(std::chrono::microseconds(MOCK_INTERVAL));
+    }
+    socket.close();
+}
+
+// the part of ShellyClientClass::NetworkLoop, which turns the frames into samples
+static void networkTask(MockSocket& socket, ShellySamplePath& samples)
+{
+    const char* paths[static_cast<size_t>(ShellyPath_t::MAX)];
+    for (size_t i = 0; i < static_cast<size_t>(ShellyPath_t::MAX); i++) {
+        paths[i] = ShellyJsonPaths[i];
+    }
+    paths[static_cast<size_t>(ShellyPath_t::Value)] = ShellyDefaultValuePaths[static_cast<size_t>(ShellyDeviceType_t::Pro3EM)];
+    ShellyJsonScanner scanner(paths, static_cast<size_t>(ShellyPath_t::MAX));
+
+    std::string frame;
+    while (socket.receive(frame)) {
+        uint32_t arrivalMicros = micros();
+        scanner.reset();
+        scanner.feed(frame.data(), frame.size());
+        double value;
+        if (scanner.getValue(static_cast<size_t>(ShellyPath_t::Value), value)) {
+            shellySample_t sample = { { RamDataType_t::Pro3EM, static_cast<time_t>(value) * 10, static_cast<float>(value) }, arrivalMicros };
+            samples.push(sample, []() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+        }
+    }
+}
+
+struct loopResult_t {
+    size_t stored;
+    size_t unordered;
+    float last;
+};
+
+// ShellyClientClass::loop and LimitControl, stall blocks the loop once for a flash write
+static void loopTask(ShellySamplePath& samples, ShellyClientData& data, const std::atomic<bool>& done,
+    loopResult_t& result, std::chrono::milliseconds stall)
+{
+    result.last = -1;
+    while (true) {
+        bool finished = done;
+        shellySample_t sample;
+        while (samples.pop(sample)) {
+            data.Update(sample.entry.type, sample.entry.value, sample.entry.time);
+            samples.stored(sample);
+            result.unordered += sample.entry.value <= result.last;
+            result.last = sample.entry.value;
+            if (++result.stored % COMMAND_EVERY == 0) {
+                samples.markSent(RamDataType_t::Pro3EM);
+            }
+        }
+        samples.markUsed(RamDataType_t::Pro3EM);
+
+        if (finished) {
+            break;
+        }
+        if (stall.count() > 0 && result.stored > 0) {
+            std::this_thread::sleep_for(stall);
+            stall = std::chrono::milliseconds(0);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(LOOP_INTERVAL));
+    }
+}
+
+static void report(const char* name, ShellySamplePath& samples)
+{
+    static const char* stages[] = { "queue", "control", "command" };
+    char message[128];
+    for (size_t i = 0; i < static_cast<size_t>(ShellyLatencyStage_t::MAX); i++) {
+        shellyLatency_t latency = samples.getLatency(static_cast<ShellyLatencyStage_t>(i));
+        snprintf(message, sizeof(message), "%s %-8s %5" PRIu32 " samples, mean %6.0f us, max %6" PRIu32 " us", name, stages[i],
+            latency.count, latency.count > 0 ? static_cast<double>(latency.sumMicros) / latency.count : 0.0, latency.maxMicros);
+        TEST_MESSAGE(message);
+    }
+}
+
+static void run(ShellySamplePath& samples, ShellyClientData& data, loopResult_t& result, std::chrono::milliseconds stall)
+{
+    MockSocket socket;
+    std::atomic<bool> done(false);
+    std::thread loop(loopTask, std::ref(samples), std::ref(data), std::cref(done), std::ref(result), stall);
+    std::thread network(networkTask, std::ref(socket), std::ref(samples));
+    std::thread shelly(mockShelly, std::ref(socket), MOCK_FRAMES);
+    shelly.join();
+    network.join();
+    done = true;
+    loop.join();
+}
+
+static void test_hand_off()
+{
+    // the loop keeps up, every sample arrives in order
+    ShellySamplePath samples;
+    ShellyClientData data;
+    loopResult_t result = {};
+    run(samples, data, result, std::chrono::milliseconds(0));
+    report("hand-off", samples);
+
+    TEST_ASSERT_EQUAL(0, samples.getDropped());
+    TEST_ASSERT_EQUAL(MOCK_FRAMES, result.stored);
+    TEST_ASSERT_EQUAL(0, result.unordered);
+    TEST_ASSERT_EQUAL_FLOAT(MOCK_FRAMES - 1, data.GetActValue(RamDataType_t::Pro3EM));
+
+    shellyLatency_t queue = samples.getLatency(ShellyLatencyStage_t::Queue);
+    shellyLatency_t control = samples.getLatency(ShellyLatencyStage_t::Control);
+    shellyLatency_t command = samples.getLatency(ShellyLatencyStage_t::Command);
+    TEST_ASSERT_EQUAL(MOCK_FRAMES, queue.count);
+    // the control uses only the newest of the samples of a pass
+    TEST_ASSERT_GREATER_THAN(0, control.count);
+    TEST_ASSERT_LESS_OR_EQUAL(MOCK_FRAMES, control.count);
+    TEST_ASSERT_EQUAL(MOCK_FRAMES / COMMAND_EVERY, command.count);
+}
+
+static void test_blocked_loop()
+{
+    // a stalled loop fills the queue, the network thread waits and then drops
+    ShellySamplePath samples;
+    ShellyClientData data;
+    loopResult_t result = {};
+    run(samples, data, result, std::chrono::milliseconds(400));
+    report("blocked", samples);
+
+    char message[64];
+    snprintf(message, sizeof(message), "%zu stored, %" PRIu32 " dropped", result.stored, samples.getDropped());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, samples.getDropped());
+    TEST_ASSERT_EQUAL(MOCK_FRAMES, result.stored + samples.getDropped());
+    TEST_ASSERT_EQUAL(0, result.unordered);
+    // the oldest samples waited for the whole stall
+    TEST_ASSERT_GREATER_OR_EQUAL(400000, samples.getLatency(ShellyLatencyStage_t::Queue).maxMicros);
+}
+
+static void test_push_retries()
+{
+    ShellySamplePath samples;
+    shellySample_t sample = { { RamDataType_t::Pro3EM, 0, 0 }, 0 };
+    size_t waits = 0;
+    auto wait = [&waits]() { waits++; };
+
+    for (size_t i = 0; i < SHELLY_QUEUE_SIZE; i++) {
+        TEST_ASSERT_TRUE(samples.push(sample, wait));
+    }
+    TEST_ASSERT_EQUAL(0, waits);
+    TEST_ASSERT_FALSE(samples.push(sample, wait));
+    TEST_ASSERT_EQUAL(SHELLY_QUEUE_RETRIES, waits);
+    TEST_ASSERT_EQUAL(1, samples.getDropped());
+
+    // a wait in which the loop pops lets the sample in
+    auto pop = [&samples]() {
+        shellySample_t s;
+        samples.pop(s);
+    };
+    TEST_ASSERT_TRUE(samples.push(sample, pop));
+    TEST_ASSERT_EQUAL(1, samples.getDropped());
+}
+
+static void test_latency_stages()
+{
+    ShellySamplePath samples;
+
+    // no sample yet, nothing to measure
+    samples.markUsed(RamDataType_t::Pro3EM);
+    samples.markSent(RamDataType_t::Pro3EM);
+    TEST_ASSERT_EQUAL(0, samples.getLatency(ShellyLatencyStage_t::Control).count);
+    TEST_ASSERT_EQUAL(0, samples.getLatency(ShellyLatencyStage_t::Command).count);
+
+    shellySample_t sample = { { RamDataType_t::Pro3EM, 0, 0 }, static_cast<uint32_t>(micros()) };
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    samples.stored(sample);
+    samples.markUsed(RamDataType_t::Pro3EM);
+    // the same sample is used only once, the commands are all measured
+    samples.markUsed(RamDataType_t::Pro3EM);
+    samples.markSent(RamDataType_t::Pro3EM);
+    samples.markSent(RamDataType_t::Pro3EM);
+    // another type
+    samples.markUsed(RamDataType_t::PlugS);
+
+    shellyLatency_t queue = samples.getLatency(ShellyLatencyStage_t::Queue);
+    shellyLatency_t control = samples.getLatency(ShellyLatencyStage_t::Control);
+    shellyLatency_t command = samples.getLatency(ShellyLatencyStage_t::Command);
+    TEST_ASSERT_EQUAL(1, queue.count);
+    TEST_ASSERT_GREATER_OR_EQUAL(2000, queue.lastMicros);
+    TEST_ASSERT_EQUAL(1, control.count);
+    TEST_ASSERT_GREATER_OR_EQUAL(queue.lastMicros, control.lastMicros);
+    TEST_ASSERT_EQUAL(2, command.count);
+    TEST_ASSERT_GREATER_OR_EQUAL(control.lastMicros, command.maxMicros);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_push_retries);
+    RUN_TEST(test_latency_stages);
+    RUN_TEST(test_hand_off);
+    RUN_TEST(test_blocked_loop);
+    return UNITY_END();
+}
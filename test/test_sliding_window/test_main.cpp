@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Sebastian Hinz
+ */
+
+// SlidingWindow against a brute force scan of all samples, and a benchmark of the
+// window queries against the former scan of the RamBuffer.
+
+#include "RamBuffer.h"
+#include "SlidingWindow.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unity.h>
+#include <vector>
+
+#define WINDOW_LENGTH 20000 // [ms] like the windows of LimitControl
+#define BENCHMARK_INTERVAL 100 // [ms] between the samples of a fast meter
+#define BENCHMARK_SAMPLES 20000
+#define BENCHMARK_QUERIES 4 // per sample, like LimitControlClass::loop
+
+struct referenceSample_t {
+    time_t time;
+    float value;
+};
+
+// the expected values of the window, from all samples
+class BruteForce {
+public:
+    explicit BruteForce(time_t length)
+        : _length(length)
+    {
+    }
+
+    void add(time_t time, float value)
+    {
+        _samples.push_back({ time, value });
+        _last = value;
+        _now = time;
+    }
+    void carry(float value) { _last = value; }
+    void expire(time_t now) { _now = now; }
+
+    bool get(float& min, float& max, double& mean) const
+    {
+        min = INFINITY;
+        max = -INFINITY;
+        double sum = 0;
+        size_t count = 0;
+        for (auto& s : _samples) {
+            if (s.time >= _now - _length) {
+                min = std::min(min, s.value);
+                max = std::max(max, s.value);
+                sum += s.value;
+                count++;
+            }
+        }
+        if (count == 0) {
+            min = max = mean = _last;
+            return false;
+        }
+        mean = sum / count;
+        return true;
+    }
+
+private:
+    time_t _length;
+    time_t _now = 0;
+    float _last = 0;
+    std::vector<referenceSample_t> _samples;
+};
+
+static void compare(const SlidingWindow& window, const BruteForce& reference, const char* message)
+{
+    float min, max;
+    double mean;
+    bool hasSamples = reference.get(min, max, mean);
+    TEST_ASSERT_TRUE_MESSAGE(window.isEmpty() != hasSamples, message);
+    TEST_ASSERT_TRUE_MESSAGE(window.getMin() == min, message);
+    TEST_ASSERT_TRUE_MESSAGE(window.getMax() == max, message);
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.01, mean, window.getMean(), message);
+}
+
+static void test_random_against_brute_force()
+{
+    std::mt19937 random(2);
+    char message[64];
+
+    for (time_t length : { 1000, WINDOW_LENGTH, 120000 }) {
+        SlidingWindow window(length);
+        BruteForce reference(length);
+        time_t now = 0;
+
+        for (int i = 0; i < 20000; i++) {
+            snprintf(message, sizeof(message), "length %ld, step %d", static_cast<long>(length), i);
+            // equal times, regular samples and gaps longer than the window
+            unsigned step = random() % 100;
+            now += step < 10 ? 0 : step < 95 ? random() % 1500 : random() % (2 * length);
+
+            // steps with equal values and noise
+            float value = random() % 4 == 0 ? std::round(std::uniform_real_distribution<float>(-500, 500)(random))
+                                            : std::uniform_real_distribution<float>(-3000, 3000)(random);
+
+            switch (random() % 8) {
+            case 0:
+                window.carry(value);
+                reference.carry(value);
+                break;
+            case 1:
+                window.expire(now);
+                reference.expire(now);
+                break;
+            default:
+                window.add(now, value);
+                reference.add(now, value);
+                break;
+            }
+            compare(window, reference, message);
+        }
+    }
+}
+
+static void test_equal_values_expire_in_order()
+{
+    // the newest of equal values stays in the queues
+    SlidingWindow window(1000);
+    window.add(0, 5);
+    window.add(500, 5);
+    window.add(900, 7);
+    window.expire(1200);
+    TEST_ASSERT_EQUAL_FLOAT(5, window.getMin());
+    window.expire(1600);
+    TEST_ASSERT_EQUAL_FLOAT(7, window.getMin());
+    TEST_ASSERT_EQUAL_FLOAT(7, window.getMean());
+    window.expire(2000);
+    TEST_ASSERT_TRUE(window.isEmpty());
+    TEST_ASSERT_EQUAL_FLOAT(7, window.getMax());
+}
+
+static void test_carry_only_without_samples()
+{
+    SlidingWindow window(1000);
+    TEST_ASSERT_EQUAL_FLOAT(0, window.getMean());
+    window.carry(42);
+    TEST_ASSERT_TRUE(window.isEmpty());
+    TEST_ASSERT_EQUAL_FLOAT(42, window.getMin());
+    window.add(0, 10);
+    window.carry(42);
+    TEST_ASSERT_EQUAL_FLOAT(10, window.getMax());
+}
+
+////////////////////////
+
+static void test_benchmark()
+{
+    uint16_t capacities[RAMBUFFER_TYPE_COUNT];
+    for (auto& capacity : capacities) {
+        capacity = 4;
+    }
+    capacities[static_cast<size_t>(RamDataType_t::Pro3EM)] = WINDOW_LENGTH / BENCHMARK_INTERVAL + 32;
+    std::vector<uint8_t> memory(RamBuffer::requiredSize(capacities));
+    RamBuffer buffer(memory.data(), memory.size(), capacities);
+    buffer.PowerOnInitialize();
+    SlidingWindow window(WINDOW_LENGTH);
+
+    std::mt19937 random(3);
+    std::normal_distribution<float> noise(0, 30);
+    std::vector<float> values(BENCHMARK_SAMPLES);
+    for (auto& v : values) {
+        v = 300 + noise(random);
+    }
+
+    using clock = std::chrono::steady_clock;
+    clock::duration scanTime {};
+    clock::duration windowTime {};
+    volatile float sink = 0;
+    size_t mismatches = 0;
+
+    for (size_t i = 0; i < BENCHMARK_SAMPLES; i++) {
+        time_t time = i * BENCHMARK_INTERVAL;
+        NativeMillis = time;
+        buffer.writeValue(RamDataType_t::Pro3EM, time, values[i]);
+        window.add(time, values[i]);
+
+        // the former path of ShellyClientData: a scan per query
+        float min = 0, max = 0, mean = 0;
+        auto start = clock::now();
+        for (int q = 0; q < BENCHMARK_QUERIES; q++) {
+            min = INFINITY;
+            max = -INFINITY;
+            double sum = 0;
+            size_t count = 0;
+            for (auto& entry : buffer.entries(RamDataType_t::Pro3EM, WINDOW_LENGTH)) {
+                float value = entry.value; // packed
+                min = std::min(min, value);
+                max = std::max(max, value);
+                sum += value;
+                count++;
+            }
+            mean = sum / count;
+            sink = sink + min + max + mean;
+        }
+        scanTime += clock::now() - start;
+
+        start = clock::now();
+        for (int q = 0; q < BENCHMARK_QUERIES; q++) {
+            window.expire(time);
+            sink = sink + window.getMin() + window.getMax() + window.getMean();
+        }
+        windowTime += clock::now() - start;
+
+        mismatches += min != window.getMin() || max != window.getMax() || std::fabs(mean - window.getMean()) > 0.01;
+    }
+
+    using ns = std::chrono::nanoseconds;
+    double queries = BENCHMARK_SAMPLES * BENCHMARK_QUERIES;
+    char message[128];
+    snprintf(message, sizeof(message), "%d samples in the window: scan %.0f ns/query, SlidingWindow %.0f ns/query",
+        WINDOW_LENGTH / BENCHMARK_INTERVAL + 1, std::chrono::duration_cast<ns>(scanTime).count() / queries,
+        std::chrono::duration_cast<ns>(windowTime).count() / queries);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, mismatches);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int, char**)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_random_against_brute_force);
+    RUN_TEST(test_equal_values_expire_in_order);
+    RUN_TEST(test_carry_only_without_samples);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
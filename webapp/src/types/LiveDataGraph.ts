@@ -9,8 +9,16 @@ export const validDataNames = {
     data_plugs_max: 6,
     data_calculated_limit: 7,
     data_limit: 8,
+    data_pro3em_a: 9,
+    data_pro3em_b: 10,
+    data_pro3em_c: 11,
 };
 
+export interface DataPoint {
+    x: number;
+    y: number;
+}
+
 export interface SingleGraph {
     data_name: keyof typeof validDataNames;
     label: string;
@@ -40,14 +48,18 @@ export interface LiveDataGraph {
     diagram_limit: SingleGraph[];
     diagram_all: SingleGraph[];
 
-    data_pro3em: string;
-    data_pro3em_min: string;
-    data_pro3em_max: string;
+    data_pro3em?: DataPoint[];
+    data_pro3em_min?: DataPoint[];
+    data_pro3em_max?: DataPoint[];
+
+    data_plugs?: DataPoint[];
+    data_plugs_min?: DataPoint[];
+    data_plugs_max?: DataPoint[];
 
-    data_plugs: string;
-    data_plugs_min: string;
-    data_plugs_max: string;
+    data_calculated_limit?: DataPoint[];
+    data_limit?: DataPoint[];
 
-    data_calculated_limit: string;
-    data_limit: string;
+    data_pro3em_a?: DataPoint[];
+    data_pro3em_b?: DataPoint[];
+    data_pro3em_c?: DataPoint[];
 }
@@ -1,11 +1,24 @@
+export interface ShellyDevice {
+    hostname: string;
+    role: number;
+    type: number;
+    json_path: string;
+    transport: number;
+}
+
 export interface ShellyConfig {
     shelly_enable: boolean;
-    shelly_hostname_pro3em: string;
-    shelly_hostname_plugs: string;
+    devices: ShellyDevice[];
     limit_enable: boolean;
     max_power: number;
     min_power: number;
     target_value: number;
     feed_in_level: number;
     view_option: number;
+    grid_phase: number;
+    http_interval: number;
+    control_strategy: number;
+    pi_kp: number;
+    pi_ki: number;
+    pi_kff: number;
 }
@@ -0,0 +1,66 @@
+import { validDataNames, type DataPoint } from '@/types/LiveDataGraph';
+
+type DataName = keyof typeof validDataNames;
+
+// value encoding, see GraphEncoding_t in ShellyClientData.h
+const ENCODING_FLOAT = 0;
+const ENCODING_INT16_DECI = 2; // 1 is int16 in 1 W
+
+// Decodes the columns of /api/livedata/graph_bin into data points with x in seconds.
+export function decodeGraphData(buffer: ArrayBuffer): Partial<Record<DataName, DataPoint[]>> {
+    const view = new DataView(buffer);
+    const result: Partial<Record<DataName, DataPoint[]>> = {};
+    if (view.byteLength < 2 || view.getUint8(0) !== 1) {
+        return result;
+    }
+
+    const names = Object.keys(validDataNames) as DataName[];
+    const seriesCount = view.getUint8(1);
+    let pos = 2;
+
+    for (let s = 0; s < seriesCount; s++) {
+        const type = view.getUint8(pos);
+        const encoding = view.getUint8(pos + 1);
+        const count = view.getUint16(pos + 2, true);
+        pos += 4;
+
+        const points: DataPoint[] = [];
+        if (count > 0) {
+            let time = view.getUint32(pos, true);
+            pos += 4;
+            points.push({ x: time / 1000, y: 0 });
+
+            for (let i = 1; i < count; i++) {
+                let delta = 0;
+                let shift = 0;
+                let b = 0;
+                do {
+                    b = view.getUint8(pos++);
+                    delta += (b & 0x7f) * 2 ** shift;
+                    shift += 7;
+                } while (b & 0x80);
+                time += delta;
+                points.push({ x: time / 1000, y: 0 });
+            }
+
+            for (let i = 0; i < count; i++) {
+                if (encoding === ENCODING_FLOAT) {
+                    points[i].y = view.getFloat32(pos, true);
+                    pos += 4;
+                } else {
+                    // int16 in 1 W or 0.1 W
+                    const v = view.getInt16(pos, true);
+                    points[i].y = encoding === ENCODING_INT16_DECI ? v / 10 : v;
+                    pos += 2;
+                }
+            }
+        }
+
+        const name = names.find((n) => validDataNames[n] === type + 1);
+        if (name !== undefined) {
+            result[name] = points;
+        }
+    }
+
+    return result;
+}